@@ -234,7 +234,7 @@ void cli_client(int argc, char **argv, const char *prog_name) {
         }
     }
 #ifdef __linux__
-    if ((!pending_data) || fork() > 0) {
+    if ((!has_pending_clipboard_item()) || fork() > 0) {
         return;
     }
     set_pending_clipboard_item();
@@ -32,7 +32,6 @@
 #include <utils/utils.h>
 
 #ifdef __linux__
-#include <pthread.h>
 #include <sys/wait.h>
 #endif
 
@@ -65,14 +64,6 @@ typedef int MHD_Result_t;
 typedef enum MHD_Result MHD_Result_t;
 #endif
 
-#ifdef __linux__
-static void *set_clipboard_thread_fn(void *args) {
-    (void)args;
-    set_pending_clipboard_item();
-    return NULL;
-}
-#endif
-
 static void callback_fn(unsigned int status, const char *msg, size_t len, status_callback_params *params) {
     if ((!params) || params->called) {
         return;
@@ -243,10 +234,7 @@ static MHD_Result_t answer_to_connection(void *cls, struct MHD_Connection *conne
         }
         if (query.server) free(query.server);
 #ifdef __linux__
-        if (pending_data) {
-            pthread_t pt;
-            pthread_create(&pt, NULL, &set_clipboard_thread_fn, NULL);
-        }
+        if (has_pending_clipboard_item()) start_clipboard_owner();
 #endif
         if (handled) return MHD_YES;
     } else {
@@ -33,10 +33,6 @@ extern char *error_log_file;
 extern char *cwd;
 extern size_t cwd_len;
 
-#ifdef __linux__
-extern char *pending_data;
-#endif
-
 #if defined(__linux__) || defined(__APPLE__)
 extern const char *global_prog_name;
 #endif
@@ -53,9 +53,13 @@
 #define WEB_PORT 8888
 
 // maximum transfer sizes
-#define MAX_TEXT_LENGTH 4194304L           // 4 MiB
-#define MAX_FILE_SIZE 68719476736LL        // 64 GiB
-#define AUTO_SEND_MAX_FILE_SIZE 67108864L  // 64 MiB
+#define MAX_TEXT_LENGTH 4194304L            // 4 MiB
+#define MAX_FILE_SIZE 68719476736LL         // 64 GiB
+#define AUTO_SEND_MAX_FILE_SIZE 67108864L   // 64 MiB
+#define MAX_CLIPBOARD_IMAGE_SIZE 33554432L  // 32 MiB
+
+// files of at least this size are transferred in the streaming mode
+#define STREAMING_MIN_FILE_SIZE 1073741824L  // 1 GiB
 
 #define ERROR_LOG_FILE "client_err.log"
 
@@ -184,7 +188,15 @@ static inline void _apply_default_conf(void) {
     if (configuration.max_text_length <= 0) configuration.max_text_length = MAX_TEXT_LENGTH;
     if (configuration.max_file_size <= 0) configuration.max_file_size = MAX_FILE_SIZE;
     if (configuration.max_file_count <= 0) configuration.max_file_count = 0xFFFFFFFEUL;
+    if (configuration.streaming_min_file_size <= 0) configuration.streaming_min_file_size = STREAMING_MIN_FILE_SIZE;
+    if (configuration.streaming_direct_io < 0) configuration.streaming_direct_io = 0;
+    if (configuration.durability < 0) configuration.durability = DURABILITY_NONE;
+    if (configuration.receive_archive < 0) configuration.receive_archive = 0;
+    if (configuration.send_archive_members < 0) configuration.send_archive_members = 0;
+    if (configuration.send_order < 0) configuration.send_order = SEND_ORDER_WALK;
     if (configuration.cut_received_files < 0) configuration.cut_received_files = 0;
+    if (configuration.image_to_clipboard < 0) configuration.image_to_clipboard = 0;
+    if (configuration.max_clipboard_image_size <= 0) configuration.max_clipboard_image_size = MAX_CLIPBOARD_IMAGE_SIZE;
     if (configuration.min_proto_version < PROTOCOL_MIN) configuration.min_proto_version = PROTOCOL_MIN;
     if (configuration.min_proto_version > PROTOCOL_MAX) configuration.min_proto_version = PROTOCOL_MAX;
     if (configuration.max_proto_version < configuration.min_proto_version ||
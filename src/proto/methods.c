@@ -25,15 +25,29 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <utils/commit_stage.h>
+#include <utils/dir_cache.h>
+#include <utils/file_io.h>
 #include <utils/net_utils.h>
+#include <utils/read_order.h>
+#include <utils/tar_archive.h>
 #include <utils/unistr_wrap.h>
 #include <utils/utils.h>
+#include <utils/write_pool.h>
 
-#define FILE_BUF_SZ 65536L  // 64 KiB
 #define MAX_FILE_NAME_LENGTH 2048
 
+#if defined(__linux__) || defined(__APPLE__)
+#define WRITE_POOL_THREADS 4
+#define WRITE_POOL_BUDGET 67108864L      // 64 MiB
+#define WRITE_POOL_MAX_FILE_SIZE 65536L  // 64 KiB
+#endif
+
 #define MIN(x, y) (x < y ? x : y)
 
+// length of the parts of text validated and converted at a time while they are received or sent
+#define TEXT_PART_LEN 65536
+
 const char bad_path[] = {PATH_SEP, '.', '.', PATH_SEP, '\0'};  // /../
 const char *base32_alpha = "0123456789abcdefghijklmnopqrstuv";
 
@@ -60,18 +74,35 @@ static inline int _send_data(socket_t *socket, int64_t length, const char *data)
 /*
  * Common function to send files.
  */
-static int _send_files_common(int version, socket_t *socket, list2 *file_list, size_t path_len, int8_t is_auto_send,
-                              StatusCallback *callback);
+static int _send_files_common(int version, socket_t *socket, const path_store *store, size_t path_len,
+                              int8_t is_auto_send, StatusCallback *callback);
 
 /*
  * Common function to send files.
  */
 static int _get_files_dirs(int version, socket_t *socket, StatusCallback *callback);
 
+/*
+ * State of receiving the files of a get files operation.
+ */
+typedef struct _recv_ctx {
+    const char *dirname;  // directory which the files are received into
+    dir_cache *dirs;
+    tar_writer *archive;  // files are added to this archive instead of dirname if not NULL
+#if defined(__linux__) || defined(__APPLE__)
+    write_pool *pool;  // writes small files in the background if not NULL
+#endif
+} recv_ctx;
+
 /*
  * Common function to save files.
+ * ctx is NULL if the file is not received with a get files operation.
  */
-static int _save_file_common(int version, socket_t *socket, const char *file_name, StatusCallback *callback);
+static int _save_file_common(int version, socket_t *socket, const char *file_name, const recv_ctx *ctx,
+                             StatusCallback *callback);
+
+static int _write_file(socket_t *socket, const char *file_name, int64_t file_size, const recv_ctx *ctx,
+                       StatusCallback *callback);
 
 /*
  * Check if the file name is valid.
@@ -94,6 +125,92 @@ static inline int _send_ack(socket_t *socket);
 
 #endif
 
+/*
+ * Get the number of bytes at the end of the len bytes at buf, which may be the start of an incomplete UTF-8 character.
+ */
+static inline size_t _incomplete_char_len(const char *buf, size_t len) {
+    for (size_t i = 1; i <= 3 && i <= len; i++) {
+        const unsigned char c = (unsigned char)buf[len - i];
+        if ((c & 0xC0) == 0x80) continue;
+        const size_t char_len = (c >= 0xF0) ? 4 : ((c >= 0xE0) ? 3 : ((c >= 0xC0) ? 2 : 1));
+        return char_len > i ? i : 0;
+    }
+    return 0;
+}
+
+/*
+ * Receive a text of length bytes, validating it as UTF-8 and converting its line endings for the platform one part
+ * at a time as the parts are received.
+ * Sets text_len_p to the length of the converted text, which ends at the first '\0' if any.
+ * Returns the malloced, null-terminated text on success. Otherwise, sets resp_p to the response for the callback and
+ * returns NULL.
+ */
+static char *_read_text(socket_t *socket, size_t length, size_t *text_len_p, unsigned *resp_p) {
+    *resp_p = RESP_LOCAL_ERROR;
+    size_t cap = length + 1;
+    char *text = malloc(cap);
+    char *part = malloc(TEXT_PART_LEN + 3);  // +3 for the incomplete character kept from the previous part
+    if (!text || !part) {
+        if (text) free(text);
+        if (part) free(part);
+        return NULL;
+    }
+    size_t text_len = 0;
+    size_t kept = 0;
+    size_t remaining = length;
+    char prev = '\0';
+    int ended = 0;
+    int failed = 0;
+    while (remaining > 0) {
+        const size_t read_len = MIN(remaining, TEXT_PART_LEN);
+        if (read_sock(socket, part + kept, read_len) != EXIT_SUCCESS) {
+#ifdef DEBUG_MODE
+            fputs("Read data failed\n", stderr);
+#endif
+            *resp_p = RESP_COMMUNICATION_FAILURE;
+            failed = 1;
+            break;
+        }
+        remaining -= read_len;
+        size_t part_len = kept + read_len;
+        // an incomplete character at the end is validated with the next part
+        kept = remaining ? _incomplete_char_len(part, part_len) : 0;
+        if (u8_check((uint8_t *)part, part_len - kept)) {
+#ifdef DEBUG_MODE
+            fputs("Invalid UTF-8\n", stderr);
+#endif
+            *resp_p = RESP_DATA_ERROR;
+            failed = 1;
+            break;
+        }
+        if (remaining && !kept && part[part_len - 1] == '\r') kept = 1;  // an LF may follow it in the next part
+        part_len -= kept;
+        if (!ended && part_len > 0) {
+            const size_t max_len = convert_eol_max_len(part_len, 0);
+            if (cap - text_len <= max_len) {
+                cap += cap >> 1;
+                if (cap <= text_len + max_len) cap = text_len + max_len + 1;
+                text = realloc_or_free(text, cap);
+                if (!text) {
+                    failed = 1;
+                    break;
+                }
+            }
+            text_len += convert_eol_part(part, part_len, prev, 0, text + text_len, &ended);
+            prev = part[part_len - 1];
+        }
+        memmove(part, part + part_len, kept);
+    }
+    free(part);
+    if (failed) {
+        if (text) free(text);
+        return NULL;
+    }
+    text[text_len] = '\0';
+    *text_len_p = text_len;
+    return text;
+}
+
 static int _send_text_common(int version, socket_t *socket, StatusCallback *callback) {
     uint32_t length = 0;
     char *buf = get_clipboard_text(&length);
@@ -112,13 +229,16 @@ static int _send_text_common(int version, socket_t *socket, StatusCallback *call
         puts("");
     }
 #endif
-    int64_t new_len = convert_eol(&buf, 1);
-    if (new_len <= 0 || !buf) {
-        if (buf) free(buf);
+    // converting to LF shrinks the text. Therefore, it is converted in place and its length is known before sending
+    int ended = 0;
+    const size_t new_len = convert_eol_part(buf, length, '\0', 1, buf, &ended);
+    buf[new_len] = '\0';
+    if (new_len == 0) {
+        free(buf);
         if (callback) callback->function(RESP_NO_DATA, NULL, 0, callback->params);
         return EXIT_FAILURE;
     }
-    if (_send_data(socket, new_len, buf) != EXIT_SUCCESS) {
+    if (_send_data(socket, (int64_t)new_len, buf) != EXIT_SUCCESS) {
         free(buf);
         if (callback) callback->function(RESP_COMMUNICATION_FAILURE, NULL, 0, callback->params);
         return EXIT_FAILURE;
@@ -138,7 +258,7 @@ static int _send_text_common(int version, socket_t *socket, StatusCallback *call
     close_socket(socket);
 #endif
 
-    if (callback) callback->function(RESP_OK, buf, (size_t)new_len, callback->params);
+    if (callback) callback->function(RESP_OK, buf, new_len, callback->params);
     free(buf);
     return EXIT_SUCCESS;
 }
@@ -158,13 +278,11 @@ static int _get_text_common(int version, socket_t *socket, StatusCallback *callb
         return EXIT_FAILURE;
     }
 
-    char *data = malloc((size_t)length + 1);
-    if ((!data) || read_sock(socket, data, (uint64_t)length) != EXIT_SUCCESS) {
-#ifdef DEBUG_MODE
-        fputs("Read data failed\n", stderr);
-#endif
-        if (data) free(data);
-        if (callback) callback->function(RESP_COMMUNICATION_FAILURE, NULL, 0, callback->params);
+    size_t text_len;
+    unsigned resp;
+    char *data = _read_text(socket, (size_t)length, &text_len, &resp);
+    if (!data) {
+        if (callback) callback->function(resp, NULL, 0, callback->params);
         return EXIT_FAILURE;
     }
 #if PROTOCOL_MAX >= 4
@@ -172,17 +290,8 @@ static int _get_text_common(int version, socket_t *socket, StatusCallback *callb
 #endif
         close_socket_no_wait(socket);
 
-    data[length] = 0;
-    if (u8_check((uint8_t *)data, (size_t)length)) {
-#ifdef DEBUG_MODE
-        fputs("Invalid UTF-8\n", stderr);
-#endif
-        free(data);
-        if (callback) callback->function(RESP_DATA_ERROR, NULL, 0, callback->params);
-        return EXIT_FAILURE;
-    }
 #ifdef DEBUG_MODE
-    if (length < 1024) puts(data);
+    if (text_len < 1024) puts(data);
 #endif
 #if PROTOCOL_MAX >= 4
     if (version >= 4) {
@@ -194,11 +303,12 @@ static int _get_text_common(int version, socket_t *socket, StatusCallback *callb
 #else
     (void)version;
 #endif
-    if (callback) callback->function(RESP_OK, data, (size_t)length, callback->params);
-    length = convert_eol(&data, 0);
-    if (length <= 0 || !data) return EXIT_FAILURE;
-    put_clipboard_text(data, (uint32_t)length);
-    free(data);
+    if (callback) callback->function(RESP_OK, data, text_len, callback->params);
+    if (text_len == 0) {
+        free(data);
+        return EXIT_FAILURE;
+    }
+    put_clipboard_text(data, (uint32_t)text_len);  // data is owned by the clipboard from here
     return EXIT_SUCCESS;
 }
 
@@ -210,47 +320,72 @@ int get_text_v1(socket_t *socket, StatusCallback *callback) { return _get_text_c
 
 #endif
 
+/*
+ * Check if the files of a get files operation are synced together at the end of the operation.
+ * Otherwise, each file is synced when the durability policy is not DURABILITY_NONE.
+ */
+static inline int _is_batch_sync(void) {
+#ifdef __linux__
+    return configuration.durability == DURABILITY_BATCH;
+#else
+    return 0;  // syncfs is not available
+#endif
+}
+
+/*
+ * Get the file_io mode for transferring a file of the given size.
+ */
+static inline int _file_io_mode(int64_t file_size) {
+    if (file_size < configuration.streaming_min_file_size) return 0;
+    return FILE_IO_STREAM | (configuration.streaming_direct_io ? FILE_IO_DIRECT : 0);
+}
+
 static int _transfer_regular_file(socket_t *socket, const char *file_path, const char *filename, size_t fname_len,
                                   int8_t is_auto_send, StatusCallback *callback) {
-    FILE *fp = open_file(file_path, "rb");
-    if (!fp) {
+    file_reader *reader = open_file_reader(file_path);
+    if (!reader) {
         error("Couldn't open some files");
         return EXIT_FAILURE;
     }
-    int64_t file_size = get_file_size(fp);
+    int64_t file_size = file_reader_size(reader);
     if (file_size < 0 || file_size > configuration.max_file_size ||
         (is_auto_send && file_size > configuration.auto_send_max_file_size)) {
 #ifdef DEBUG_MODE
         printf("file size = %" PRIi64 "\n", file_size);
 #endif
-        fclose(fp);
+        close_file_reader(reader);
         return EXIT_FAILURE;
     }
+    file_reader_set_mode(reader, _file_io_mode(file_size));
 
     if (_send_data(socket, (int64_t)fname_len, filename) != EXIT_SUCCESS) {
-        fclose(fp);
+        close_file_reader(reader);
         if (callback) callback->function(RESP_COMMUNICATION_FAILURE, NULL, 0, callback->params);
         return EXIT_FAILURE;
     }
 
     if (send_size(socket, file_size) != EXIT_SUCCESS) {
-        fclose(fp);
+        close_file_reader(reader);
         if (callback) callback->function(RESP_COMMUNICATION_FAILURE, NULL, 0, callback->params);
         return EXIT_FAILURE;
     }
 
-    char data[FILE_BUF_SZ];
     while (file_size > 0) {
-        size_t read = fread(data, 1, FILE_BUF_SZ, fp);
-        if (read == 0) continue;
-        if (write_sock(socket, data, read) != EXIT_SUCCESS) {
-            fclose(fp);
+        size_t read_len;
+        const char *data = file_reader_read(reader, &read_len);
+        if (!data) {  // the file is truncated after sending its size
+            close_file_reader(reader);
+            return EXIT_FAILURE;
+        }
+        if ((uint64_t)file_size < read_len) read_len = (size_t)file_size;  // the file has grown
+        if (write_sock(socket, data, read_len) != EXIT_SUCCESS) {
+            close_file_reader(reader);
             if (callback) callback->function(RESP_COMMUNICATION_FAILURE, NULL, 0, callback->params);
             return EXIT_FAILURE;
         }
-        file_size -= (ssize_t)read;
+        file_size -= (int64_t)read_len;
     }
-    fclose(fp);
+    close_file_reader(reader);
     return EXIT_SUCCESS;
 }
 
@@ -283,10 +418,11 @@ static int _transfer_single_file(int version, socket_t *socket, const char *file
             break;
         }
 #endif
-#if (PROTOCOL_MIN <= 4) && (2 <= PROTOCOL_MAX)
+#if (PROTOCOL_MIN <= 5) && (2 <= PROTOCOL_MAX)
         case 2:
         case 3:
-        case 4: {
+        case 4:
+        case 5: {
             tmp_fname = file_path + path_len;
             break;
         }
@@ -325,29 +461,239 @@ static int _transfer_single_file(int version, socket_t *socket, const char *file
     return _transfer_regular_file(socket, file_path, filename, fname_len, is_auto_send, callback);
 }
 
-static int _send_files_common(int version, socket_t *socket, list2 *file_list, size_t path_len, int8_t is_auto_send,
-                              StatusCallback *callback) {
-    if ((!file_list) || file_list->len == 0 || file_list->len >= 0xFFFFFFFFUL) {
+/*
+ * Sends the end of the file list if required and completes the file sending.
+ */
+static int _finish_send_files(int version, socket_t *socket, StatusCallback *callback) {
+#if PROTOCOL_MAX >= 5
+    if (version >= 5 && send_size(socket, 0) != EXIT_SUCCESS) {  // end of the file list
+        if (callback) callback->function(RESP_COMMUNICATION_FAILURE, NULL, 0, callback->params);
+        return EXIT_FAILURE;
+    }
+#endif
+    if (callback) callback->function(RESP_OK, NULL, 0, callback->params);
+
+#if PROTOCOL_MAX >= 4
+    if (version >= 4) {
+        if (_read_ack(socket) != EXIT_SUCCESS && callback) {
+            callback->function(RESP_COMMUNICATION_FAILURE, NULL, 0, callback->params);
+        }
+        close_socket_no_wait(socket);
+    } else {
+        close_socket(socket);
+    }
+#else
+    (void)version;
+    close_socket(socket);
+#endif
+    return EXIT_SUCCESS;
+}
+
+#if PROTOCOL_MAX >= 2
+static inline int _is_tar_file(const char *path) {
+    const size_t len = strlen(path);
+    if (len <= 4 || path[len - 4] != '.') return 0;
+    const char *ext = path + len - 3;
+    return (ext[0] | 0x20) == 't' && (ext[1] | 0x20) == 'a' && (ext[2] | 0x20) == 'r';
+}
+
+/*
+ * Check if the name of an archive member can be sent as a relative path in the copied files.
+ * Absolute names, names with empty or ".." components, and names with control characters or invalid UTF-8 are rejected
+ * the same way as on the receiving side.
+ * returns 1 if the name is valid. Otherwise, returns 0.
+ */
+static int _is_valid_member_name(const char *name) {
+    const size_t name_len = strnlen(name, MAX_FILE_NAME_LENGTH + 1);
+    if (name_len == 0 || name_len > MAX_FILE_NAME_LENGTH || name[0] == '/' || strstr(name, "//")) return 0;
+    // path must not go to a parent directory when the files are saved
+    if (!strcmp(name, "..") || !strncmp(name, "../", 3) || strstr(name, "/../") ||
+        (name_len >= 3 && !strcmp(name + name_len - 3, "/.."))) {
+        return 0;
+    }
+    return _is_valid_fname(name, name_len) == EXIT_SUCCESS;
+}
+
+/*
+ * Send a member of the archive, which is the current entry of the reader, as a file or directory.
+ */
+static int _transfer_archive_member(socket_t *socket, tar_reader *tar, const char *name, int64_t size,
+                                    StatusCallback *callback) {
+    const size_t name_len = strnlen(name, MAX_FILE_NAME_LENGTH + 1);
+    if (name_len > MAX_FILE_NAME_LENGTH) {
+        error("Invalid file name length.");
+        return EXIT_FAILURE;
+    }
+#if PROTOCOL_MAX >= 3
+    if (size < 0) return _transfer_directory(socket, name, name_len, callback);
+#endif
+    if (_send_data(socket, (int64_t)name_len, name) != EXIT_SUCCESS || send_size(socket, size) != EXIT_SUCCESS) {
+        if (callback) callback->function(RESP_COMMUNICATION_FAILURE, NULL, 0, callback->params);
+        return EXIT_FAILURE;
+    }
+    while (size > 0) {
+        size_t read_len;
+        const char *data = tar_reader_read(tar, &read_len);
+        if (!data) return EXIT_FAILURE;  // the archive is truncated
+        if (write_sock(socket, data, read_len) != EXIT_SUCCESS) {
+            if (callback) callback->function(RESP_COMMUNICATION_FAILURE, NULL, 0, callback->params);
+            return EXIT_FAILURE;
+        }
+        size -= (int64_t)read_len;
+    }
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Count the members of the archive to send, which are regular files, and directories from version 3, with valid names.
+ * returns the number of members or -1 on failure.
+ */
+static int64_t _count_archive_members(int version, const char *archive_path) {
+    tar_reader *tar = open_tar_reader(archive_path);
+    if (!tar) return -1;
+    int64_t cnt = 0;
+    const char *name;
+    int64_t size;
+    int status;
+    while ((status = tar_reader_next(tar, &name, &size)) == 1) {
+        if ((size >= 0 || version >= 3) && _is_valid_member_name(name)) cnt++;
+    }
+    close_tar_reader(tar);
+    return status == 0 ? cnt : -1;
+}
+
+/*
+ * Send the members of the tar archive at archive_path as files and directories without extracting the archive.
+ */
+static int _send_archive_members(int version, socket_t *socket, const char *archive_path, int8_t is_auto_send,
+                                 StatusCallback *callback) {
+    int64_t file_cnt = 0;
+    if (version < 5) {
+        // the archive is read twice since the file count is sent before the files
+        file_cnt = _count_archive_members(version, archive_path);
+        if (file_cnt <= 0 || file_cnt >= 0xFFFFFFFFL) {
+            error("Couldn't read the archive");
+            if (callback) callback->function(RESP_NO_DATA, NULL, 0, callback->params);
+            return EXIT_FAILURE;
+        }
+        if (is_auto_send && (uint64_t)file_cnt > configuration.auto_send_max_files) return EXIT_FAILURE;
+        if (send_size(socket, file_cnt) != EXIT_SUCCESS) {
+            if (callback) callback->function(RESP_COMMUNICATION_FAILURE, NULL, 0, callback->params);
+            return EXIT_FAILURE;
+        }
+    }
+    tar_reader *tar = open_tar_reader(archive_path);
+    if (!tar) {
+        error("Couldn't open some files");
+        return EXIT_FAILURE;
+    }
+    int64_t sent_cnt = 0;
+    const char *name;
+    int64_t size;
+    int status;
+    while ((status = tar_reader_next(tar, &name, &size)) == 1) {
+        if (size < 0 && version < 3) continue;  // directories are created from the paths of the files
+        if (!_is_valid_member_name(name)) {
+#ifdef DEBUG_MODE
+            printf("Skipped invalid member name in the archive: %s\n", name);
+#endif
+            continue;
+        }
+        sent_cnt++;
+        if ((version < 5 && sent_cnt > file_cnt) || size > configuration.max_file_size) {
+            status = -1;
+            break;
+        }
+        if (is_auto_send &&
+            ((uint64_t)sent_cnt > configuration.auto_send_max_files || size > configuration.auto_send_max_file_size)) {
+            status = -1;
+            break;
+        }
+#ifdef DEBUG_MODE
+        printf("file name = %s\n", name);
+#endif
+        if (_transfer_archive_member(socket, tar, name, size, callback) != EXIT_SUCCESS) {
+            status = -1;
+            break;
+        }
+    }
+    close_tar_reader(tar);
+    if (status != 0 || sent_cnt == 0 || (version < 5 && sent_cnt != file_cnt)) {
+#ifdef DEBUG_MODE
+        puts("Transfer failed");
+#endif
+        if (sent_cnt == 0 && callback) callback->function(RESP_NO_DATA, NULL, 0, callback->params);
+        return EXIT_FAILURE;
+    }
+    return _finish_send_files(version, socket, callback);
+}
+#endif
+
+/*
+ * Get the limits of auto-send to stop walking the copied directories as soon as they are exceeded.
+ * returns budget if is_auto_send is set, or NULL otherwise.
+ */
+static inline const walk_budget *_get_send_budget(int8_t is_auto_send, walk_budget *budget) {
+    if (!is_auto_send) return NULL;
+    budget->max_files = configuration.auto_send_max_files;
+    budget->max_file_size = configuration.auto_send_max_file_size;
+    return budget;
+}
+
+static int _send_files_common(int version, socket_t *socket, const path_store *store, size_t path_len,
+                              int8_t is_auto_send, StatusCallback *callback) {
+    uint32_t file_cnt = store ? path_store_count(store) : 0;
+    if (file_cnt == 0 || file_cnt >= 0xFFFFFFFFUL) {
         if (callback) callback->function(RESP_NO_DATA, NULL, 0, callback->params);
         return EXIT_FAILURE;
     }
 
-    uint32_t file_cnt = file_list->len;
     if (is_auto_send && file_cnt > configuration.auto_send_max_files) {
         return EXIT_FAILURE;
     }
-    char **files = (char **)file_list->array;
+    path_iter *iter = path_store_iter(store);
+    if (!iter) return EXIT_FAILURE;
+#if PROTOCOL_MAX >= 2
+    if (configuration.send_archive_members && version > 1 && file_cnt == 1) {
+        const char *file_path = path_iter_next(iter, NULL);
+        if (file_path && _is_tar_file(file_path)) {
+            int ret = _send_archive_members(version, socket, file_path, is_auto_send, callback);
+            free_path_iter(iter);
+            return ret;
+        }
+        // not an archive. Send the file from the start of the path store
+        free_path_iter(iter);
+        iter = path_store_iter(store);
+        if (!iter) return EXIT_FAILURE;
+    }
+#endif
 #ifdef DEBUG_MODE
     printf("%" PRIu32 "file(s)\n", file_cnt);
 #endif
-    if (version > 1 && (send_size(socket, (int64_t)file_cnt) != EXIT_SUCCESS)) {
+    arena *mem = NULL;
+    list2 *sorted_paths = NULL;
+#if defined(__linux__) || defined(__APPLE__)
+    if (configuration.send_order != SEND_ORDER_WALK && version > 1) {
+        // the files are sent in the walk order if sorting fails
+        mem = new_arena(0);
+        sorted_paths = mem ? sort_paths_for_reading(store, configuration.send_order == SEND_ORDER_EXTENT, mem) : NULL;
+        if (sorted_paths && sorted_paths->len != file_cnt) sorted_paths = NULL;
+    }
+#endif
+    int status = EXIT_SUCCESS;
+    // file count is not sent from version 5. Instead, the end of the file list is sent after all files
+    if (version > 1 && version < 5 && (send_size(socket, (int64_t)file_cnt) != EXIT_SUCCESS)) {
         if (callback) callback->function(RESP_COMMUNICATION_FAILURE, NULL, 0, callback->params);
-        return EXIT_FAILURE;
+        status = EXIT_FAILURE;
     }
     if (version == 1) file_cnt = 1;  // proto v1 can only send 1 file
 
-    for (uint32_t i = 0; i < file_cnt; i++) {
-        const char *file_path = files[i];
+    for (uint32_t i = 0; status == EXIT_SUCCESS && i < file_cnt; i++) {
+        const char *file_path = sorted_paths ? (const char *)sorted_paths->array[i] : path_iter_next(iter, NULL);
+        if (!file_path) {
+            status = EXIT_FAILURE;
+            break;
+        }
 #ifdef DEBUG_MODE
         printf("file name = %s\n", file_path);
 #endif
@@ -356,27 +702,79 @@ static int _send_files_common(int version, socket_t *socket, list2 *file_list, s
 #ifdef DEBUG_MODE
             puts("Transfer failed");
 #endif
-            return EXIT_FAILURE;
+            status = EXIT_FAILURE;
         }
     }
-    if (callback) callback->function(RESP_OK, NULL, 0, callback->params);
+    free_path_iter(iter);
+    if (mem) free_arena(mem);
+    if (status != EXIT_SUCCESS) return EXIT_FAILURE;
+    return _finish_send_files(version, socket, callback);
+}
 
-#if PROTOCOL_MAX >= 4
-    if (version >= 4) {
-        if (_read_ack(socket) != EXIT_SUCCESS && callback) {
-            callback->function(RESP_COMMUNICATION_FAILURE, NULL, 0, callback->params);
+#if (defined(__linux__) || defined(__APPLE__)) && (PROTOCOL_MIN <= 5) && (5 <= PROTOCOL_MAX)
+/*
+ * Send files from a directory stream as they are found, without waiting for the directory walk to complete.
+ */
+static int _send_files_stream(int version, socket_t *socket, dir_stream *stream, size_t path_len, int8_t is_auto_send,
+                              StatusCallback *callback) {
+    uint32_t file_cnt = 0;
+    char *file_path;
+    while ((file_path = dir_stream_next(stream)) != NULL) {
+        file_cnt++;
+        if (is_auto_send && file_cnt > configuration.auto_send_max_files) {
+            free(file_path);
+            return EXIT_FAILURE;
+        }
+#ifdef DEBUG_MODE
+        printf("file name = %s\n", file_path);
+#endif
+        int status = _transfer_single_file(version, socket, file_path, path_len, is_auto_send, callback);
+        free(file_path);
+        if (status != EXIT_SUCCESS) {
+#ifdef DEBUG_MODE
+            puts("Transfer failed");
+#endif
+            return EXIT_FAILURE;
         }
-        close_socket_no_wait(socket);
-    } else {
-        close_socket(socket);
     }
-#else
-    close_socket(socket);
+    if (dir_stream_status(stream) != EXIT_SUCCESS) return EXIT_FAILURE;
+    if (file_cnt == 0) {
+        if (callback) callback->function(RESP_NO_DATA, NULL, 0, callback->params);
+        return EXIT_FAILURE;
+    }
+#ifdef DEBUG_MODE
+    printf("%" PRIu32 "file(s)\n", file_cnt);
+#endif
+    return _finish_send_files(version, socket, callback);
+}
+#endif
+
+#if defined(__linux__) || defined(__APPLE__)
+/*
+ * Receive a small file into a buffer and let the write pool create and write it.
+ */
+static int _save_file_pooled(socket_t *socket, const char *file_name, int64_t file_size, write_pool *pool,
+                             StatusCallback *callback) {
+    char *buf = write_pool_buf(pool, file_name, (size_t)file_size);
+    if (!buf) {
+        error("Couldn't create some files");
+        return EXIT_FAILURE;
+    }
+    if (file_size > 0 && read_sock(socket, buf, (size_t)file_size) != EXIT_SUCCESS) {
+#ifdef DEBUG_MODE
+        puts("recieve error");
 #endif
+        write_pool_discard(pool);
+        if (callback) callback->function(RESP_COMMUNICATION_FAILURE, NULL, 0, callback->params);
+        return EXIT_FAILURE;
+    }
+    write_pool_submit(pool);
     return EXIT_SUCCESS;
 }
+#endif
 
-static int _save_file_common(int version, socket_t *socket, const char *file_name, StatusCallback *callback) {
+static int _save_file_common(int version, socket_t *socket, const char *file_name, const recv_ctx *ctx,
+                             StatusCallback *callback) {
     int64_t file_size;
     if (read_size(socket, &file_size) != EXIT_SUCCESS) {
         if (callback) callback->function(RESP_COMMUNICATION_FAILURE, NULL, 0, callback->params);
@@ -390,9 +788,9 @@ static int _save_file_common(int version, socket_t *socket, const char *file_nam
         return EXIT_FAILURE;
     }
 
-#if (PROTOCOL_MIN <= 4) && (3 <= PROTOCOL_MAX)
+#if (PROTOCOL_MIN <= 5) && (3 <= PROTOCOL_MAX)
     if (file_size == -1 && version >= 3) {
-        return mkdirs(file_name);
+        return ctx ? dir_cache_mkdirs(ctx->dirs, file_name) : mkdirs(file_name);
     }
 #else
     (void)version;
@@ -402,33 +800,55 @@ static int _save_file_common(int version, socket_t *socket, const char *file_nam
         return EXIT_FAILURE;
     }
 
-    FILE *file = open_file(file_name, "wb");
-    if (!file) {
+#if defined(__linux__) || defined(__APPLE__)
+    if (ctx && ctx->pool && file_size <= WRITE_POOL_MAX_FILE_SIZE) {
+        return _save_file_pooled(socket, file_name, file_size, ctx->pool, callback);
+    }
+#endif
+    return _write_file(socket, file_name, file_size, ctx, callback);
+}
+
+/*
+ * Receive file_size bytes of data from the socket into a new file at file_name.
+ */
+static int _write_file(socket_t *socket, const char *file_name, int64_t file_size, const recv_ctx *ctx,
+                       StatusCallback *callback) {
+    // space for the whole file is reserved before receiving it
+    int mode = _file_io_mode(file_size);
+    // files of a get files operation are synced at the end with the batch policy
+    if (configuration.durability != DURABILITY_NONE && !(ctx && _is_batch_sync())) mode |= FILE_IO_SYNC;
+    file_writer *writer = open_file_writer(file_name, file_size, mode);
+    if (!writer) {
+        // the file is not removed. It may be an existing file of the same name
         error("Couldn't create some files");
         return EXIT_FAILURE;
     }
 
-    char data[FILE_BUF_SZ];
     while (file_size) {
-        size_t read_len = file_size < FILE_BUF_SZ ? (size_t)file_size : FILE_BUF_SZ;
-        if (read_sock(socket, data, read_len) != EXIT_SUCCESS) {
+        size_t buf_len;
+        char *buf = file_writer_buf(writer, &buf_len);
+        size_t read_len = (uint64_t)file_size < buf_len ? (size_t)file_size : buf_len;
+        if (read_sock(socket, buf, read_len) != EXIT_SUCCESS) {
 #ifdef DEBUG_MODE
             puts("recieve error");
 #endif
-            fclose(file);
+            close_file_writer(writer);
             remove_file(file_name);
             if (callback) callback->function(RESP_COMMUNICATION_FAILURE, NULL, 0, callback->params);
             return EXIT_FAILURE;
         }
-        if (fwrite(data, 1, read_len, file) < read_len) {
-            fclose(file);
+        if (file_writer_commit(writer, read_len) != EXIT_SUCCESS) {
+            close_file_writer(writer);
             remove_file(file_name);
             return EXIT_FAILURE;
         }
         file_size -= (int64_t)read_len;
     }
 
-    fclose(file);
+    if (close_file_writer(writer) != EXIT_SUCCESS) {
+        remove_file(file_name);
+        return EXIT_FAILURE;
+    }
 
 #ifdef DEBUG_MODE
     printf("file saved : %s\n", file_name);
@@ -450,8 +870,13 @@ static inline int _is_valid_fname(const char *fname, size_t name_length) {
     return EXIT_SUCCESS;
 }
 
-static char *get_abs_path(const char *rel_path, size_t rel_path_max_len) {
-    char *path = (char *)malloc(cwd_len + rel_path_max_len + 2);  // for PATH_SEP and null terminator
+/*
+ * Get the absolute path of the relative path in the working directory.
+ * The path is allocated from the arena mem if it is not NULL. Otherwise, it is allocated with malloc.
+ */
+static char *get_abs_path(const char *rel_path, size_t rel_path_max_len, arena *mem) {
+    const size_t path_sz = cwd_len + rel_path_max_len + 2;  // for PATH_SEP and null terminator
+    char *path = (char *)(mem ? arena_alloc(mem, path_sz) : malloc(path_sz));
     if (!path) return NULL;
     strncpy(path, cwd, cwd_len);
     size_t p_len = cwd_len;
@@ -475,10 +900,30 @@ static inline int _get_base_name(char *file_name, size_t name_length) {
     return EXIT_SUCCESS;
 }
 
-int send_file_v1(socket_t *socket, int8_t is_auto_send, StatusCallback *callback) {
+/*
+ * Get the copied files in a path store with their absolute paths in the top level directory.
+ */
+static path_store *_get_copied_files_store(void) {
     list2 *file_list = get_copied_files();
-    int ret = _send_files_common(1, socket, file_list, 0, is_auto_send, callback);
-    if (file_list) free_list(file_list);
+    if (!file_list) return NULL;
+    path_store *store = new_path_store();
+    ps_writer *writer = store ? path_store_writer(store) : NULL;
+    if (writer) {
+        for (uint32_t i = 0; i < file_list->len; i++) {
+            const char *file_path = file_list->array[i];
+            if (path_store_add_file(writer, path_store_root(store), file_path, strlen(file_path)) != EXIT_SUCCESS) {
+                break;
+            }
+        }
+    }
+    free_list(file_list);
+    return store;
+}
+
+int send_file_v1(socket_t *socket, int8_t is_auto_send, StatusCallback *callback) {
+    path_store *store = _get_copied_files_store();
+    int ret = _send_files_common(1, socket, store, 0, is_auto_send, callback);
+    if (store) free_path_store(store);
     return ret;
 }
 
@@ -498,10 +943,41 @@ static inline void _set_filename(char *filename) {
     }
 }
 
+/*
+ * Receive an image of size bytes into memory, to be put into the clipboard without saving it to a file.
+ * returns the malloced image on success or NULL on failure.
+ */
+static char *_read_image(socket_t *socket, int64_t size, StatusCallback *callback) {
+    char *data = malloc((size_t)size);
+    if (!data) return NULL;
+    if (read_sock(socket, data, (uint64_t)size) != EXIT_SUCCESS) {
+#ifdef DEBUG_MODE
+        puts("recieve error");
+#endif
+        free(data);
+        if (callback) callback->function(RESP_COMMUNICATION_FAILURE, NULL, 0, callback->params);
+        return NULL;
+    }
+    return data;
+}
+
 static inline int _save_image_common(int version, socket_t *socket, StatusCallback *callback) {
     char file_name[] = "000000000.png";  // array length is sufficient until year 3084
-    _set_filename(file_name);
-    int status = _save_file_common(version, socket, file_name, callback);
+    char *image = NULL;
+    int64_t size;
+    int status = EXIT_FAILURE;
+    if (read_size(socket, &size) != EXIT_SUCCESS) {
+        if (callback) callback->function(RESP_COMMUNICATION_FAILURE, NULL, 0, callback->params);
+    } else if (size < 0 || size > configuration.max_file_size) {
+        if (callback) callback->function(RESP_DATA_ERROR, NULL, 0, callback->params);
+    } else if (configuration.image_to_clipboard && size > 0 && size <= configuration.max_clipboard_image_size) {
+        // images up to the limit skip the disk, and larger images are saved to a file
+        image = _read_image(socket, size, callback);
+        if (image) status = EXIT_SUCCESS;
+    } else {
+        _set_filename(file_name);
+        status = _write_file(socket, file_name, size, NULL, callback);
+    }
     if (status != EXIT_SUCCESS && callback) {
         callback->function(RESP_LOCAL_ERROR, NULL, 0, callback->params);
     }
@@ -518,6 +994,14 @@ static inline int _save_image_common(int version, socket_t *socket, StatusCallba
     (void)version;
     close_socket_no_wait(socket);
 #endif
+    if (image) {
+        if (put_clipboard_image(image, (uint32_t)size) != EXIT_SUCCESS) {
+            if (callback) callback->function(RESP_LOCAL_ERROR, NULL, 0, callback->params);
+            return EXIT_FAILURE;
+        }
+        if (callback) callback->function(RESP_OK, "clipboard", 9, callback->params);
+        return EXIT_SUCCESS;
+    }
     if (status != EXIT_SUCCESS || !configuration.cut_received_files) {
         if (callback) {
             callback->function(RESP_OK, file_name, strnlen(file_name, sizeof(file_name) - 1), callback->params);
@@ -526,7 +1010,7 @@ static inline int _save_image_common(int version, socket_t *socket, StatusCallba
     }
     list2 *dest_files = init_list(1);
     if (!dest_files) return EXIT_FAILURE;
-    char *abs_path = get_abs_path(file_name, 40);
+    char *abs_path = get_abs_path(file_name, 40, NULL);
     if (!abs_path) {
         free_list(dest_files);
         return EXIT_FAILURE;
@@ -600,11 +1084,11 @@ int info_v1(socket_t *socket, StatusCallback *callback) {
 /*
  * Make parent directories for path
  */
-static inline int _make_directories(const char *path) {
+static inline int _make_directories(char *path, dir_cache *dirs) {
     char *base_name = strrchr(path, PATH_SEP);
     if (!base_name) return EXIT_FAILURE;
     *base_name = 0;
-    if (mkdirs(path) != EXIT_SUCCESS) {
+    if (dir_cache_mkdirs(dirs, path) != EXIT_SUCCESS) {
         *base_name = PATH_SEP;
         return EXIT_FAILURE;
     }
@@ -612,7 +1096,60 @@ static inline int _make_directories(const char *path) {
     return EXIT_SUCCESS;
 }
 
-static inline int _validate_and_save(int version, socket_t *socket, const char *dirname, char *file_name,
+#if PROTOCOL_MAX >= 2
+/*
+ * Receive a file or directory as a new entry of the archive.
+ * file_name uses / as the path separator.
+ */
+static int _save_archive_entry(int version, socket_t *socket, tar_writer *archive, const char *file_name,
+                               StatusCallback *callback) {
+    while (file_name[0] == '/') file_name++;
+    const size_t name_len = strlen(file_name);
+    // path must not go to a parent directory when the archive is extracted
+    if (name_len == 0 || !strcmp(file_name, "..") || !strncmp(file_name, "../", 3) || strstr(file_name, "/../") ||
+        (name_len >= 3 && !strcmp(file_name + name_len - 3, "/.."))) {
+        if (callback) callback->function(RESP_DATA_ERROR, NULL, 0, callback->params);
+        return EXIT_FAILURE;
+    }
+
+    int64_t file_size;
+    if (read_size(socket, &file_size) != EXIT_SUCCESS) {
+        if (callback) callback->function(RESP_COMMUNICATION_FAILURE, NULL, 0, callback->params);
+        return EXIT_FAILURE;
+    }
+#ifdef DEBUG_MODE
+    printf("data len = %" PRIi64 "\n", file_size);
+#endif
+    // directories are sent from version 3
+    if (file_size > configuration.max_file_size || file_size < -1 || (file_size == -1 && version < 3)) {
+        if (callback) callback->function(RESP_DATA_ERROR, NULL, 0, callback->params);
+        return EXIT_FAILURE;
+    }
+    if (tar_add_entry(archive, file_name, name_len, file_size) != EXIT_SUCCESS) {
+        error("Couldn't write to the archive");
+        return EXIT_FAILURE;
+    }
+    while (file_size > 0) {
+        size_t buf_len;
+        char *buf = tar_writer_buf(archive, &buf_len);
+        if (read_sock(socket, buf, buf_len) != EXIT_SUCCESS) {
+#ifdef DEBUG_MODE
+            puts("recieve error");
+#endif
+            if (callback) callback->function(RESP_COMMUNICATION_FAILURE, NULL, 0, callback->params);
+            return EXIT_FAILURE;
+        }
+        if (tar_writer_commit(archive, buf_len) != EXIT_SUCCESS) {
+            error("Couldn't write to the archive");
+            return EXIT_FAILURE;
+        }
+        file_size -= (int64_t)buf_len;
+    }
+    return EXIT_SUCCESS;
+}
+#endif
+
+static inline int _validate_and_save(int version, socket_t *socket, const recv_ctx *ctx, char *file_name,
                                      size_t name_length, StatusCallback *callback) {
     if (_is_valid_fname(file_name, name_length) != EXIT_SUCCESS) {
 #ifdef DEBUG_MODE
@@ -622,6 +1159,9 @@ static inline int _validate_and_save(int version, socket_t *socket, const char *
         return EXIT_FAILURE;
     }
     if (file_name[name_length - 1] == '/') file_name[name_length - 1] = 0;  // remove trailing /
+#if PROTOCOL_MAX >= 2
+    if (ctx->archive) return _save_archive_entry(version, socket, ctx->archive, file_name, callback);
+#endif
 
 #if PATH_SEP != '/'
     // replace '/' with PATH_SEP
@@ -647,29 +1187,27 @@ static inline int _validate_and_save(int version, socket_t *socket, const char *
 
     char new_path[name_length + 20];
     if (file_name[0] == PATH_SEP) {
-        if (snprintf_check(new_path, name_length + 20, "%s%s", dirname, file_name)) return EXIT_FAILURE;
+        if (snprintf_check(new_path, name_length + 20, "%s%s", ctx->dirname, file_name)) return EXIT_FAILURE;
     } else {
-        if (snprintf_check(new_path, name_length + 20, "%s%c%s", dirname, PATH_SEP, file_name)) return EXIT_FAILURE;
+        if (snprintf_check(new_path, name_length + 20, "%s%c%s", ctx->dirname, PATH_SEP, file_name)) {
+            return EXIT_FAILURE;
+        }
     }
 
     // path must not contain /../ (go to parent dir)
     if (strstr(new_path, bad_path)) return EXIT_FAILURE;
 
     // make parent directories
-    if (version > 1 && _make_directories(new_path) != EXIT_SUCCESS) return EXIT_FAILURE;
+    if (version > 1 && _make_directories(new_path, ctx->dirs) != EXIT_SUCCESS) return EXIT_FAILURE;
 
     // check if file exists
     if (file_exists(new_path)) return EXIT_FAILURE;
 
-    return _save_file_common(version, socket, new_path, callback);
+    return _save_file_common(version, socket, new_path, ctx, callback);
 }
 
-static int save_file(int version, socket_t *socket, const char *dirname, StatusCallback *callback) {
-    int64_t fname_size;
-    if (read_size(socket, &fname_size) != EXIT_SUCCESS) {
-        if (callback) callback->function(RESP_COMMUNICATION_FAILURE, NULL, 0, callback->params);
-        return EXIT_FAILURE;
-    }
+static int save_file(int version, socket_t *socket, const recv_ctx *ctx, int64_t fname_size,
+                     StatusCallback *callback) {
 #ifdef DEBUG_MODE
     printf("name_len = %" PRIi64 "\n", fname_size);
 #endif
@@ -690,59 +1228,162 @@ static int save_file(int version, socket_t *socket, const char *dirname, StatusC
     }
     file_name[name_length] = 0;
 
-    return _validate_and_save(version, socket, dirname, file_name, name_length, callback);
+    return _validate_and_save(version, socket, ctx, file_name, name_length, callback);
 }
 
-static char *_check_and_rename(const char *filename, const char *dirname) {
+static char *_check_and_rename(const char *filename, commit_stage *stage, arena *mem) {
     const size_t name_len = strnlen(filename, MAX_FILE_NAME_LENGTH + 1);
     if (name_len > MAX_FILE_NAME_LENGTH) {
         error("Too long file name.");
         return NULL;
     }
     const size_t name_max_len = name_len + 20;
-    char old_path[name_max_len];
-    if (snprintf_check(old_path, name_max_len, "%s%c%s", dirname, PATH_SEP, filename)) return NULL;
-
     char new_path[name_max_len];
-    if (configuration.working_dir != NULL || strcmp(filename, CONFIG_FILE)) {
-        // "./" is important to prevent file names like "C:\path"
-        if (snprintf_check(new_path, name_max_len, ".%c%s", PATH_SEP, filename)) return NULL;
-    } else {
-        // do not create file named clipshare-desktop.conf. "./" is important to prevent file names like "C:\path"
-        if (snprintf_check(new_path, name_max_len, ".%c1_%s", PATH_SEP, filename)) return NULL;
-    }
+    // do not create file named clipshare-desktop.conf
+    int allow_plain_name = configuration.working_dir != NULL || strcmp(filename, CONFIG_FILE);
+    // if the name is already taken, use a different file name
+    if (commit_entry(stage, filename, allow_plain_name, new_path, name_max_len) != EXIT_SUCCESS) return NULL;
 
-    // if new_path already exists, use a different file name
-    int n = 1;
-    while (file_exists(new_path)) {
-        if (n > 999999L) return NULL;
-        if (snprintf_check(new_path, name_max_len, ".%c%i_%s", PATH_SEP, n, filename)) {
-            return NULL;
-        }
-        n++;
-    }
+    char *path = get_abs_path(new_path + 2, name_max_len, mem);  // +2 for ./ (new_path always starts with ./)
+    return path;
+}
 
-    if (rename_file(old_path, new_path)) {
-#ifdef DEBUG_MODE
-        printf("Rename failed : %s\n", new_path);
+/*
+ * Receive the files into the directory ctx->dirname, or into the archive ctx->archive if it is not NULL.
+ * The directory is created through the cache ctx->dirs together with the sub-directories of the received files.
+ * Returns after all the files are written.
+ */
+static int _receive_files(int version, socket_t *socket, const recv_ctx *ctx, int64_t cnt, StatusCallback *callback) {
+    if (!ctx->archive && dir_cache_mkdirs(ctx->dirs, ctx->dirname) != EXIT_SUCCESS) return EXIT_FAILURE;
+
+    for (int64_t file_num = 0; version >= 5 || file_num < cnt; file_num++) {
+        int64_t fname_size;
+        if (read_size(socket, &fname_size) != EXIT_SUCCESS) {
+            if (callback) callback->function(RESP_COMMUNICATION_FAILURE, NULL, 0, callback->params);
+            return EXIT_FAILURE;
+        }
+#if PROTOCOL_MAX >= 5
+        if (version >= 5) {
+            if (fname_size == 0) {  // end of the file list
+                if (file_num > 0) break;
+                if (callback) callback->function(RESP_NO_DATA, NULL, 0, callback->params);
+                return EXIT_FAILURE;
+            }
+            if ((uint64_t)file_num >= configuration.max_file_count) {
+                if (callback) callback->function(RESP_DATA_ERROR, NULL, 0, callback->params);
+                return EXIT_FAILURE;
+            }
+        }
 #endif
-        return NULL;
+        if (save_file(version, socket, ctx, fname_size, callback) != EXIT_SUCCESS) {
+            return EXIT_FAILURE;
+        }
     }
+#if defined(__linux__) || defined(__APPLE__)
+    if (ctx->pool && write_pool_wait(ctx->pool) != EXIT_SUCCESS) {
+        error("Couldn't create some files");
+        return EXIT_FAILURE;
+    }
+#endif
+    return EXIT_SUCCESS;
+}
 
-    char *path = get_abs_path(new_path + 2, name_max_len);  // +2 for ./ (new_path always starts with ./)
-    return path;
+/*
+ * Complete a get files operation after saving the received files.
+ * The transfer is acknowledged only if status is EXIT_SUCCESS. The saved files dest_files are cut into the clipboard
+ * if configured.
+ * returns the final status of the operation.
+ */
+static int _finish_get_files(int version, socket_t *socket, int status, list2 *dest_files, StatusCallback *callback) {
+    if (status != EXIT_SUCCESS && callback) {
+        callback->function(RESP_LOCAL_ERROR, NULL, 0, callback->params);
+    }
+#if PROTOCOL_MAX >= 4
+    if (version >= 4 && status == EXIT_SUCCESS) {
+        if (_send_ack(socket) != EXIT_SUCCESS && callback) {
+            callback->function(RESP_COMMUNICATION_FAILURE, NULL, 0, callback->params);
+        }
+        close_socket(socket);
+    } else {
+        close_socket_no_wait(socket);
+    }
+#else
+    (void)version;
+    (void)socket;
+#endif
+    if (callback) callback->function(RESP_OK, NULL, 0, callback->params);
+    if (configuration.cut_received_files && status == EXIT_SUCCESS &&
+        set_clipboard_cut_files(dest_files) != EXIT_SUCCESS)
+        status = EXIT_FAILURE;
+    return status;
 }
 
-static int _get_files_dirs(int version, socket_t *socket, StatusCallback *callback) {
-    int64_t cnt;
-    if (read_size(socket, &cnt) != EXIT_SUCCESS) {
-        if (callback) callback->function(RESP_COMMUNICATION_FAILURE, NULL, 0, callback->params);
+#if PROTOCOL_MAX >= 2
+/*
+ * Receive the files of a get files operation into a new tar archive in the working directory.
+ */
+static int _get_files_archive(int version, socket_t *socket, int64_t cnt, StatusCallback *callback) {
+    char archive_path[24];
+    unsigned id = (unsigned)time(NULL);
+    do {
+        if (snprintf_check(archive_path, 24, ".%c%x.tar", PATH_SEP, id)) return EXIT_FAILURE;
+        id = (unsigned)rand();
+    } while (file_exists(archive_path));
+
+    recv_ctx ctx = {.dirname = archive_path};
+    // the archive is a single file. So, it is synced when closed unless the durability policy is DURABILITY_NONE
+    ctx.archive = open_tar_writer(archive_path, configuration.durability != DURABILITY_NONE ? FILE_IO_SYNC : 0);
+    if (!ctx.archive) {
+        error("Couldn't create some files");
         return EXIT_FAILURE;
     }
-    if (cnt <= 0 || (uint64_t)cnt > configuration.max_file_count) {
-        if (callback) callback->function(RESP_NO_DATA, NULL, 0, callback->params);
+    int status = _receive_files(version, socket, &ctx, cnt, callback);
+    if (close_tar_writer(ctx.archive) != EXIT_SUCCESS) status = EXIT_FAILURE;
+    if (status != EXIT_SUCCESS) {
+        remove_file(archive_path);
+        return EXIT_FAILURE;
+    }
+
+#if PROTOCOL_MAX >= 4
+    if (version < 4)
+#endif
+        close_socket_no_wait(socket);
+
+    arena *mem = new_arena(0);
+    if (!mem) return EXIT_FAILURE;
+    list2 *dest_files = init_list_arena(mem, 1);
+    char *path = dest_files ? get_abs_path(archive_path + 2, sizeof(archive_path), mem) : NULL;  // +2 for ./
+    if (!path) {
+        free_arena(mem);
         return EXIT_FAILURE;
     }
+    append(dest_files, path);
+    if (configuration.durability != DURABILITY_NONE && sync_directory(".", 0) != EXIT_SUCCESS) status = EXIT_FAILURE;
+    status = _finish_get_files(version, socket, status, dest_files, callback);
+    free_arena(mem);
+    return status;
+}
+#endif
+
+static int _get_files_dirs(int version, socket_t *socket, StatusCallback *callback) {
+    int64_t cnt = 0;
+#if PROTOCOL_MAX >= 5
+    if (version < 5) {  // file count is not sent from version 5
+#endif
+        if (read_size(socket, &cnt) != EXIT_SUCCESS) {
+            if (callback) callback->function(RESP_COMMUNICATION_FAILURE, NULL, 0, callback->params);
+            return EXIT_FAILURE;
+        }
+        if (cnt <= 0 || (uint64_t)cnt > configuration.max_file_count) {
+            if (callback) callback->function(RESP_NO_DATA, NULL, 0, callback->params);
+            return EXIT_FAILURE;
+        }
+#if PROTOCOL_MAX >= 5
+    }
+#endif
+#if PROTOCOL_MAX >= 2
+    if (configuration.receive_archive && version >= 2) return _get_files_archive(version, socket, cnt, callback);
+#endif
     char dirname[17];
     unsigned id = (unsigned)time(NULL);
     do {
@@ -750,71 +1391,79 @@ static int _get_files_dirs(int version, socket_t *socket, StatusCallback *callba
         id = (unsigned)rand();
     } while (file_exists(dirname));
 
-    if (mkdirs(dirname) != EXIT_SUCCESS) return EXIT_FAILURE;
+    recv_ctx ctx = {.dirname = dirname};
+    // each directory is created only once for the transfer
+    ctx.dirs = new_dir_cache();
+    if (!ctx.dirs) return EXIT_FAILURE;
+#if defined(__linux__) || defined(__APPLE__)
+    // small files are written in the background. They are written by the receiving thread if the pool is NULL
+    int sync_mode = 0;
+    if (configuration.durability != DURABILITY_NONE) {
+        sync_mode = _is_batch_sync() ? WRITE_POOL_WRITE_BACK : WRITE_POOL_SYNC;
+    }
+    ctx.pool = new_write_pool(WRITE_POOL_THREADS, WRITE_POOL_BUDGET, sync_mode);
+#endif
+    int recv_status = _receive_files(version, socket, &ctx, cnt, callback);
+#if defined(__linux__) || defined(__APPLE__)
+    if (ctx.pool) free_write_pool(ctx.pool);
+#endif
+    // created directories are synced before they are moved. The batch policy syncs them with the file system
+    if (recv_status == EXIT_SUCCESS && configuration.durability != DURABILITY_NONE && !_is_batch_sync() &&
+        dir_cache_sync(ctx.dirs) != EXIT_SUCCESS)
+        recv_status = EXIT_FAILURE;
+    free_dir_cache(ctx.dirs);
+    if (recv_status != EXIT_SUCCESS) return EXIT_FAILURE;
 
-    for (int64_t file_num = 0; file_num < cnt; file_num++) {
-        if (save_file(version, socket, dirname, callback) != EXIT_SUCCESS) {
-            return EXIT_FAILURE;
-        }
-    }
 #if PROTOCOL_MAX >= 4
     if (version < 4)
 #endif
         close_socket_no_wait(socket);
 
-    list2 *files = list_dir(dirname);
-    if (!files) return EXIT_FAILURE;
-    int status = EXIT_SUCCESS;
-    list2 *dest_files = init_list(files->len);
-    if (!dest_files) {
-        free_list(files);
+    // file names and paths are needed only until the end of this operation
+    arena *mem = new_arena(0);
+    if (!mem) return EXIT_FAILURE;
+    list2 *files = list_dir(dirname, mem);
+    list2 *dest_files = files ? init_list_arena(mem, files->len) : NULL;
+    commit_stage *stage = dest_files ? open_commit_stage(dirname) : NULL;
+    if (!stage) {
+        free_arena(mem);
         return EXIT_FAILURE;
     }
+    int status = EXIT_SUCCESS;
     for (uint32_t i = 0; i < files->len; i++) {
         const char *filename = files->array[i];
-        char *new_path = _check_and_rename(filename, dirname);
+        char *new_path = _check_and_rename(filename, stage, mem);
         if (!new_path) {
             status = EXIT_FAILURE;
             continue;
         }
         append(dest_files, new_path);
     }
-    free_list(files);
+    close_commit_stage(stage);
     if (status == EXIT_SUCCESS && remove_directory(dirname)) status = EXIT_FAILURE;
-    if (status != EXIT_SUCCESS && callback) {
-        callback->function(RESP_LOCAL_ERROR, NULL, 0, callback->params);
-    }
-#if PROTOCOL_MAX >= 4
-    if (version >= 4 && status == EXIT_SUCCESS) {
-        if (_send_ack(socket) != EXIT_SUCCESS && callback) {
-            callback->function(RESP_COMMUNICATION_FAILURE, NULL, 0, callback->params);
-        }
-        close_socket(socket);
-    } else {
-        close_socket_no_wait(socket);
-    }
-#endif
-    if (callback) callback->function(RESP_OK, NULL, 0, callback->params);
-    if (configuration.cut_received_files && status == EXIT_SUCCESS &&
-        set_clipboard_cut_files(dest_files) != EXIT_SUCCESS)
+    // sync the renamed entries, or all the received data with the batch policy, before acknowledging
+    if (status == EXIT_SUCCESS && configuration.durability != DURABILITY_NONE &&
+        sync_directory(".", _is_batch_sync()) != EXIT_SUCCESS)
         status = EXIT_FAILURE;
-    free_list(dest_files);
+    status = _finish_get_files(version, socket, status, dest_files, callback);
+    free_arena(mem);
     return status;
 }
 
 #if (PROTOCOL_MIN <= 2) && (2 <= PROTOCOL_MAX)
 int send_files_v2(socket_t *socket, int8_t is_auto_send, StatusCallback *callback) {
+    walk_budget budget;
     dir_files copied_dir_files;
-    get_copied_dirs_files(&copied_dir_files, 0);
-    int ret = _send_files_common(2, socket, copied_dir_files.lst, copied_dir_files.path_len, is_auto_send, callback);
-    if (copied_dir_files.lst) free_list(copied_dir_files.lst);
+    get_copied_dirs_files(&copied_dir_files, 0, _get_send_budget(is_auto_send, &budget));
+    int ret = _send_files_common(2, socket, copied_dir_files.store, copied_dir_files.path_len, is_auto_send, callback);
+    if (copied_dir_files.store) free_path_store(copied_dir_files.store);
     return ret;
 }
 
 int get_files_v2(socket_t *socket, StatusCallback *callback) { return _get_files_dirs(2, socket, callback); }
 #endif
 
-#if (PROTOCOL_MIN <= 4) && (3 <= PROTOCOL_MAX)
+#if (PROTOCOL_MIN <= 5) && (3 <= PROTOCOL_MAX)
 static inline int _get_screenshot_common(int version, socket_t *socket, uint16_t display, StatusCallback *callback) {
     if (send_size(socket, (int32_t)display) != EXIT_SUCCESS) {
         if (callback) callback->function(RESP_COMMUNICATION_FAILURE, NULL, 0, callback->params);
@@ -844,17 +1493,18 @@ int get_screenshot_v3(socket_t *socket, uint16_t display, StatusCallback *callba
 }
 
 int send_files_v3(socket_t *socket, int8_t is_auto_send, StatusCallback *callback) {
+    walk_budget budget;
     dir_files copied_dir_files;
-    get_copied_dirs_files(&copied_dir_files, 1);
-    int ret = _send_files_common(3, socket, copied_dir_files.lst, copied_dir_files.path_len, is_auto_send, callback);
-    if (copied_dir_files.lst) free_list(copied_dir_files.lst);
+    get_copied_dirs_files(&copied_dir_files, 1, _get_send_budget(is_auto_send, &budget));
+    int ret = _send_files_common(3, socket, copied_dir_files.store, copied_dir_files.path_len, is_auto_send, callback);
+    if (copied_dir_files.store) free_path_store(copied_dir_files.store);
     return ret;
 }
 
 int get_files_v3(socket_t *socket, StatusCallback *callback) { return _get_files_dirs(3, socket, callback); }
 #endif
 
-#if (PROTOCOL_MIN <= 4) && (4 <= PROTOCOL_MAX)
+#if (PROTOCOL_MIN <= 5) && (4 <= PROTOCOL_MAX)
 
 static inline int _read_ack(socket_t *socket) {
     char status;
@@ -888,11 +1538,12 @@ int send_text_v4(socket_t *socket, StatusCallback *callback) { return _send_text
 int get_files_v4(socket_t *socket, StatusCallback *callback) { return _get_files_dirs(4, socket, callback); }
 
 int send_files_v4(socket_t *socket, int8_t is_auto_send, StatusCallback *callback) {
+    walk_budget budget;
     dir_files copied_dir_files;
-    get_copied_dirs_files(&copied_dir_files, 1);
-    int ret = _send_files_common(4, socket, copied_dir_files.lst, copied_dir_files.path_len, is_auto_send, callback);
-    if (copied_dir_files.lst) {
-        free_list(copied_dir_files.lst);
+    get_copied_dirs_files(&copied_dir_files, 1, _get_send_budget(is_auto_send, &budget));
+    int ret = _send_files_common(4, socket, copied_dir_files.store, copied_dir_files.path_len, is_auto_send, callback);
+    if (copied_dir_files.store) {
+        free_path_store(copied_dir_files.store);
     }
     return ret;
 }
@@ -931,3 +1582,34 @@ int info_v4(socket_t *socket, StatusCallback *callback) {
 }
 
 #endif
+
+#if (PROTOCOL_MIN <= 5) && (5 <= PROTOCOL_MAX)
+
+int get_files_v5(socket_t *socket, StatusCallback *callback) { return _get_files_dirs(5, socket, callback); }
+
+int send_files_v5(socket_t *socket, int8_t is_auto_send, StatusCallback *callback) {
+    walk_budget budget;
+#if defined(__linux__) || defined(__APPLE__)
+    // a single copied archive is detected, and the files are sorted, only with the complete list of files
+    if (!configuration.send_archive_members && configuration.send_order == SEND_ORDER_WALK) {
+        size_t path_len;
+        dir_stream *stream = get_copied_dirs_stream(&path_len, 1, _get_send_budget(is_auto_send, &budget));
+        if (!stream) {
+            if (callback) callback->function(RESP_NO_DATA, NULL, 0, callback->params);
+            return EXIT_FAILURE;
+        }
+        int ret = _send_files_stream(5, socket, stream, path_len, is_auto_send, callback);
+        close_dir_stream(stream);
+        return ret;
+    }
+#endif
+    dir_files copied_dir_files;
+    get_copied_dirs_files(&copied_dir_files, 1, _get_send_budget(is_auto_send, &budget));
+    int ret = _send_files_common(5, socket, copied_dir_files.store, copied_dir_files.path_len, is_auto_send, callback);
+    if (copied_dir_files.store) {
+        free_path_store(copied_dir_files.store);
+    }
+    return ret;
+}
+
+#endif
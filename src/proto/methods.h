@@ -53,7 +53,7 @@ extern int get_screenshot_v3(socket_t *socket, uint16_t display, StatusCallback
 #endif
 
 // Version 4 methods
-#if (PROTOCOL_MIN <= 4) && (4 <= PROTOCOL_MAX)
+#if (PROTOCOL_MIN <= 5) && (4 <= PROTOCOL_MAX)
 extern int get_text_v4(socket_t *socket, StatusCallback *callback);
 extern int send_text_v4(socket_t *socket, StatusCallback *callback);
 extern int get_files_v4(socket_t *socket, StatusCallback *callback);
@@ -64,4 +64,15 @@ extern int get_screenshot_v4(socket_t *socket, uint16_t display, StatusCallback
 extern int info_v4(socket_t *socket, StatusCallback *callback);
 #endif
 
+// Version 5 methods
+/*
+ * Version 5 is the same as version 4, except that the file list of the get files and send files methods is not
+ * preceded by the number of files. Each file is sent as the name length, name, and file size followed by the file
+ * content, or -1 as the size for a directory, like in version 4. The list ends with a name length of 0.
+ */
+#if (PROTOCOL_MIN <= 5) && (5 <= PROTOCOL_MAX)
+extern int get_files_v5(socket_t *socket, StatusCallback *callback);
+extern int send_files_v5(socket_t *socket, int8_t is_auto_send, StatusCallback *callback);
+#endif
+
 #endif  // PROTO_METHODS_H_
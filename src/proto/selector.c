@@ -56,6 +56,11 @@ static inline int proto_handler(socket_t *socket, uint8_t version, uint8_t metho
         case 4: {
             return version_4(socket, method, args, callback);
         }
+#endif
+#if (PROTOCOL_MIN <= 5) && (5 <= PROTOCOL_MAX)
+        case 5: {
+            return version_5(socket, method, args, callback);
+        }
 #endif
         default: {  // invalid or unknown version
             error("Invalid protocol version");
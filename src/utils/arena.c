@@ -0,0 +1,95 @@
+/*
+ * utils/arena.c - arena allocator
+ * Copyright (C) 2026 H. Thevindu J. Wijesekera
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <utils/arena.h>
+
+#define DEFAULT_CHUNK_SIZE 65536L  // 64 KiB
+#define ARENA_ALIGN (sizeof(max_align_t))
+
+typedef union _arena_chunk {
+    union _arena_chunk *next;
+    max_align_t align;  // data following the header is aligned
+} arena_chunk;
+
+struct _arena {
+    arena_chunk *chunks;
+    char *cur;
+    size_t avail;
+    size_t chunk_size;
+};
+
+arena *new_arena(size_t chunk_size) {
+    arena *mem = (arena *)calloc(1, sizeof(arena));
+    if (!mem) return NULL;
+    mem->chunk_size = chunk_size ? chunk_size : DEFAULT_CHUNK_SIZE;
+    return mem;
+}
+
+void free_arena(arena *mem) {
+    arena_chunk *chunk = mem->chunks;
+    while (chunk) {
+        arena_chunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    free(mem);
+}
+
+void *arena_alloc(arena *mem, size_t size) {
+    if (size > SIZE_MAX - ARENA_ALIGN - sizeof(arena_chunk)) return NULL;
+    size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+    if (size > mem->avail) {
+        if (size > mem->chunk_size / 4) {
+            // large allocations get a separate chunk to keep using the free space of the current chunk
+            arena_chunk *chunk = (arena_chunk *)malloc(sizeof(arena_chunk) + size);
+            if (!chunk) return NULL;
+            if (mem->chunks) {
+                chunk->next = mem->chunks->next;
+                mem->chunks->next = chunk;
+            } else {
+                chunk->next = NULL;
+                mem->chunks = chunk;
+            }
+            return chunk + 1;
+        }
+        arena_chunk *chunk = (arena_chunk *)malloc(sizeof(arena_chunk) + mem->chunk_size);
+        if (!chunk) return NULL;
+        chunk->next = mem->chunks;
+        mem->chunks = chunk;
+        mem->cur = (char *)(chunk + 1);
+        mem->avail = mem->chunk_size;
+    }
+    void *ptr = mem->cur;
+    mem->cur += size;
+    mem->avail -= size;
+    return ptr;
+}
+
+char *arena_strndup(arena *mem, const char *str, size_t n) {
+    size_t len = strnlen(str, n);
+    char *copy = (char *)arena_alloc(mem, len + 1);
+    if (!copy) return NULL;
+    memcpy(copy, str, len);
+    copy[len] = '\0';
+    return copy;
+}
+
+char *arena_strdup(arena *mem, const char *str) { return arena_strndup(mem, str, SIZE_MAX); }
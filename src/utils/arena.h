@@ -0,0 +1,62 @@
+/*
+ * utils/arena.h - header for arena allocator
+ * Copyright (C) 2026 H. Thevindu J. Wijesekera
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef UTILS_ARENA_H_
+#define UTILS_ARENA_H_
+
+#include <stddef.h>
+
+/*
+ * Bump allocator for the allocations of a single operation.
+ * Memory is allocated from large chunks and all of it is released at once with free_arena().
+ * An arena is not thread-safe.
+ */
+typedef struct _arena arena;
+
+/*
+ * Creates an arena which allocates chunks of at least chunk_size bytes.
+ * Uses the default chunk size if chunk_size is 0.
+ * returns the arena on success or NULL on failure.
+ */
+extern arena *new_arena(size_t chunk_size);
+
+/*
+ * Frees the arena and all the memory allocated from it.
+ */
+extern void free_arena(arena *mem);
+
+/*
+ * Allocates size bytes from the arena, aligned for any type.
+ * The memory must not be freed with free().
+ * returns NULL on failure.
+ */
+extern void *arena_alloc(arena *mem, size_t size) __attribute__((__malloc__));
+
+/*
+ * Copies at most n bytes of the string str to the arena with a null terminator.
+ * returns NULL on failure.
+ */
+extern char *arena_strndup(arena *mem, const char *str, size_t n) __attribute__((__malloc__));
+
+/*
+ * Copies the string str to the arena.
+ * returns NULL on failure.
+ */
+extern char *arena_strdup(arena *mem, const char *str) __attribute__((__malloc__));
+
+#endif  // UTILS_ARENA_H_
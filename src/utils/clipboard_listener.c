@@ -27,39 +27,185 @@
 #include <arpa/inet.h>
 #include <pthread.h>
 #include <sys/socket.h>
+#include <time.h>
 #endif
 
 #ifdef _WIN32
 typedef HANDLE thread_t;
+typedef CRITICAL_SECTION mutex_t;
+typedef CONDITION_VARIABLE cond_t;
+#define mutex_lock(m) EnterCriticalSection(m)
+#define mutex_unlock(m) LeaveCriticalSection(m)
+#define cond_wait(c, m) SleepConditionVariableCS(c, m, INFINITE)
+#define cond_signal(c) WakeConditionVariable(c)
 #elif defined(__linux__) || defined(__APPLE__)
 typedef pthread_t thread_t;
+typedef pthread_mutex_t mutex_t;
+typedef pthread_cond_t cond_t;
+#define mutex_lock(m) pthread_mutex_lock(m)
+#define mutex_unlock(m) pthread_mutex_unlock(m)
+#define cond_wait(c, m) pthread_cond_wait(c, m)
+#define cond_signal(c) pthread_cond_signal(c)
 #endif
 
+// changes closer than this are a burst, of which only the last is sent after the clipboard is not changed for this time
+#define DEBOUNCE_MS 50
+
+// the same content is not sent again to a server that received it within this time
+#define DUPLICATE_WINDOW_MS 60000
+// number of servers whose last delivered content is remembered
+#define DELIVERED_TABLE_LEN 64
+
+typedef struct {
+    uint32_t addr;
+    int type;
+    uint64_t digest;
+    uint64_t time;  // time of the delivery in milliseconds, or 0 if the entry is free
+} delivery;
+
+static delivery delivered[DELIVERED_TABLE_LEN];
+static mutex_t delivered_lock;
+#ifdef DEBUG_MODE
+static unsigned long suppressed_cnt = 0;
+#endif
+
+// the last content delivered to all the servers found by a scan, which needs no scan while it is not changed
+static struct {
+    int type;
+    uint64_t digest;
+    uint64_t time;
+} last_round;
+
 typedef struct {
     char *server;
     int type;
+    uint64_t digest;
+    int delivered;
+    int cancelled;   // guarded by dispatch.lock
+    socket_t *sock;  // connection in use, or NULL. guarded by dispatch.lock
 } send_arg_t;
 
-static void *send_to_server(void *args) {
-    send_arg_t *arg = (send_arg_t *)args;
+// the sends of one content to the servers found by a scan, which run while the dispatcher waits for changes
+static struct {
+    list2 *servers;  // NULL if no round is in progress
+    int type;
+    uint64_t digest;
+    unsigned long generation;  // the change of the clipboard sent in this round
+    int cancelled;
+    size_t running;  // number of send threads not completed. guarded by dispatch.lock
+    thread_t *threads;
+    send_arg_t *args;
+    thread_t threads_buf[16];
+    send_arg_t args_buf[16];
+} sending;
+
+// the changes reported by the listener, which only records them for the dispatcher thread to send
+static struct {
+    mutex_t lock;
+    cond_t cond;               // signalled on a change and when a send thread completes
+    unsigned long generation;  // number of changes of the clipboard
+    int pending;               // whether the last change is to be sent
+    int burst;                 // whether the last change followed another change within the debounce time
+    uint64_t change_time;      // time of the last change in milliseconds
+} dispatch;
+
+static inline int _is_recent(uint64_t time, uint64_t now) {
+    return time && now >= time && now - time < DUPLICATE_WINDOW_MS;
+}
+
+/*
+ * Check if the contents with the types and digests are the same. Content with DIGEST_NONE is not the same as any.
+ */
+static inline int _is_same(int type1, uint64_t digest1, int type2, uint64_t digest2) {
+    return type1 == type2 && digest1 == digest2 && digest1 != DIGEST_NONE;
+}
+
+/*
+ * Check if the content was delivered to the server within the duplicate window.
+ */
+static int _is_delivered(uint32_t addr, int type, uint64_t digest, uint64_t now) {
+    int found = 0;
+    mutex_lock(&delivered_lock);
+    for (size_t i = 0; i < DELIVERED_TABLE_LEN; i++) {
+        const delivery *entry = delivered + i;
+        if (entry->addr == addr && _is_recent(entry->time, now)) {
+            found = _is_same(entry->type, entry->digest, type, digest);
+            break;
+        }
+    }
+    mutex_unlock(&delivered_lock);
+    return found;
+}
+
+/*
+ * Record the content delivered to the server, replacing its previous entry or the oldest entry.
+ */
+static void _set_delivered(uint32_t addr, int type, uint64_t digest) {
+    mutex_lock(&delivered_lock);
+    delivery *slot = delivered;
+    for (size_t i = 0; i < DELIVERED_TABLE_LEN; i++) {
+        delivery *entry = delivered + i;
+        if (entry->time && entry->addr == addr) {
+            slot = entry;
+            break;
+        }
+        if (entry->time < slot->time) slot = entry;
+    }
+    slot->addr = addr;
+    slot->type = type;
+    slot->digest = digest;
+    slot->time = get_time_millis();
+    mutex_unlock(&delivered_lock);
+}
+
+static void send_content(send_arg_t *arg) {
     const char *server = arg->server;
     int type = arg->type;
-    free(arg);
 
     uint32_t server_addr;
     if (ipv4_aton(server, &server_addr) != EXIT_SUCCESS) {
-        return NULL;
+        return;
+    }
+    if (_is_delivered(server_addr, type, arg->digest, get_time_millis())) {
+#ifdef DEBUG_MODE
+        mutex_lock(&delivered_lock);
+        printf("Skipped sending the same content to %s again. Suppressed sends: %lu\n", server, ++suppressed_cnt);
+        mutex_unlock(&delivered_lock);
+#endif
+        arg->delivered = 1;
+        return;
     }
     socket_t sock;
     connect_server(&sock, server_addr);
     if (IS_NULL_SOCK(sock.type)) {
-        return NULL;
+        return;
+    }
+    // the connection is registered for the dispatcher to interrupt it if the content is superseded
+    mutex_lock(&dispatch.lock);
+    int cancelled = arg->cancelled;
+    if (!cancelled) arg->sock = &sock;
+    mutex_unlock(&dispatch.lock);
+    if (!cancelled) {
+        uint8_t method = (type == COPIED_TYPE_FILE) ? METHOD_SEND_FILE : METHOD_SEND_TEXT;
+        MethodArgs methodArgs = {0};
+        methodArgs.is_auto_send = 1;
+        if (handle_proto(&sock, method, &methodArgs, NULL) == EXIT_SUCCESS) {
+            _set_delivered(server_addr, type, arg->digest);
+            arg->delivered = 1;
+        }
+        mutex_lock(&dispatch.lock);
+        arg->sock = NULL;
+        mutex_unlock(&dispatch.lock);
     }
-    uint8_t method = (type == COPIED_TYPE_FILE) ? METHOD_SEND_FILE : METHOD_SEND_TEXT;
-    MethodArgs methodArgs = {0};
-    methodArgs.is_auto_send = 1;
-    handle_proto(&sock, method, &methodArgs, NULL);
     close_socket_no_wait(&sock);
+}
+
+static void *send_to_server(void *args) {
+    send_content((send_arg_t *)args);
+    mutex_lock(&dispatch.lock);
+    sending.running--;
+    cond_signal(&dispatch.cond);
+    mutex_unlock(&dispatch.lock);
     return NULL;
 }
 
@@ -116,22 +262,40 @@ static inline list2 *scan_servers(void) {
     return servers;
 }
 
-static inline void send_in_threads(int type, list2 *servers) {
-    thread_t threads_buf[16];
-    thread_t *threads;
-    if (servers->len < 16) {
-        threads = threads_buf;
+/*
+ * Start a round sending the content to each server in a thread of its own. Takes the ownership of the servers list.
+ */
+static void start_round(int type, uint64_t digest, unsigned long generation, list2 *servers) {
+    if (servers->len <= 16) {
+        sending.threads = sending.threads_buf;
+        sending.args = sending.args_buf;
     } else {
-        threads = malloc(sizeof(thread_t) * servers->len);
-        if (!threads) {
+        sending.threads = malloc(sizeof(thread_t) * servers->len);
+        sending.args = malloc(sizeof(send_arg_t) * servers->len);
+        if (!sending.threads || !sending.args) {
+            if (sending.threads) free(sending.threads);
+            if (sending.args) free(sending.args);
+            free_list(servers);
             return;
         }
     }
+    sending.type = type;
+    sending.digest = digest;
+    sending.generation = generation;
+    sending.cancelled = 0;
+    mutex_lock(&dispatch.lock);
+    sending.servers = servers;
+    sending.running = servers->len;
+    mutex_unlock(&dispatch.lock);
 
     for (size_t i = 0; i < servers->len; i++) {
-        send_arg_t *arg = malloc(sizeof(send_arg_t));
+        send_arg_t *arg = sending.args + i;
         arg->server = servers->array[i];
         arg->type = type;
+        arg->digest = digest;
+        arg->delivered = 0;
+        arg->cancelled = 0;
+        arg->sock = NULL;
         thread_t thread;
 #ifdef _WIN32
         thread = CreateThread(NULL, 0, send_to_server_wrapper, arg, 0, NULL);
@@ -141,44 +305,173 @@ static inline void send_in_threads(int type, list2 *servers) {
             thread = 0;
         }
 #endif
+        sending.threads[i] = thread;
         if (!thread) {
-            free(arg);
+            mutex_lock(&dispatch.lock);
+            sending.running--;
+            mutex_unlock(&dispatch.lock);
         }
-        threads[i] = thread;
     }
-    for (size_t i = 0; i < servers->len; i++) {
-        if (!threads[i]) {
+}
+
+/*
+ * Stop the sends of the round in progress, including the transfers already started.
+ * Should be called with dispatch.lock held.
+ */
+static void cancel_round(void) {
+    if (sending.cancelled) return;
+    sending.cancelled = 1;
+    for (size_t i = 0; i < sending.servers->len; i++) {
+        send_arg_t *arg = sending.args + i;
+        arg->cancelled = 1;
+        if (arg->sock) interrupt_socket(arg->sock);
+    }
+#ifdef DEBUG_MODE
+    puts("Cancelled sending the superseded content");
+#endif
+}
+
+/*
+ * Release the round after all its send threads are completed.
+ */
+static void finish_round(void) {
+    int all_delivered = 1;
+    for (size_t i = 0; i < sending.servers->len; i++) {
+        if (!sending.threads[i]) {
+            all_delivered = 0;
             continue;
         }
 #ifdef _WIN32
-        WaitForSingleObject(threads[i], INFINITE);
+        WaitForSingleObject(sending.threads[i], INFINITE);
+        CloseHandle(sending.threads[i]);
 #elif defined(__linux__) || defined(__APPLE__)
-        pthread_join(threads[i], NULL);
+        pthread_join(sending.threads[i], NULL);
 #endif
+        if (!sending.args[i].delivered) all_delivered = 0;
+    }
+    if (all_delivered) {
+        last_round.type = sending.type;
+        last_round.digest = sending.digest;
+        last_round.time = get_time_millis();
+    } else {
+        last_round.time = 0;
     }
 
-    if (threads != threads_buf) {
-        free(threads);
+    if (sending.threads != sending.threads_buf) {
+        free(sending.threads);
+        free(sending.args);
     }
+    mutex_lock(&dispatch.lock);
+    free_list(sending.servers);
+    sending.servers = NULL;
+    mutex_unlock(&dispatch.lock);
+}
+
+/*
+ * Get the digest of the copied content of the type.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+static int get_digest(int type, uint64_t *digest_p) {
+    if (type == COPIED_TYPE_FILE) return get_copied_files_digest(digest_p);
+    uint32_t len;
+    char *text = get_clipboard_text(&len);
+    if (!text) return EXIT_FAILURE;
+    *digest_p = hash_bytes(text, len, HASH_INIT);
+    free(text);
+    return EXIT_SUCCESS;
 }
 
-static void send_to_servers(int type) {
+/*
+ * Get the type and the digest of the copied content if the content of that type is to be sent.
+ * returns EXIT_SUCCESS if the content is to be sent and EXIT_FAILURE otherwise.
+ */
+static int get_change(int *type_p, uint64_t *digest_p) {
+    int type = get_copied_type();
     switch (type) {
         case COPIED_TYPE_TEXT: {
             if (!configuration.auto_send_text) {
-                return;
+                return EXIT_FAILURE;
             }
             break;
         }
         case COPIED_TYPE_FILE: {
             if (!configuration.auto_send_files) {
-                return;
+                return EXIT_FAILURE;
             }
             break;
         }
         default:
+            return EXIT_FAILURE;
+    }
+    *type_p = type;
+    return get_digest(type, digest_p);
+}
+
+/*
+ * Check if the content was delivered to all the servers in the last round.
+ * Apps re-assert the ownership or re-copy the same content, which need not be scanned for and sent again.
+ */
+static int is_last_round(int type, uint64_t digest) {
+    if (!_is_same(type, digest, last_round.type, last_round.digest) ||
+        !_is_recent(last_round.time, get_time_millis())) {
+        return 0;
+    }
+#ifdef DEBUG_MODE
+    mutex_lock(&delivered_lock);
+    printf("Skipped sending the same content again. Suppressed sends: %lu\n", ++suppressed_cnt);
+    mutex_unlock(&delivered_lock);
+#endif
+    return 1;
+}
+
+/*
+ * Wait for the time of the given milliseconds or until the condition is signalled.
+ */
+static void cond_wait_ms(cond_t *cond, mutex_t *lock, uint64_t ms) {
+#ifdef _WIN32
+    SleepConditionVariableCS(cond, lock, (DWORD)ms);
+#elif defined(__linux__) || defined(__APPLE__)
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += (time_t)(ms / 1000);
+    deadline.tv_nsec += (long)(ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    pthread_cond_timedwait(cond, lock, &deadline);
+#endif
+}
+
+/*
+ * Wait until a burst of changes settles. A change that is not in a burst is not waited for.
+ * Should be called with dispatch.lock held.
+ */
+static void wait_settled(void) {
+    while (dispatch.burst) {
+        uint64_t now = get_time_millis();
+        if (now < dispatch.change_time || now - dispatch.change_time >= DEBOUNCE_MS) break;
+        cond_wait_ms(&dispatch.cond, &dispatch.lock, DEBOUNCE_MS - (now - dispatch.change_time));
+    }
+}
+
+static void send_change(unsigned long generation) {
+    int type;
+    uint64_t digest;
+    if (get_change(&type, &digest) != EXIT_SUCCESS) return;
+    if (sending.servers) {
+        mutex_lock(&dispatch.lock);
+        if (_is_same(type, digest, sending.type, sending.digest) && !sending.cancelled) {
+            sending.generation = generation;
+            mutex_unlock(&dispatch.lock);
             return;
+        }
+        cancel_round();
+        while (sending.running) cond_wait(&dispatch.cond, &dispatch.lock);
+        mutex_unlock(&dispatch.lock);
+        finish_round();
     }
+    if (is_last_round(type, digest)) return;
 
     list2 *servers = scan_servers();
     if (!servers) {
@@ -187,9 +480,90 @@ static void send_to_servers(int type) {
             return;
         }
     }
+    // the clipboard may be changed again during the scan, and then the last content is sent to the servers found
+    mutex_lock(&dispatch.lock);
+    if (generation != dispatch.generation) {
+        wait_settled();
+        int pending = dispatch.pending;
+        dispatch.pending = 0;
+        generation = dispatch.generation;
+        mutex_unlock(&dispatch.lock);
+        if (!pending || get_change(&type, &digest) != EXIT_SUCCESS || is_last_round(type, digest)) {
+            free_list(servers);
+            return;
+        }
+    } else {
+        mutex_unlock(&dispatch.lock);
+    }
+    start_round(type, digest, generation, servers);
+}
 
-    send_in_threads(type, servers);
-    free_list(servers);
+/*
+ * Send the last change of the clipboard, and stop sending the content that is superseded.
+ */
+static void *dispatch_changes(void *unused) {
+    (void)unused;
+    mutex_lock(&dispatch.lock);
+    while (1) {
+        if (sending.servers && !sending.running) {
+            mutex_unlock(&dispatch.lock);
+            finish_round();
+            mutex_lock(&dispatch.lock);
+            continue;
+        }
+        // the content in the round is replaced by the content received by this program
+        if (sending.servers && !dispatch.pending && sending.generation != dispatch.generation) cancel_round();
+        if (!dispatch.pending) {
+            cond_wait(&dispatch.cond, &dispatch.lock);
+            continue;
+        }
+        wait_settled();
+        if (!dispatch.pending) continue;
+        dispatch.pending = 0;
+        unsigned long generation = dispatch.generation;
+        mutex_unlock(&dispatch.lock);
+        send_change(generation);
+        mutex_lock(&dispatch.lock);
+    }
+    return NULL;
+}
+
+#ifdef _WIN32
+static DWORD WINAPI dispatch_changes_wrapper(void *arg) {
+    dispatch_changes(arg);
+    return EXIT_SUCCESS;
 }
+#endif
 
-int start_clipboard_listener(void) { return clipboard_listen(&send_to_servers); }
+/*
+ * Record a change of the clipboard. This is called from the listener, which should not wait for the sends.
+ */
+static void on_change(int from_self) {
+    uint64_t now = get_time_millis();
+    mutex_lock(&dispatch.lock);
+    dispatch.generation++;
+    dispatch.pending = !from_self;  // the content received by this program is not sent back
+    dispatch.burst = now >= dispatch.change_time && now - dispatch.change_time < DEBOUNCE_MS;
+    dispatch.change_time = now;
+    cond_signal(&dispatch.cond);
+    mutex_unlock(&dispatch.lock);
+}
+
+int start_clipboard_listener(void) {
+#ifdef _WIN32
+    InitializeCriticalSection(&delivered_lock);
+    InitializeCriticalSection(&(dispatch.lock));
+    InitializeConditionVariable(&(dispatch.cond));
+    HANDLE thread = CreateThread(NULL, 0, dispatch_changes_wrapper, NULL, 0, NULL);
+    if (!thread) return EXIT_FAILURE;
+    CloseHandle(thread);
+#elif defined(__linux__) || defined(__APPLE__)
+    pthread_mutex_init(&delivered_lock, NULL);
+    pthread_mutex_init(&(dispatch.lock), NULL);
+    pthread_cond_init(&(dispatch.cond), NULL);
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, &dispatch_changes, NULL)) return EXIT_FAILURE;
+    pthread_detach(thread);
+#endif
+    return clipboard_listen(&on_change);
+}
@@ -19,7 +19,11 @@
 #ifndef UTILS_CLIPBOARD_LISTENER_H_
 #define UTILS_CLIPBOARD_LISTENER_H_
 
-typedef void (*ListenerCallback)(int);
+/*
+ * Called by the listener on each change of the clipboard, with from_self set to non-zero if the change was made by this
+ * program. This should return quickly without waiting for the content to be sent.
+ */
+typedef void (*ListenerCallback)(int from_self);
 
 extern int start_clipboard_listener(void);
 
@@ -0,0 +1,145 @@
+/*
+ * utils/commit_stage.c - moving received files to the working directory
+ * Copyright (C) 2026 H. Thevindu J. Wijesekera
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifdef __linux__
+#define _GNU_SOURCE  // for renameat2
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <utils/arena.h>
+#include <utils/commit_stage.h>
+#include <utils/str_set.h>
+#include <utils/utils.h>
+
+#define MAX_NAME_SUFFIX 999999L
+
+struct _commit_stage {
+    str_set *names;  // names of the entries in the working directory
+    char *stage_dir;
+#if defined(__linux__) || defined(__APPLE__)
+    int stage_fd;
+#endif
+};
+
+commit_stage *open_commit_stage(const char *stage_dir) {
+    commit_stage *stage = (commit_stage *)calloc(1, sizeof(commit_stage));
+    if (!stage) return NULL;
+#if defined(__linux__) || defined(__APPLE__)
+    stage->stage_fd = -1;
+#endif
+    stage->names = new_str_set();
+    stage->stage_dir = strdup(stage_dir);
+    arena *mem = new_arena(0);
+    // list the working directory only once
+    list2 *names = mem ? list_dir(".", mem) : NULL;
+    if (!stage->names || !stage->stage_dir || !names) {
+        if (mem) free_arena(mem);
+        close_commit_stage(stage);
+        return NULL;
+    }
+    for (uint32_t i = 0; i < names->len; i++) {
+        const char *name = names->array[i];
+        if (!str_set_add(stage->names, name, strlen(name))) {
+            free_arena(mem);
+            close_commit_stage(stage);
+            return NULL;
+        }
+    }
+    free_arena(mem);
+#if defined(__linux__) || defined(__APPLE__)
+    stage->stage_fd = open(stage_dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (stage->stage_fd < 0) {
+        close_commit_stage(stage);
+        return NULL;
+    }
+#endif
+    return stage;
+}
+
+void close_commit_stage(commit_stage *stage) {
+#if defined(__linux__) || defined(__APPLE__)
+    if (stage->stage_fd >= 0) close(stage->stage_fd);
+#endif
+    if (stage->names) free_str_set(stage->names);
+    if (stage->stage_dir) free(stage->stage_dir);
+    free(stage);
+}
+
+/*
+ * Rename the entry filename of the stage to new_path, failing with errno EEXIST if new_path already exists.
+ * returns 0 on success and -1 on failure.
+ */
+static int _rename_no_replace(const commit_stage *stage, const char *filename, const char *new_path) {
+#if defined(__linux__)
+    if (renameat2(stage->stage_fd, filename, AT_FDCWD, new_path, RENAME_NOREPLACE) == 0) return 0;
+    if (errno != EINVAL && errno != ENOSYS) return -1;
+    // the file system does not support RENAME_NOREPLACE
+    if (faccessat(AT_FDCWD, new_path, F_OK, AT_SYMLINK_NOFOLLOW) == 0) {
+        errno = EEXIST;
+        return -1;
+    }
+    return renameat(stage->stage_fd, filename, AT_FDCWD, new_path);
+#elif defined(__APPLE__)
+    return renameatx_np(stage->stage_fd, filename, AT_FDCWD, new_path, RENAME_EXCL);
+#elif defined(_WIN32)
+    const size_t path_sz = strlen(stage->stage_dir) + strlen(filename) + 2;
+    char *old_path = malloc(path_sz);
+    if (!old_path) return -1;
+    if (snprintf_check(old_path, path_sz, "%s%c%s", stage->stage_dir, PATH_SEP, filename)) {
+        free(old_path);
+        return -1;
+    }
+    // rename does not replace existing files on Windows
+    int status = rename_file(old_path, new_path);
+    free(old_path);
+    if (status && file_exists(new_path)) errno = EEXIST;
+    return status ? -1 : 0;
+#endif
+}
+
+int commit_entry(commit_stage *stage, const char *filename, int allow_plain_name, char *new_path, size_t max_len) {
+    for (long n = allow_plain_name ? 0 : 1; n <= MAX_NAME_SUFFIX; n++) {
+        // "./" is important to prevent file names like "C:\path"
+        if (n == 0) {
+            if (snprintf_check(new_path, max_len, ".%c%s", PATH_SEP, filename)) return EXIT_FAILURE;
+        } else {
+            if (snprintf_check(new_path, max_len, ".%c%li_%s", PATH_SEP, n, filename)) return EXIT_FAILURE;
+        }
+        const char *name = new_path + 2;
+        const size_t name_len = strlen(name);
+        if (str_set_contains(stage->names, name, name_len)) continue;
+        if (_rename_no_replace(stage, filename, new_path) == 0) {
+            if (!str_set_add(stage->names, name, name_len)) return EXIT_FAILURE;
+            return EXIT_SUCCESS;
+        }
+        if (errno != EEXIST) {
+#ifdef DEBUG_MODE
+            printf("Rename failed : %s\n", new_path);
+#endif
+            return EXIT_FAILURE;
+        }
+        // created after listing the working directory
+        if (!str_set_add(stage->names, name, name_len)) return EXIT_FAILURE;
+    }
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,52 @@
+/*
+ * utils/commit_stage.h - header for moving received files to the working directory
+ * Copyright (C) 2026 H. Thevindu J. Wijesekera
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef UTILS_COMMIT_STAGE_H_
+#define UTILS_COMMIT_STAGE_H_
+
+#include <stddef.h>
+
+/*
+ * Moves the entries of a staging directory to the working directory without replacing any existing file.
+ * The names in the working directory are read once when opening the stage, so finding a free name for an entry does
+ * not need a system call for each candidate name.
+ */
+typedef struct _commit_stage commit_stage;
+
+/*
+ * Opens the staging directory stage_dir, which must be a relative path in the working directory.
+ * returns the stage on success or NULL on failure.
+ */
+extern commit_stage *open_commit_stage(const char *stage_dir);
+
+/*
+ * Moves the entry filename of the staging directory to the working directory.
+ * If the name is already taken, the entry is renamed to "<n>_filename" with the smallest available n from 1 to 999999.
+ * The name filename itself is not used if allow_plain_name is 0.
+ * Writes the new path, which starts with "./", to new_path of size max_len.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+extern int commit_entry(commit_stage *stage, const char *filename, int allow_plain_name, char *new_path,
+                        size_t max_len);
+
+/*
+ * Closes the stage. The staging directory is not removed.
+ */
+extern void close_commit_stage(commit_stage *stage);
+
+#endif  // UTILS_COMMIT_STAGE_H_
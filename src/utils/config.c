@@ -175,6 +175,42 @@ static inline void set_is_true(const char *str, int8_t *conf_ptr) {
     }
 }
 
+/*
+ * str must be a valid and null-terminated string
+ * conf_ptr must be a valid pointer to a char
+ * Sets the value pointed by conf_ptr to DURABILITY_NONE, DURABILITY_BATCH, or DURABILITY_FILE if the string is "none",
+ * "batch", or "file" respectively.
+ */
+static inline void set_durability(const char *str, int8_t *conf_ptr) {
+    if (!strcasecmp("none", str)) {
+        *conf_ptr = DURABILITY_NONE;
+    } else if (!strcasecmp("batch", str)) {
+        *conf_ptr = DURABILITY_BATCH;
+    } else if (!strcasecmp("file", str)) {
+        *conf_ptr = DURABILITY_FILE;
+    } else {
+        error_exit("Error: invalid durability config value");
+    }
+}
+
+/*
+ * str must be a valid and null-terminated string
+ * conf_ptr must be a valid pointer to a char
+ * Sets the value pointed by conf_ptr to SEND_ORDER_WALK, SEND_ORDER_INODE, or SEND_ORDER_EXTENT if the string is
+ * "walk", "inode", or "extent" respectively.
+ */
+static inline void set_send_order(const char *str, int8_t *conf_ptr) {
+    if (!strcasecmp("walk", str)) {
+        *conf_ptr = SEND_ORDER_WALK;
+    } else if (!strcasecmp("inode", str)) {
+        *conf_ptr = SEND_ORDER_INODE;
+    } else if (!strcasecmp("extent", str)) {
+        *conf_ptr = SEND_ORDER_EXTENT;
+    } else {
+        error_exit("Error: invalid send_order config value");
+    }
+}
+
 /*
  * str must be a valid and null-terminated string
  * conf_ptr must be a valid pointer to an unsigned 64-bit long integer
@@ -334,8 +370,24 @@ static void parse_line(char *line, config *cfg) {
         set_int64(value, &(cfg->max_file_size));
     } else if (!strcmp("max_file_count", key)) {
         set_uint32(value, &(cfg->max_file_count));
+    } else if (!strcmp("streaming_min_file_size", key)) {
+        set_int64(value, &(cfg->streaming_min_file_size));
+    } else if (!strcmp("streaming_direct_io", key)) {
+        set_is_true(value, &(cfg->streaming_direct_io));
+    } else if (!strcmp("durability", key)) {
+        set_durability(value, &(cfg->durability));
+    } else if (!strcmp("receive_archive", key)) {
+        set_is_true(value, &(cfg->receive_archive));
+    } else if (!strcmp("send_archive_members", key)) {
+        set_is_true(value, &(cfg->send_archive_members));
+    } else if (!strcmp("send_order", key)) {
+        set_send_order(value, &(cfg->send_order));
     } else if (!strcmp("cut_received_files", key)) {
         set_is_true(value, &(cfg->cut_received_files));
+    } else if (!strcmp("image_to_clipboard", key)) {
+        set_is_true(value, &(cfg->image_to_clipboard));
+    } else if (!strcmp("max_clipboard_image_size", key)) {
+        set_uint32(value, &(cfg->max_clipboard_image_size));
     } else if (!strcmp("min_proto_version", key)) {
         set_uint16(value, &(cfg->min_proto_version));
     } else if (!strcmp("max_proto_version", key)) {
@@ -377,7 +429,15 @@ void parse_conf(config *cfg, const char *file_name) {
     cfg->max_text_length = 0;
     cfg->max_file_size = 0;
     cfg->max_file_count = 0;
+    cfg->streaming_min_file_size = 0;
+    cfg->streaming_direct_io = -1;
+    cfg->durability = -1;
+    cfg->receive_archive = -1;
+    cfg->send_archive_members = -1;
+    cfg->send_order = -1;
     cfg->cut_received_files = -1;
+    cfg->image_to_clipboard = -1;
+    cfg->max_clipboard_image_size = 0;
     cfg->min_proto_version = 0;
     cfg->max_proto_version = 0;
     cfg->auto_send_text = -1;
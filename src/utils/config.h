@@ -23,6 +23,14 @@
 #include <sys/types.h>
 #include <utils/list_utils.h>
 
+#define DURABILITY_NONE 0   // received files are not synced to the storage
+#define DURABILITY_BATCH 1  // received files are synced once at the end of each transfer
+#define DURABILITY_FILE 2   // each received file is synced before the next one
+
+#define SEND_ORDER_WALK 0    // files are sent in the order which the directories are read
+#define SEND_ORDER_INODE 1   // files are sent in the order of their inode numbers
+#define SEND_ORDER_EXTENT 2  // files are sent in the order of their physical locations on the storage
+
 typedef struct _data_buffer {
     int32_t len;
     char *data;
@@ -44,10 +52,18 @@ typedef struct _config {
     char *working_dir;
     uint32_t bind_addr;
     int8_t cut_received_files;
+    int8_t image_to_clipboard;
+    uint32_t max_clipboard_image_size;
 
     uint32_t max_text_length;
     int64_t max_file_size;
     uint32_t max_file_count;
+    int64_t streaming_min_file_size;
+    int8_t streaming_direct_io;
+    int8_t durability;
+    int8_t receive_archive;
+    int8_t send_archive_members;
+    int8_t send_order;
 
     uint16_t min_proto_version;
     uint16_t max_proto_version;
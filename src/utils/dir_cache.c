@@ -0,0 +1,200 @@
+/*
+ * utils/dir_cache.c - cache of created directories
+ * Copyright (C) 2026 H. Thevindu J. Wijesekera
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utils/dir_cache.h>
+#include <utils/file_io.h>
+#include <utils/str_set.h>
+#include <utils/utils.h>
+
+#define MAX_PATH_LENGTH 2048
+
+struct _dir_cache {
+    str_set *dirs;
+#if defined(__linux__) || defined(__APPLE__)
+    int last_fd;  // open descriptor of the last directory, or -1
+    const char *last_path;
+    size_t last_len;
+    const char **created;  // paths of the directories created through the cache, in the order of creation
+    size_t created_cnt;
+    size_t created_cap;
+#endif
+};
+
+dir_cache *new_dir_cache(void) {
+    dir_cache *cache = (dir_cache *)calloc(1, sizeof(dir_cache));
+    if (!cache) return NULL;
+    cache->dirs = new_str_set();
+    if (!cache->dirs) {
+        free(cache);
+        return NULL;
+    }
+#if defined(__linux__) || defined(__APPLE__)
+    cache->last_fd = -1;
+#endif
+    return cache;
+}
+
+void free_dir_cache(dir_cache *cache) {
+#if defined(__linux__) || defined(__APPLE__)
+    if (cache->last_fd >= 0) close(cache->last_fd);
+    if (cache->created) free(cache->created);
+#endif
+    free_str_set(cache->dirs);
+    free(cache);
+}
+
+#if defined(__linux__) || defined(__APPLE__)
+
+/*
+ * Open the directory at the first base_len characters of path, reusing the last directory if possible.
+ */
+static int _open_base(dir_cache *cache, const char *path, size_t base_len) {
+    if (cache->last_fd >= 0 && cache->last_len == base_len && !memcmp(cache->last_path, path, base_len)) {
+        int fd = cache->last_fd;
+        cache->last_fd = -1;
+        return fd;
+    }
+    if (base_len > MAX_PATH_LENGTH) return -1;
+    char base[base_len + 1];
+    memcpy(base, path, base_len);
+    base[base_len] = '\0';
+    return open(base, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+}
+
+/*
+ * Record the path of a directory created through the cache to sync it later.
+ */
+static int _add_created(dir_cache *cache, const char *path) {
+    if (cache->created_cnt >= cache->created_cap) {
+        size_t new_cap = cache->created_cap ? cache->created_cap * 2 : 16;
+        const char **new_arr = (const char **)realloc(cache->created, new_cap * sizeof(const char *));
+        if (!new_arr) return EXIT_FAILURE;
+        cache->created = new_arr;
+        cache->created_cap = new_cap;
+    }
+    cache->created[cache->created_cnt++] = path;
+    return EXIT_SUCCESS;
+}
+
+int dir_cache_mkdirs(dir_cache *cache, const char *dir_path) {
+    if (dir_path[0] != '.') return EXIT_FAILURE;  // path must be relative and start with .
+
+    size_t len = strnlen(dir_path, MAX_PATH_LENGTH + 2);
+    if (len > MAX_PATH_LENGTH) {
+        error("Too long file name.");
+        return EXIT_FAILURE;
+    }
+    while (len > 1 && dir_path[len - 1] == PATH_SEP) len--;
+    if (str_set_contains(cache->dirs, dir_path, len)) return EXIT_SUCCESS;
+
+    char path[len + 1];
+    memcpy(path, dir_path, len);
+    path[len] = '\0';
+
+    // find the closest parent directory which is already in the cache
+    size_t pos = 0;
+    int dir_fd = AT_FDCWD;
+    for (size_t i = len - 1; i > 0; i--) {
+        if (path[i] != PATH_SEP || !str_set_contains(cache->dirs, path, i)) continue;
+        dir_fd = _open_base(cache, path, i);
+        if (dir_fd < 0) return EXIT_FAILURE;
+        pos = i + 1;
+        break;
+    }
+
+    const char *cached_path = NULL;
+    while (pos < len) {
+        size_t end = pos;
+        while (end < len && path[end] != PATH_SEP) end++;
+        if (end == pos) {  // empty component in "//"
+            pos++;
+            continue;
+        }
+        path[end] = '\0';
+        int status = mkdirat(dir_fd, path + pos, S_IRWXU | S_IRWXG);
+        // open fails if the existing file is not a directory
+        int fd = (status == 0 || errno == EEXIST)
+                     ? openat(dir_fd, path + pos, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC)
+                     : -1;
+        if (dir_fd != AT_FDCWD) close(dir_fd);
+        if (fd < 0) {
+#ifdef DEBUG_MODE
+            printf("Error creating directory %s\n", path);
+#endif
+            return EXIT_FAILURE;
+        }
+        dir_fd = fd;
+        cached_path = str_set_add(cache->dirs, path, end);
+        if (status == 0 && (!cached_path || _add_created(cache, cached_path) != EXIT_SUCCESS)) {
+            close(dir_fd);
+            return EXIT_FAILURE;
+        }
+        if (end < len) path[end] = PATH_SEP;
+        pos = end + 1;
+    }
+
+    if (cache->last_fd >= 0) close(cache->last_fd);
+    cache->last_fd = -1;
+    if (dir_fd == AT_FDCWD) return EXIT_SUCCESS;
+    if (cached_path) {
+        cache->last_fd = dir_fd;
+        cache->last_path = cached_path;
+        cache->last_len = len;
+    } else {
+        close(dir_fd);
+    }
+    return EXIT_SUCCESS;
+}
+
+int dir_cache_sync(const dir_cache *cache) {
+    int status = EXIT_SUCCESS;
+    // a directory is created after its parent. So, the directories are synced deepest first in the reverse order
+    for (size_t i = cache->created_cnt; i > 0; i--) {
+        if (sync_directory(cache->created[i - 1], 0) != EXIT_SUCCESS) status = EXIT_FAILURE;
+    }
+    return status;
+}
+
+#elif defined(_WIN32)
+
+int dir_cache_mkdirs(dir_cache *cache, const char *dir_path) {
+    size_t len = strnlen(dir_path, MAX_PATH_LENGTH + 2);
+    if (len > MAX_PATH_LENGTH) {
+        error("Too long file name.");
+        return EXIT_FAILURE;
+    }
+    if (str_set_contains(cache->dirs, dir_path, len)) return EXIT_SUCCESS;
+    if (mkdirs(dir_path) != EXIT_SUCCESS) return EXIT_FAILURE;
+    (void)str_set_add(cache->dirs, dir_path, len);
+    return EXIT_SUCCESS;
+}
+
+int dir_cache_sync(const dir_cache *cache) {
+    // directory entries are written with the file system metadata on Windows
+    (void)cache;
+    return EXIT_SUCCESS;
+}
+
+#endif
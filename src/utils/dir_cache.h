@@ -0,0 +1,54 @@
+/*
+ * utils/dir_cache.h - header for cache of created directories
+ * Copyright (C) 2026 H. Thevindu J. Wijesekera
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef UTILS_DIR_CACHE_H_
+#define UTILS_DIR_CACHE_H_
+
+/*
+ * Set of directories already created or verified during a single transfer.
+ * It is not thread-safe.
+ */
+typedef struct _dir_cache dir_cache;
+
+/*
+ * Creates an empty directory cache.
+ * returns the cache on success or NULL on failure.
+ */
+extern dir_cache *new_dir_cache(void);
+
+/*
+ * Frees the directory cache and closes the directory it keeps open.
+ */
+extern void free_dir_cache(dir_cache *cache);
+
+/*
+ * Same as mkdirs(), but each directory is created or verified only once for the cache.
+ * Missing directories are created with mkdirat() relative to the closest parent directory in the cache, keeping the
+ * last directory open for the next call.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+extern int dir_cache_mkdirs(dir_cache *cache, const char *dir_path);
+
+/*
+ * Syncs the entries of each directory created through the cache to the storage, deepest first.
+ * The directories must not have been moved since they were created.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+extern int dir_cache_sync(const dir_cache *cache);
+
+#endif  // UTILS_DIR_CACHE_H_
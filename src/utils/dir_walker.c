@@ -0,0 +1,768 @@
+/*
+ * utils/dir_walker.c - parallel directory walker
+ * Copyright (C) 2026 H. Thevindu J. Wijesekera
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#if defined(__linux__) || defined(__APPLE__)
+
+#define _FILE_OFFSET_BITS 64
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utils/dir_walker.h>
+#include <utils/utils.h>
+
+#define MAX_PATH_LENGTH 2048
+
+// maximum number of directory file descriptors kept open to open their sub-directories with openat()
+#define MAX_OPEN_DIR_FDS 256
+
+#define ENTRY_OTHER 0
+#define ENTRY_FILE 1
+#define ENTRY_DIR 2
+
+#define BUDGET_OK 0
+#define BUDGET_TOO_MANY_FILES 1
+#define BUDGET_TOO_LARGE_FILE 2
+#define WALK_ERROR 3  // some entries could not be added, and the walk result is incomplete
+
+typedef struct _walk_node walk_node;
+
+/*
+ * A directory to read in the walk.
+ * Entries of the directory are added to the path store under dir.
+ */
+struct _walk_node {
+    walk_node *parent;
+    walk_node *next_sibling;  // next sub-directory of the parent to be read
+    walk_node *alloc_next;    // next node allocated by the same worker
+    ps_dir *dir;
+    const char *name;
+    size_t name_len;
+    size_t path_len;          // length of the path of this directory
+    size_t child_prefix_len;  // length of the path including the PATH_SEP before the names of entries
+    int depth;
+    int fd;                    // kept open until all the sub-directories are opened, or -1
+    uint32_t pending_subdirs;  // number of sub-directories not opened yet
+};
+
+/*
+ * Double ended queue of directories to read.
+ * The owner worker pushes and pops at the tail. Other workers steal from the head.
+ */
+typedef struct _walk_deque {
+    pthread_mutex_t lock;
+    walk_node **tasks;
+    size_t head;
+    size_t tail;
+    size_t capacity;
+} walk_deque;
+
+typedef struct _walk_pool walk_pool;
+
+typedef struct _walk_worker {
+    walk_pool *pool;
+    unsigned id;
+    ps_writer *writer;
+    walk_node *nodes;  // nodes allocated by this worker, freed after the walk
+} walk_worker;
+
+struct _walk_pool {
+    walk_deque *deques;
+    walk_worker *workers;
+    unsigned worker_cnt;
+    int include_leaf_dirs;
+    const walk_budget *budget;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    size_t queued;   // number of tasks in the deques
+    size_t pending;  // number of tasks pushed but not completed
+    unsigned open_fds;
+    uint32_t entry_cnt;  // number of files and leaf directories counted against the budget
+    int exceeded;        // reason for stopping the walk, or BUDGET_OK
+};
+
+static inline int _is_dot_or_dot_dot(const char *name) {
+    return name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'));
+}
+
+/*
+ * Get the type of the directory entry using d_type if available. Falls back to fstatat() relative to the directory
+ * file descriptor only if the file system does not report the type.
+ */
+static inline int _get_entry_type(int dir_fd, const struct dirent *entry) {
+#ifdef _DIRENT_HAVE_D_TYPE
+    switch (entry->d_type) {
+        case DT_DIR:
+            return ENTRY_DIR;
+        case DT_REG:
+            return ENTRY_FILE;
+        case DT_UNKNOWN:
+            break;
+        default:
+            return ENTRY_OTHER;
+    }
+#elif defined(__APPLE__)
+    if (entry->d_type == DT_DIR) return ENTRY_DIR;
+    if (entry->d_type == DT_REG) return ENTRY_FILE;
+    if (entry->d_type != DT_UNKNOWN) return ENTRY_OTHER;
+#endif
+    struct stat sb;
+    if (fstatat(dir_fd, entry->d_name, &sb, AT_SYMLINK_NOFOLLOW)) return ENTRY_OTHER;
+    if (S_ISDIR(sb.st_mode)) return ENTRY_DIR;
+    if (S_ISREG(sb.st_mode)) return ENTRY_FILE;
+    return ENTRY_OTHER;
+}
+
+/*
+ * Get the size of the file name in the directory dir_fd if the budget limits the file size.
+ * Returns -1 if the size is not limited or not available.
+ */
+static int64_t _budget_file_size(const walk_budget *budget, int dir_fd, const char *name) {
+    if (!budget || budget->max_file_size < 0) return -1;
+    struct stat sb;
+    if (fstatat(dir_fd, name, &sb, AT_SYMLINK_NOFOLLOW)) return -1;
+    return (int64_t)sb.st_size;
+}
+
+/*
+ * Count a file of size file_size, or a leaf directory if file_size is -1, against the budget.
+ * entry_cnt_p is the number of entries already counted, which is incremented atomically.
+ * Returns BUDGET_OK if the budget is not exceeded. Otherwise, returns the reason.
+ */
+static int _charge_budget(const walk_budget *budget, uint32_t *entry_cnt_p, int64_t file_size) {
+    if (!budget) return BUDGET_OK;
+    if (budget->max_file_size >= 0 && file_size > budget->max_file_size) return BUDGET_TOO_LARGE_FILE;
+    if (budget->max_files > 0 && __atomic_add_fetch(entry_cnt_p, 1, __ATOMIC_RELAXED) > budget->max_files) {
+        return BUDGET_TOO_MANY_FILES;
+    }
+    return BUDGET_OK;
+}
+
+static void _log_stop_reason(int reason) {
+    if (reason == BUDGET_TOO_MANY_FILES) {
+        error("Directory walk stopped. Too many files.");
+    } else if (reason == BUDGET_TOO_LARGE_FILE) {
+        error("Directory walk stopped. File is too large.");
+    } else {
+        error("Directory walk stopped. Couldn't list some files.");
+    }
+}
+
+/*
+ * Stop the walk of the pool for the reason. Only the first reason is logged.
+ */
+static void _stop_walk(walk_pool *pool, int reason) {
+    int expected = BUDGET_OK;
+    if (__atomic_compare_exchange_n(&(pool->exceeded), &expected, reason, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        _log_stop_reason(reason);
+    }
+}
+
+static inline int _is_stopped(walk_pool *pool) {
+    return __atomic_load_n(&(pool->exceeded), __ATOMIC_RELAXED) != BUDGET_OK;
+}
+
+static walk_node *_new_node(walk_worker *worker, walk_node *parent, ps_dir *dir) {
+    walk_node *node = (walk_node *)calloc(1, sizeof(walk_node));
+    if (!node) return NULL;
+    node->alloc_next = worker->nodes;
+    worker->nodes = node;
+    node->parent = parent;
+    node->dir = dir;
+    node->name = path_store_dir_name(dir, &(node->name_len));
+    node->path_len = parent->child_prefix_len + node->name_len;
+    node->child_prefix_len = node->path_len;
+    if (node->name[node->name_len - 1] != PATH_SEP) node->child_prefix_len++;
+    node->depth = parent->depth + 1;
+    node->fd = -1;
+    return node;
+}
+
+/*
+ * Writes the path of the directory to buf, which must have space for at least path_len + 1 bytes.
+ */
+static void _get_node_path(const walk_node *node, char *buf) {
+    buf[node->path_len] = '\0';
+    for (; node->parent; node = node->parent) {
+        const walk_node *parent = node->parent;
+        memcpy(buf + parent->child_prefix_len, node->name, node->name_len);
+        if (parent->child_prefix_len > parent->path_len) buf[parent->path_len] = PATH_SEP;
+    }
+}
+
+static void _release_parent(walk_pool *pool, walk_node *parent) {
+    if (!parent->parent) return;  // pseudo root
+    if (__atomic_sub_fetch(&(parent->pending_subdirs), 1, __ATOMIC_ACQ_REL) == 0 && parent->fd >= 0) {
+        close(parent->fd);
+        parent->fd = -1;
+        __atomic_sub_fetch(&(pool->open_fds), 1, __ATOMIC_RELAXED);
+    }
+}
+
+static int _open_dir(walk_pool *pool, walk_node *node) {
+    walk_node *parent = node->parent;
+    int flags = O_RDONLY | O_DIRECTORY | O_CLOEXEC;
+    if (parent->parent) flags |= O_NOFOLLOW;  // copied directories may be symlinks, but not the ones inside them
+    int fd;
+    if (!parent->parent) {
+        fd = open(node->name, flags);
+    } else if (parent->fd >= 0) {
+        fd = openat(parent->fd, node->name, flags);
+    } else {
+        char path[MAX_PATH_LENGTH + 1];
+        _get_node_path(node, path);
+        fd = open(path, flags);
+    }
+    _release_parent(pool, parent);
+    return fd;
+}
+
+/*
+ * Keep a duplicate of the directory file descriptor to open the sub-directories relative to it.
+ * Returns -1 if too many descriptors are already kept open. Then the sub-directories are opened with their paths.
+ */
+static int _keep_fd(walk_pool *pool, int dir_fd) {
+    if (__atomic_add_fetch(&(pool->open_fds), 1, __ATOMIC_RELAXED) > MAX_OPEN_DIR_FDS) {
+        __atomic_sub_fetch(&(pool->open_fds), 1, __ATOMIC_RELAXED);
+        return -1;
+    }
+    int fd = fcntl(dir_fd, F_DUPFD_CLOEXEC, 0);
+    if (fd < 0) __atomic_sub_fetch(&(pool->open_fds), 1, __ATOMIC_RELAXED);
+    return fd;
+}
+
+static void _push_task(walk_pool *pool, unsigned id, walk_node *node) {
+    // counted before the task is published, so that the counts do not drop below zero if another worker takes and
+    // completes it before this worker returns
+    pthread_mutex_lock(&(pool->lock));
+    pool->queued++;
+    pool->pending++;
+    pthread_mutex_unlock(&(pool->lock));
+
+    walk_deque *deque = pool->deques + id;
+    pthread_mutex_lock(&(deque->lock));
+    if (deque->tail >= deque->capacity) {
+        if (deque->head > 0) {
+            memmove(deque->tasks, deque->tasks + deque->head, sizeof(walk_node *) * (deque->tail - deque->head));
+            deque->tail -= deque->head;
+            deque->head = 0;
+        }
+        if (deque->tail >= deque->capacity) {
+            size_t new_cap = deque->capacity ? deque->capacity * 2 : 64;
+            walk_node **new_arr = (walk_node **)realloc(deque->tasks, sizeof(walk_node *) * new_cap);
+            if (!new_arr) {
+                pthread_mutex_unlock(&(deque->lock));
+                _stop_walk(pool, WALK_ERROR);
+                _release_parent(pool, node->parent);  // the directory is skipped
+                pthread_mutex_lock(&(pool->lock));
+                pool->queued--;
+                pool->pending--;
+                if (pool->pending == 0) pthread_cond_broadcast(&(pool->cond));
+                pthread_mutex_unlock(&(pool->lock));
+                return;
+            }
+            deque->tasks = new_arr;
+            deque->capacity = new_cap;
+        }
+    }
+    deque->tasks[deque->tail++] = node;
+    pthread_mutex_unlock(&(deque->lock));
+
+    pthread_mutex_lock(&(pool->lock));
+    pthread_cond_signal(&(pool->cond));
+    pthread_mutex_unlock(&(pool->lock));
+}
+
+static walk_node *_take_task(walk_pool *pool, unsigned id, int steal) {
+    walk_deque *deque = pool->deques + id;
+    walk_node *node = NULL;
+    pthread_mutex_lock(&(deque->lock));
+    if (deque->head < deque->tail) {
+        if (steal) {
+            node = deque->tasks[deque->head++];
+        } else {
+            node = deque->tasks[--(deque->tail)];
+        }
+        if (deque->head == deque->tail) {
+            deque->head = 0;
+            deque->tail = 0;
+        }
+    }
+    pthread_mutex_unlock(&(deque->lock));
+    if (node) {
+        pthread_mutex_lock(&(pool->lock));
+        pool->queued--;
+        pthread_mutex_unlock(&(pool->lock));
+    }
+    return node;
+}
+
+static void _read_dir(walk_worker *worker, walk_node *node) {
+    walk_pool *pool = worker->pool;
+    if (node->depth > MAX_RECURSE_DEPTH || _is_stopped(pool)) {
+        _release_parent(pool, node->parent);
+        return;
+    }
+    int fd = _open_dir(pool, node);
+    if (fd < 0) {
+#ifdef DEBUG_MODE
+        printf("Error opening directory %s\n", node->name);
+#endif
+        return;
+    }
+    DIR *d = fdopendir(fd);
+    if (!d) {
+        close(fd);
+        return;
+    }
+    walk_node *subdirs = NULL;  // in the reverse order
+    uint32_t subdir_cnt = 0;
+    int8_t is_empty = 1;
+    const struct dirent *dir;
+    while ((dir = readdir(d)) != NULL) {
+        const char *filename = dir->d_name;
+        if (_is_dot_or_dot_dot(filename)) continue;
+        is_empty = 0;
+        const size_t fname_len = strnlen(filename, sizeof(dir->d_name));
+        if (node->child_prefix_len + fname_len > MAX_PATH_LENGTH) {
+            error("Too long file name.");
+            _stop_walk(pool, WALK_ERROR);
+            break;
+        }
+        int type = _get_entry_type(fd, dir);
+        if (type == ENTRY_FILE) {
+            const int64_t file_size = _budget_file_size(pool->budget, fd, filename);
+            int reason = _charge_budget(pool->budget, &(pool->entry_cnt), file_size);
+            if (reason != BUDGET_OK) {
+                _stop_walk(pool, reason);
+                break;
+            }
+            if (path_store_add_file(worker->writer, node->dir, filename, fname_len) != EXIT_SUCCESS) {
+                _stop_walk(pool, WALK_ERROR);
+                break;
+            }
+        } else if (type == ENTRY_DIR) {
+            if (_is_stopped(pool)) break;
+            ps_dir *sub_dir = path_store_add_dir(worker->writer, node->dir, filename, fname_len);
+            walk_node *child = sub_dir ? _new_node(worker, node, sub_dir) : NULL;
+            if (!child) {
+                _stop_walk(pool, WALK_ERROR);
+                break;
+            }
+            child->next_sibling = subdirs;
+            subdirs = child;
+            subdir_cnt++;
+        }
+    }
+    if (pool->include_leaf_dirs && is_empty) {
+        int reason = _charge_budget(pool->budget, &(pool->entry_cnt), -1);
+        if (reason == BUDGET_OK) {
+            path_store_set_leaf(worker->writer, node->dir);
+        } else {
+            _stop_walk(pool, reason);
+        }
+    }
+    node->pending_subdirs = subdir_cnt;
+    if (subdir_cnt > 0) node->fd = _keep_fd(pool, fd);
+    (void)closedir(d);
+
+    // pushed in the reverse order so that this worker reads the first sub-directory next
+    for (walk_node *child = subdirs; child; child = child->next_sibling) {
+        _push_task(pool, worker->id, child);
+    }
+}
+
+static void *_worker(void *arg) {
+    walk_worker *worker = (walk_worker *)arg;
+    walk_pool *pool = worker->pool;
+    const unsigned id = worker->id;
+    while (1) {
+        walk_node *node = _take_task(pool, id, 0);
+        for (unsigned i = 1; !node && i < pool->worker_cnt; i++) {
+            node = _take_task(pool, (id + i) % pool->worker_cnt, 1);
+        }
+        if (node) {
+            _read_dir(worker, node);
+            pthread_mutex_lock(&(pool->lock));
+            pool->pending--;
+            if (pool->pending == 0) pthread_cond_broadcast(&(pool->cond));
+            pthread_mutex_unlock(&(pool->lock));
+            continue;
+        }
+        pthread_mutex_lock(&(pool->lock));
+        while (pool->queued == 0 && pool->pending > 0) {
+            pthread_cond_wait(&(pool->cond), &(pool->lock));
+        }
+        const int done = (pool->pending == 0);
+        pthread_mutex_unlock(&(pool->lock));
+        if (done) break;
+    }
+    return NULL;
+}
+
+static unsigned _get_thread_count(void) {
+    long cpu_cnt = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpu_cnt < 1) return 1;
+    if (cpu_cnt > WALKER_MAX_THREADS) return WALKER_MAX_THREADS;
+    return (unsigned)cpu_cnt;
+}
+
+static void _run_workers(walk_pool *pool) {
+    pthread_t threads[WALKER_MAX_THREADS];
+    unsigned started = 1;
+    for (unsigned i = 1; i < pool->worker_cnt; i++) {
+        if (pthread_create(threads + started, NULL, &_worker, pool->workers + i)) break;
+        started++;
+    }
+    _worker(pool->workers);  // the calling thread is the worker 0
+    for (unsigned i = 1; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+}
+
+int walk_dir_tree(const char *const *roots, uint32_t root_cnt, int include_leaf_dirs, unsigned thread_cnt,
+                  const walk_budget *budget, path_store *store) {
+    if (thread_cnt == 0) thread_cnt = _get_thread_count();
+    if (thread_cnt > WALKER_MAX_THREADS) thread_cnt = WALKER_MAX_THREADS;
+
+    walk_deque deques[WALKER_MAX_THREADS];
+    walk_worker workers[WALKER_MAX_THREADS];
+    walk_pool pool = {.deques = deques,
+                      .workers = workers,
+                      .worker_cnt = thread_cnt,
+                      .include_leaf_dirs = include_leaf_dirs,
+                      .budget = budget,
+                      .queued = 0,
+                      .pending = 0,
+                      .open_fds = 0,
+                      .entry_cnt = 0,
+                      .exceeded = BUDGET_OK};
+    for (unsigned i = 0; i < thread_cnt; i++) {
+        workers[i].pool = &pool;
+        workers[i].id = i;
+        workers[i].nodes = NULL;
+        workers[i].writer = path_store_writer(store);
+        if (!workers[i].writer) {
+            while (i-- > 0) free_path_store_writer(store, workers[i].writer);
+            return EXIT_FAILURE;
+        }
+    }
+
+    walk_node root = {.parent = NULL, .dir = path_store_root(store), .fd = -1};
+    walk_node *root_dirs = NULL;  // in the reverse order
+    for (uint32_t i = 0; i < root_cnt; i++) {
+        const char *name = roots[i];
+        const size_t name_len = strnlen(name, MAX_PATH_LENGTH + 1);
+        if (name_len == 0 || name_len > MAX_PATH_LENGTH) continue;
+        struct stat statbuf;
+        if (stat(name, &statbuf)) {
+#ifdef DEBUG_MODE
+            puts("stat failed");
+#endif
+            continue;
+        }
+        if (S_ISREG(statbuf.st_mode)) {
+            int reason = _charge_budget(budget, &(pool.entry_cnt), (int64_t)statbuf.st_size);
+            if (reason != BUDGET_OK) {
+                _stop_walk(&pool, reason);
+                break;
+            }
+            if (path_store_add_file(workers[0].writer, root.dir, name, name_len) != EXIT_SUCCESS) {
+                _stop_walk(&pool, WALK_ERROR);
+                break;
+            }
+        } else if (S_ISDIR(statbuf.st_mode)) {
+            ps_dir *dir = path_store_add_dir(workers[0].writer, root.dir, name, name_len);
+            walk_node *node = dir ? _new_node(workers, &root, dir) : NULL;
+            if (!node) {
+                _stop_walk(&pool, WALK_ERROR);
+                break;
+            }
+            node->next_sibling = root_dirs;
+            root_dirs = node;
+        }
+    }
+
+    if (root_dirs && !_is_stopped(&pool)) {
+        pthread_mutex_init(&(pool.lock), NULL);
+        pthread_cond_init(&(pool.cond), NULL);
+        for (unsigned i = 0; i < thread_cnt; i++) {
+            memset(deques + i, 0, sizeof(walk_deque));
+            pthread_mutex_init(&(deques[i].lock), NULL);
+        }
+        for (walk_node *node = root_dirs; node; node = node->next_sibling) {
+            _push_task(&pool, 0, node);
+        }
+
+        _run_workers(&pool);
+
+        for (unsigned i = 0; i < thread_cnt; i++) {
+            if (deques[i].tasks) free(deques[i].tasks);
+            pthread_mutex_destroy(&(deques[i].lock));
+        }
+        pthread_cond_destroy(&(pool.cond));
+        pthread_mutex_destroy(&(pool.lock));
+    }
+
+    for (unsigned i = 0; i < thread_cnt; i++) {
+        walk_node *node = workers[i].nodes;
+        while (node) {
+            walk_node *next = node->alloc_next;
+            if (node->fd >= 0) close(node->fd);
+            free(node);
+            node = next;
+        }
+    }
+    return _is_stopped(&pool) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+struct _dir_stream {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    char **queue;  // circular buffer of paths
+    uint32_t capacity;
+    uint32_t head;
+    uint32_t count;
+    int8_t done;
+    int8_t cancelled;
+    int include_leaf_dirs;
+    char **roots;
+    uint32_t root_cnt;
+    const walk_budget *budget;  // points to budget_copy if the walk has a budget, or NULL
+    walk_budget budget_copy;
+    uint32_t entry_cnt;  // number of files and leaf directories counted against the budget
+    int exceeded;        // reason for stopping the walk other than cancelling, or BUDGET_OK
+};
+
+/*
+ * Record the reason for stopping the walk of the stream, so that the walk is not reported as complete.
+ * Only the first reason is kept and logged. Always returns EXIT_FAILURE.
+ */
+static int _stream_stop(dir_stream *stream, int reason) {
+    if (stream->exceeded == BUDGET_OK) {
+        stream->exceeded = reason;
+        _log_stop_reason(reason);
+    }
+    return EXIT_FAILURE;
+}
+
+/*
+ * Count an entry against the budget of the stream and stop the walk if the budget is exceeded.
+ * Returns EXIT_FAILURE if the walk should be stopped.
+ */
+static int _stream_charge(dir_stream *stream, int64_t file_size) {
+    int reason = _charge_budget(stream->budget, &(stream->entry_cnt), file_size);
+    if (reason == BUDGET_OK) return EXIT_SUCCESS;
+    return _stream_stop(stream, reason);
+}
+
+/*
+ * Waits until there is space in the queue and appends the path to it.
+ * Returns EXIT_FAILURE if the stream is cancelled or path is NULL, which is an allocation failure that stops the walk
+ * with an error.
+ */
+static int _stream_push(dir_stream *stream, char *path) {
+    if (!path) return _stream_stop(stream, WALK_ERROR);
+    pthread_mutex_lock(&(stream->lock));
+    while (stream->count >= stream->capacity && !stream->cancelled) {
+        pthread_cond_wait(&(stream->not_full), &(stream->lock));
+    }
+    if (stream->cancelled) {
+        pthread_mutex_unlock(&(stream->lock));
+        free(path);
+        return EXIT_FAILURE;
+    }
+    stream->queue[(stream->head + stream->count) % stream->capacity] = path;
+    stream->count++;
+    pthread_cond_signal(&(stream->not_empty));
+    pthread_mutex_unlock(&(stream->lock));
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Recursively push all file paths in the directory opened as dir_fd to the stream.
+ * path must contain the path of the directory and have space for MAX_PATH_LENGTH + 2 bytes.
+ * Returns EXIT_FAILURE only if the walk should be stopped.
+ */
+static int _stream_dir(dir_stream *stream, int dir_fd, char *path, size_t path_len, int depth) {
+    DIR *d = fdopendir(dir_fd);
+    if (!d) {
+        close(dir_fd);
+        return EXIT_SUCCESS;
+    }
+    size_t prefix_len = path_len;
+    if (path[path_len - 1] != PATH_SEP) path[prefix_len++] = PATH_SEP;
+    path[prefix_len] = '\0';
+
+    int status = EXIT_SUCCESS;
+    int8_t is_empty = 1;
+    const struct dirent *dir;
+    while ((dir = readdir(d)) != NULL) {
+        const char *filename = dir->d_name;
+        if (_is_dot_or_dot_dot(filename)) continue;
+        is_empty = 0;
+        const size_t fname_len = strnlen(filename, sizeof(dir->d_name));
+        if (prefix_len + fname_len > MAX_PATH_LENGTH) {
+            error("Too long file name.");
+            status = _stream_stop(stream, WALK_ERROR);
+            break;
+        }
+        memcpy(path + prefix_len, filename, fname_len + 1);
+        int type = _get_entry_type(dir_fd, dir);
+        if (type == ENTRY_FILE) {
+            status = _stream_charge(stream, _budget_file_size(stream->budget, dir_fd, filename));
+            if (status == EXIT_SUCCESS) status = _stream_push(stream, strdup(path));
+        } else if (type == ENTRY_DIR && depth < MAX_RECURSE_DEPTH) {
+            int fd = openat(dir_fd, filename, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+            if (fd >= 0) status = _stream_dir(stream, fd, path, prefix_len + fname_len, depth + 1);
+        }
+        if (status != EXIT_SUCCESS) break;
+    }
+    if (status == EXIT_SUCCESS && stream->include_leaf_dirs && is_empty) {
+        path[prefix_len] = '\0';
+        status = _stream_charge(stream, -1);
+        if (status == EXIT_SUCCESS) status = _stream_push(stream, strdup(path));
+    }
+    (void)closedir(d);
+    return status;
+}
+
+static void *_stream_worker(void *arg) {
+    dir_stream *stream = (dir_stream *)arg;
+    char path[MAX_PATH_LENGTH + 2];  // +2 for the trailing PATH_SEP of leaf directories and the null terminator
+    for (uint32_t i = 0; i < stream->root_cnt; i++) {
+        const char *name = stream->roots[i];
+        const size_t name_len = strnlen(name, MAX_PATH_LENGTH + 1);
+        if (name_len == 0 || name_len > MAX_PATH_LENGTH) continue;
+        struct stat statbuf;
+        if (stat(name, &statbuf)) {
+#ifdef DEBUG_MODE
+            puts("stat failed");
+#endif
+            continue;
+        }
+        int status = EXIT_SUCCESS;
+        if (S_ISDIR(statbuf.st_mode)) {
+            int fd = open(name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+            if (fd < 0) continue;
+            memcpy(path, name, name_len + 1);
+            status = _stream_dir(stream, fd, path, name_len, 1);
+        } else if (S_ISREG(statbuf.st_mode)) {
+            status = _stream_charge(stream, (int64_t)statbuf.st_size);
+            if (status == EXIT_SUCCESS) status = _stream_push(stream, strdup(name));
+        }
+        if (status != EXIT_SUCCESS) break;
+    }
+    pthread_mutex_lock(&(stream->lock));
+    stream->done = 1;
+    pthread_cond_broadcast(&(stream->not_empty));
+    pthread_mutex_unlock(&(stream->lock));
+    return NULL;
+}
+
+static void _free_stream(dir_stream *stream) {
+    for (uint32_t i = 0; i < stream->count; i++) {
+        free(stream->queue[(stream->head + i) % stream->capacity]);
+    }
+    for (uint32_t i = 0; i < stream->root_cnt; i++) {
+        free(stream->roots[i]);
+    }
+    free(stream->roots);
+    free(stream->queue);
+    pthread_cond_destroy(&(stream->not_full));
+    pthread_cond_destroy(&(stream->not_empty));
+    pthread_mutex_destroy(&(stream->lock));
+    free(stream);
+}
+
+dir_stream *open_dir_stream(const char *const *roots, uint32_t root_cnt, int include_leaf_dirs,
+                            const walk_budget *budget, uint32_t queue_cap) {
+    if (queue_cap == 0) return NULL;
+    dir_stream *stream = (dir_stream *)calloc(1, sizeof(dir_stream));
+    if (!stream) return NULL;
+    stream->capacity = queue_cap;
+    stream->include_leaf_dirs = include_leaf_dirs;
+    if (budget) {
+        stream->budget_copy = *budget;
+        stream->budget = &(stream->budget_copy);
+    }
+    stream->exceeded = BUDGET_OK;
+    pthread_mutex_init(&(stream->lock), NULL);
+    pthread_cond_init(&(stream->not_empty), NULL);
+    pthread_cond_init(&(stream->not_full), NULL);
+    stream->queue = (char **)malloc(sizeof(char *) * queue_cap);
+    stream->roots = (char **)malloc(sizeof(char *) * (root_cnt ? root_cnt : 1));
+    if (!stream->queue || !stream->roots) {
+        _free_stream(stream);
+        return NULL;
+    }
+    for (uint32_t i = 0; i < root_cnt; i++) {
+        char *root = strdup(roots[i]);
+        if (!root) {
+            _free_stream(stream);
+            return NULL;
+        }
+        stream->roots[stream->root_cnt++] = root;
+    }
+    if (pthread_create(&(stream->thread), NULL, &_stream_worker, stream)) {
+        _free_stream(stream);
+        return NULL;
+    }
+    return stream;
+}
+
+char *dir_stream_next(dir_stream *stream) {
+    pthread_mutex_lock(&(stream->lock));
+    while (stream->count == 0 && !stream->done) {
+        pthread_cond_wait(&(stream->not_empty), &(stream->lock));
+    }
+    char *path = NULL;
+    if (stream->count > 0) {
+        path = stream->queue[stream->head];
+        stream->head = (stream->head + 1) % stream->capacity;
+        stream->count--;
+        pthread_cond_signal(&(stream->not_full));
+    }
+    pthread_mutex_unlock(&(stream->lock));
+    return path;
+}
+
+int dir_stream_status(dir_stream *stream) {
+    pthread_mutex_lock(&(stream->lock));
+    const int exceeded = stream->exceeded;
+    pthread_mutex_unlock(&(stream->lock));
+    return exceeded == BUDGET_OK ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+void close_dir_stream(dir_stream *stream) {
+    pthread_mutex_lock(&(stream->lock));
+    stream->cancelled = 1;
+    pthread_cond_broadcast(&(stream->not_full));
+    pthread_mutex_unlock(&(stream->lock));
+    pthread_join(stream->thread, NULL);
+    _free_stream(stream);
+}
+
+#endif
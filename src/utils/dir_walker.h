@@ -0,0 +1,92 @@
+/*
+ * utils/dir_walker.h - header for parallel directory walker
+ * Copyright (C) 2026 H. Thevindu J. Wijesekera
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef UTILS_DIR_WALKER_H_
+#define UTILS_DIR_WALKER_H_
+
+#include <stdint.h>
+#include <utils/path_store.h>
+
+// maximum depth of sub-directories to walk into
+#define MAX_RECURSE_DEPTH 256
+
+// maximum number of threads used to walk directories
+#define WALKER_MAX_THREADS 16
+
+/*
+ * Limits on the entries found in a directory walk. The walk is stopped as soon as a limit is exceeded.
+ * max_files limits the number of files and leaf directories, and max_file_size limits the size of each file.
+ * A limit of 0 for max_files or a negative max_file_size is not checked.
+ */
+typedef struct _walk_budget {
+    uint32_t max_files;
+    int64_t max_file_size;
+} walk_budget;
+
+#if defined(__linux__) || defined(__APPLE__)
+
+/*
+ * Walk the files and directories given by the root_cnt paths in roots and add them to the path store.
+ * Root paths are followed if they are symlinks. Symlinks inside the directories are not followed.
+ * Regular files in roots are added to the top level directory of the store as they are. Directories are walked
+ * recursively with up to thread_cnt threads, and all regular files in them are added to the store. If
+ * include_leaf_dirs is non-zero, empty directories are marked as leaf directories.
+ * The entries of each directory are added in the directory read order, regardless of the number of threads used.
+ * If thread_cnt is 0, the number of threads is selected based on the number of processors.
+ * If budget is not NULL, the walk is stopped as soon as any of its limits is exceeded, and the reason is logged.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure or if the budget is exceeded.
+ */
+extern int walk_dir_tree(const char *const *roots, uint32_t root_cnt, int include_leaf_dirs, unsigned thread_cnt,
+                         const walk_budget *budget, path_store *store);
+
+typedef struct _dir_stream dir_stream;
+
+/*
+ * Start walking the files and directories given by the root_cnt paths in roots on a separate thread.
+ * The paths are produced in the same order as iterating a path store filled by walk_dir_tree(), but only up to
+ * queue_cap paths are buffered until they are taken with dir_stream_next(). The root paths and the budget are copied.
+ * If budget is not NULL, the walk is stopped as soon as any of its limits is exceeded, and the reason is logged.
+ * Returns the stream on success. Otherwise, returns NULL.
+ * The stream must be closed with close_dir_stream().
+ */
+extern dir_stream *open_dir_stream(const char *const *roots, uint32_t root_cnt, int include_leaf_dirs,
+                                   const walk_budget *budget, uint32_t queue_cap);
+
+/*
+ * Waits for the next path from the stream.
+ * Returns the path allocated with malloc, which should be freed by the caller.
+ * Returns NULL if there are no more paths.
+ */
+extern char *dir_stream_next(dir_stream *stream);
+
+/*
+ * Check if the walk of the stream was stopped before listing all the paths, because its budget is exceeded or on an
+ * error such as an allocation failure or a too long path.
+ * Must be called only after dir_stream_next() returned NULL.
+ * Returns EXIT_FAILURE if the walk is incomplete. Otherwise, returns EXIT_SUCCESS.
+ */
+extern int dir_stream_status(dir_stream *stream);
+
+/*
+ * Stops the walk if it is not finished and frees the stream.
+ */
+extern void close_dir_stream(dir_stream *stream);
+
+#endif
+
+#endif  // UTILS_DIR_WALKER_H_
@@ -0,0 +1,445 @@
+/*
+ * utils/file_io.c - large file reads and writes
+ * Copyright (C) 2026 H. Thevindu J. Wijesekera
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifdef __linux__
+#define _GNU_SOURCE  // for fallocate, sync_file_range, syncfs, and O_DIRECT
+#endif
+#define _FILE_OFFSET_BITS 64
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utils/file_io.h>
+#include <utils/utils.h>
+#if defined(__linux__) || defined(__APPLE__)
+#include <pthread.h>
+#elif defined(_WIN32)
+#include <io.h>
+#endif
+
+#define IO_BUF_SZ 1048576L        // 1 MiB
+#define WRITE_BEHIND_SZ 8388608L  // 8 MiB
+#define DROP_CACHE_SZ 8388608L    // 8 MiB
+#define BUF_ALIGN 4096
+#define BUF_POOL_LEN 4
+
+struct _file_writer {
+#if defined(__linux__) || defined(__APPLE__)
+    int fd;
+#elif defined(_WIN32)
+    FILE *file;
+#endif
+    int mode;
+    char *buf;
+    size_t buf_len;      // length of the data in buf
+    int64_t offset;      // length of the data written to the file
+    int64_t write_back;  // end of the range submitted for write-back
+};
+
+struct _file_reader {
+#if defined(__linux__) || defined(__APPLE__)
+    int fd;
+#elif defined(_WIN32)
+    FILE *file;
+#endif
+    int mode;
+    char *buf;
+    int64_t size;
+    int64_t offset;   // length of the data read from the file
+    int64_t dropped;  // end of the range dropped from the page cache
+};
+
+#if defined(__linux__) || defined(__APPLE__)
+
+static void *buf_pool[BUF_POOL_LEN];
+static int buf_pool_len = 0;
+static pthread_mutex_t buf_pool_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Get a page-aligned buffer of IO_BUF_SZ bytes, reusing a buffer returned with _put_buf() if available.
+ */
+static char *_get_buf(void) {
+    void *buf = NULL;
+    pthread_mutex_lock(&buf_pool_lock);
+    if (buf_pool_len > 0) buf = buf_pool[--buf_pool_len];
+    pthread_mutex_unlock(&buf_pool_lock);
+    if (!buf && posix_memalign(&buf, BUF_ALIGN, IO_BUF_SZ)) return NULL;
+    return (char *)buf;
+}
+
+static void _put_buf(char *buf) {
+    pthread_mutex_lock(&buf_pool_lock);
+    if (buf_pool_len < BUF_POOL_LEN) {
+        buf_pool[buf_pool_len++] = buf;
+        buf = NULL;
+    }
+    pthread_mutex_unlock(&buf_pool_lock);
+    if (buf) free(buf);
+}
+
+/*
+ * Set or clear the file status flag of fd.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+static inline int _set_fl(int fd, int flag, int enable) {
+    int flags = fcntl(fd, F_GETFL);
+    if (flags == -1) return EXIT_FAILURE;
+    flags = enable ? (flags | flag) : (flags & ~flag);
+    return fcntl(fd, F_SETFL, flags) == -1 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+int sync_fd(int fd) {
+#ifdef __linux__
+    while (fdatasync(fd)) {
+#elif defined(__APPLE__)
+    // fsync does not flush the disk cache on macOS
+    if (fcntl(fd, F_FULLFSYNC) != -1) return EXIT_SUCCESS;
+    while (fsync(fd)) {
+#endif
+        if (errno != EINTR) return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Apply the mode to the open file. The file is used without the mode if the file system does not support it.
+ * returns the mode applied to the file.
+ */
+static int _apply_mode(int fd, int mode) {
+#ifdef __linux__
+    if (mode & FILE_IO_STREAM) (void)posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    if ((mode & FILE_IO_DIRECT) && _set_fl(fd, O_DIRECT, 1) != EXIT_SUCCESS) mode &= ~FILE_IO_DIRECT;
+#elif defined(__APPLE__)
+    // macOS has no posix_fadvise. Both modes bypass the cache with F_NOCACHE.
+    if ((mode & (FILE_IO_STREAM | FILE_IO_DIRECT)) && fcntl(fd, F_NOCACHE, 1) == -1) {
+        mode &= ~(FILE_IO_STREAM | FILE_IO_DIRECT);
+    }
+#endif
+    return mode;
+}
+
+/*
+ * Drop the pages of the file in the range from offset to offset+len from the page cache.
+ * Dirty pages are not dropped.
+ */
+static inline void _drop_cache(int fd, int64_t offset, int64_t len) {
+#ifdef __linux__
+    (void)posix_fadvise(fd, (off_t)offset, (off_t)len, POSIX_FADV_DONTNEED);
+#else
+    (void)fd;
+    (void)offset;
+    (void)len;
+#endif
+}
+
+/*
+ * Reserve the space for the file.
+ * Only fails if there is not enough space. Does nothing if the file system does not support preallocation.
+ */
+static int _preallocate(int fd, int64_t size) {
+    if (size <= 0) return EXIT_SUCCESS;
+#ifdef __linux__
+    if (fallocate(fd, 0, 0, (off_t)size) == 0) return EXIT_SUCCESS;
+#elif defined(__APPLE__)
+    fstore_t store = {F_ALLOCATEALL, F_PEOFPOSMODE, 0, (off_t)size, 0};
+    if (fcntl(fd, F_PREALLOCATE, &store) != -1) return EXIT_SUCCESS;
+#endif
+    if (errno == ENOSPC || errno == EFBIG) {
+#ifdef DEBUG_MODE
+        puts("Not enough space for the file");
+#endif
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Start the write-back of each completed window of written data and wait for the window before it, which bounds the
+ * amount of dirty pages of the file to about two windows. In the streaming mode, the window which is already written
+ * back is dropped from the page cache.
+ */
+static inline void _write_behind(file_writer *writer) {
+#ifdef __linux__
+    if (writer->mode & FILE_IO_DIRECT) return;  // no dirty pages
+    while (writer->offset - writer->write_back >= WRITE_BEHIND_SZ) {
+        (void)sync_file_range(writer->fd, writer->write_back, WRITE_BEHIND_SZ, SYNC_FILE_RANGE_WRITE);
+        if (writer->write_back >= WRITE_BEHIND_SZ) {
+            const int64_t prev = writer->write_back - WRITE_BEHIND_SZ;
+            (void)sync_file_range(writer->fd, prev, WRITE_BEHIND_SZ,
+                                  SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+            if (writer->mode & FILE_IO_STREAM) _drop_cache(writer->fd, prev, WRITE_BEHIND_SZ);
+        }
+        writer->write_back += WRITE_BEHIND_SZ;
+    }
+#else
+    (void)writer;
+#endif
+}
+
+static int _flush(file_writer *writer) {
+#ifdef __linux__
+    if ((writer->mode & FILE_IO_DIRECT) && (writer->buf_len % BUF_ALIGN)) {
+        // direct writes must be a multiple of the block size. This is the last part of the file.
+        if (_set_fl(writer->fd, O_DIRECT, 0) != EXIT_SUCCESS) return EXIT_FAILURE;
+        writer->mode &= ~FILE_IO_DIRECT;
+    }
+#endif
+    const char *ptr = writer->buf;
+    size_t remaining = writer->buf_len;
+    while (remaining) {
+        ssize_t written = write(writer->fd, ptr, remaining);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return EXIT_FAILURE;
+        }
+        ptr += written;
+        remaining -= (size_t)written;
+    }
+    writer->offset += (int64_t)writer->buf_len;
+    writer->buf_len = 0;
+    _write_behind(writer);
+    return EXIT_SUCCESS;
+}
+
+file_writer *open_file_writer(const char *path, int64_t size, int mode) {
+    file_writer *writer = (file_writer *)calloc(1, sizeof(file_writer));
+    if (!writer) return NULL;
+    writer->buf = _get_buf();
+    if (!writer->buf) {
+        free(writer);
+        return NULL;
+    }
+    // an existing file is never replaced, including one created by the write pool for a file of the same name
+    writer->fd = open(path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0666);
+    if (writer->fd < 0) {
+#ifdef DEBUG_MODE
+        if (errno == EEXIST) printf("file exists : %s\n", path);
+#endif
+        _put_buf(writer->buf);
+        free(writer);
+        return NULL;
+    }
+    if (_preallocate(writer->fd, size) != EXIT_SUCCESS) {
+        close(writer->fd);
+        unlink(path);
+        _put_buf(writer->buf);
+        free(writer);
+        return NULL;
+    }
+    writer->mode = _apply_mode(writer->fd, mode);
+    return writer;
+}
+
+int close_file_writer(file_writer *writer) {
+    int status = _flush(writer);
+    if (status == EXIT_SUCCESS && (writer->mode & FILE_IO_STREAM)) {
+#ifdef __linux__
+        // write back the remaining part to drop it from the page cache
+        const int64_t start = writer->write_back >= WRITE_BEHIND_SZ ? writer->write_back - WRITE_BEHIND_SZ : 0;
+        (void)sync_file_range(writer->fd, start, 0,
+                              SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+        _drop_cache(writer->fd, start, 0);
+#endif
+    }
+    if (status == EXIT_SUCCESS && (writer->mode & FILE_IO_SYNC)) status = sync_fd(writer->fd);
+    if (close(writer->fd)) status = EXIT_FAILURE;
+    _put_buf(writer->buf);
+    free(writer);
+    return status;
+}
+
+file_reader *open_file_reader(const char *path) {
+    file_reader *reader = (file_reader *)calloc(1, sizeof(file_reader));
+    if (!reader) return NULL;
+    reader->buf = _get_buf();
+    if (!reader->buf) {
+        free(reader);
+        return NULL;
+    }
+    reader->fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat statbuf;
+    if (reader->fd < 0 || fstat(reader->fd, &statbuf) || !S_ISREG(statbuf.st_mode)) {
+#ifdef DEBUG_MODE
+        puts("not a file");
+#endif
+        if (reader->fd >= 0) close(reader->fd);
+        _put_buf(reader->buf);
+        free(reader);
+        return NULL;
+    }
+    reader->size = (int64_t)statbuf.st_size;
+    return reader;
+}
+
+void file_reader_set_mode(file_reader *reader, int mode) { reader->mode = _apply_mode(reader->fd, mode); }
+
+const char *file_reader_read(file_reader *reader, size_t *len_p) {
+    ssize_t len;
+    while ((len = read(reader->fd, reader->buf, IO_BUF_SZ)) < 0) {
+        if (errno == EINTR) continue;
+#ifdef __linux__
+        // the offset is not aligned after a short read. Continue without direct reads.
+        if (errno == EINVAL && (reader->mode & FILE_IO_DIRECT) && _set_fl(reader->fd, O_DIRECT, 0) == EXIT_SUCCESS) {
+            reader->mode &= ~FILE_IO_DIRECT;
+            continue;
+        }
+#endif
+        return NULL;
+    }
+    if (len == 0) return NULL;
+    reader->offset += len;
+    if ((reader->mode & FILE_IO_STREAM) && reader->offset - reader->dropped >= DROP_CACHE_SZ) {
+        _drop_cache(reader->fd, reader->dropped, reader->offset - reader->dropped);
+        reader->dropped = reader->offset;
+    }
+    *len_p = (size_t)len;
+    return reader->buf;
+}
+
+void close_file_reader(file_reader *reader) {
+    if (reader->mode & FILE_IO_STREAM) _drop_cache(reader->fd, reader->dropped, 0);
+    close(reader->fd);
+    _put_buf(reader->buf);
+    free(reader);
+}
+
+#elif defined(_WIN32)
+
+static int _flush(file_writer *writer) {
+    if (fwrite(writer->buf, 1, writer->buf_len, writer->file) < writer->buf_len) return EXIT_FAILURE;
+    writer->offset += (int64_t)writer->buf_len;
+    writer->buf_len = 0;
+    return EXIT_SUCCESS;
+}
+
+file_writer *open_file_writer(const char *path, int64_t size, int mode) {
+    (void)size;
+    file_writer *writer = (file_writer *)calloc(1, sizeof(file_writer));
+    if (!writer) return NULL;
+    writer->mode = mode;
+    writer->buf = malloc(IO_BUF_SZ);
+    if (!writer->buf) {
+        free(writer);
+        return NULL;
+    }
+    writer->file = open_file(path, "wb");
+    if (!writer->file) {
+        free(writer->buf);
+        free(writer);
+        return NULL;
+    }
+    setvbuf(writer->file, NULL, _IONBF, 0);  // data is already buffered in large blocks
+    return writer;
+}
+
+int close_file_writer(file_writer *writer) {
+    int status = _flush(writer);
+    if (status == EXIT_SUCCESS && (writer->mode & FILE_IO_SYNC) &&
+        (fflush(writer->file) || _commit(_fileno(writer->file)))) {
+        status = EXIT_FAILURE;
+    }
+    if (fclose(writer->file)) status = EXIT_FAILURE;
+    free(writer->buf);
+    free(writer);
+    return status;
+}
+
+file_reader *open_file_reader(const char *path) {
+    file_reader *reader = (file_reader *)calloc(1, sizeof(file_reader));
+    if (!reader) return NULL;
+    reader->buf = malloc(IO_BUF_SZ);
+    if (!reader->buf) {
+        free(reader);
+        return NULL;
+    }
+    reader->file = open_file(path, "rb");
+    reader->size = reader->file ? get_file_size(reader->file) : -1;
+    if (reader->size < 0) {
+        if (reader->file) fclose(reader->file);
+        free(reader->buf);
+        free(reader);
+        return NULL;
+    }
+    setvbuf(reader->file, NULL, _IONBF, 0);
+    return reader;
+}
+
+void file_reader_set_mode(file_reader *reader, int mode) { reader->mode = mode; }
+
+const char *file_reader_read(file_reader *reader, size_t *len_p) {
+    size_t len = fread(reader->buf, 1, IO_BUF_SZ, reader->file);
+    if (len == 0) return NULL;
+    reader->offset += (int64_t)len;
+    *len_p = len;
+    return reader->buf;
+}
+
+void close_file_reader(file_reader *reader) {
+    fclose(reader->file);
+    free(reader->buf);
+    free(reader);
+}
+
+#endif
+
+#if defined(__linux__) || defined(__APPLE__)
+
+int sync_directory(const char *path, int whole_fs) {
+    int fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) return EXIT_FAILURE;
+    int status;
+#ifdef __linux__
+    if (whole_fs) {
+        status = syncfs(fd) ? EXIT_FAILURE : EXIT_SUCCESS;
+    } else {
+        status = sync_fd(fd);
+    }
+#else
+    (void)whole_fs;
+    status = sync_fd(fd);
+#endif
+    close(fd);
+    return status;
+}
+
+#elif defined(_WIN32)
+
+int sync_directory(const char *path, int whole_fs) {
+    // directory entries are written with the file system metadata on Windows
+    (void)path;
+    (void)whole_fs;
+    return EXIT_SUCCESS;
+}
+
+#endif
+
+char *file_writer_buf(file_writer *writer, size_t *len_p) {
+    *len_p = IO_BUF_SZ - writer->buf_len;
+    return writer->buf + writer->buf_len;
+}
+
+int file_writer_commit(file_writer *writer, size_t len) {
+    writer->buf_len += len;
+    if (writer->buf_len < IO_BUF_SZ) return EXIT_SUCCESS;
+    return _flush(writer);
+}
+
+int64_t file_reader_size(const file_reader *reader) { return reader->size; }
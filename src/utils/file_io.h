@@ -0,0 +1,121 @@
+/*
+ * utils/file_io.h - header for large file reads and writes
+ * Copyright (C) 2026 H. Thevindu J. Wijesekera
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef UTILS_FILE_IO_H_
+#define UTILS_FILE_IO_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Streaming mode. Data behind the read or write position is dropped from the page cache.
+ */
+#define FILE_IO_STREAM 1
+
+/*
+ * Direct mode. Data is read or written bypassing the page cache where the file system supports it.
+ */
+#define FILE_IO_DIRECT 2
+
+/*
+ * Sync mode. Data of the file is synced to the storage when the writer is closed.
+ */
+#define FILE_IO_SYNC 4
+
+/*
+ * Writes a file of known size through a large page-aligned buffer.
+ * The file is preallocated when it is opened, and written data is handed to the kernel for write-back in the
+ * background so that dirty pages do not pile up.
+ */
+typedef struct _file_writer file_writer;
+
+/*
+ * Reads a regular file through a large page-aligned buffer.
+ */
+typedef struct _file_reader file_reader;
+
+/*
+ * Creates the file at path for writing size bytes and preallocates the space for it.
+ * Fails if the file already exists on Linux and macOS, where it may have been created by the write pool. Fails early
+ * if there is not enough space for the file, and then the file is removed.
+ * mode is a combination of FILE_IO_STREAM, FILE_IO_DIRECT, and FILE_IO_SYNC, or 0 for the normal mode.
+ * returns the writer on success or NULL on failure.
+ */
+extern file_writer *open_file_writer(const char *path, int64_t size, int mode);
+
+/*
+ * Get the free space in the buffer of the writer.
+ * Sets len_p to the length of the free space, which is never 0.
+ */
+extern char *file_writer_buf(file_writer *writer, size_t *len_p);
+
+/*
+ * Adds the first len bytes of the free space of the buffer to the file.
+ * The buffer is written to the file when it is full.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+extern int file_writer_commit(file_writer *writer, size_t len);
+
+/*
+ * Writes the remaining data in the buffer, closes the file, and frees the writer.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+extern int close_file_writer(file_writer *writer);
+
+/*
+ * Opens the regular file at path for reading.
+ * returns the reader on success or NULL on failure or if the file is not a regular file.
+ */
+extern file_reader *open_file_reader(const char *path);
+
+/*
+ * Get the size of the file when it was opened.
+ */
+extern int64_t file_reader_size(const file_reader *reader);
+
+/*
+ * Sets the mode for the rest of the file, which is a combination of FILE_IO_STREAM and FILE_IO_DIRECT.
+ */
+extern void file_reader_set_mode(file_reader *reader, int mode);
+
+/*
+ * Reads the next part of the file into the buffer of the reader.
+ * The returned data is valid only until the next call to file_reader_read() or close_file_reader().
+ * Sets len_p to the length of the data.
+ * returns NULL at the end of the file or on failure.
+ */
+extern const char *file_reader_read(file_reader *reader, size_t *len_p);
+
+extern void close_file_reader(file_reader *reader);
+
+#if defined(__linux__) || defined(__APPLE__)
+/*
+ * Syncs the data of the open file fd to the storage.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+extern int sync_fd(int fd);
+#endif
+
+/*
+ * Syncs the entries of the directory at path to the storage.
+ * If whole_fs is not 0, syncs all the data of the file system containing the directory instead, where supported.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+extern int sync_directory(const char *path, int whole_fs);
+
+#endif  // UTILS_FILE_IO_H_
@@ -18,6 +18,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <utils/list_utils.h>
 #include <utils/utils.h>
 
@@ -32,10 +33,24 @@ list2 *init_list(uint32_t len) {
     lst->array = arr;
     lst->len = 0;
     lst->capacity = len;
+    lst->mem = NULL;
+    return lst;
+}
+
+list2 *init_list_arena(arena *mem, uint32_t len) {
+    list2 *lst = (list2 *)arena_alloc(mem, sizeof(list2));
+    if (!lst) return NULL;
+    void **arr = (void **)arena_alloc(mem, len * sizeof(void *));
+    if (!arr) return NULL;
+    lst->array = arr;
+    lst->len = 0;
+    lst->capacity = len;
+    lst->mem = mem;
     return lst;
 }
 
 void free_list(list2 *lst) {
+    if (lst->mem) return;  // freed with the arena
     for (uint32_t i = 0; i < lst->len; i++) {
         if (lst->array[i]) free(lst->array[i]);
     }
@@ -53,7 +68,13 @@ void append(list2 *lst, void *elem) {
         } else {
             new_cap = 0xFFFFFFFFUL;
         }
-        void **new_arr = (void **)realloc(lst->array, sizeof(void *) * new_cap);
+        void **new_arr;
+        if (lst->mem) {
+            new_arr = (void **)arena_alloc(lst->mem, sizeof(void *) * new_cap);
+            if (new_arr) memcpy(new_arr, lst->array, sizeof(void *) * lst->len);
+        } else {
+            new_arr = (void **)realloc(lst->array, sizeof(void *) * new_cap);
+        }
         if (!new_arr) return;
         lst->array = new_arr;
         lst->capacity = new_cap;
@@ -21,11 +21,13 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <utils/arena.h>
 
 typedef struct _list {
     uint32_t len;
     uint32_t capacity;
     void **array;
+    arena *mem;  // arena which the list is allocated from, or NULL if allocated with malloc
 } list2;
 
 /*
@@ -34,8 +36,17 @@ typedef struct _list {
  */
 extern list2 *init_list(uint32_t len);
 
+/*
+ * Initialize a list2 with initial capacity len, allocated from the arena mem.
+ * Elements appended to the list should also be allocated from the same arena.
+ * The list and its elements are freed with the arena.
+ * returns NULL on error
+ */
+extern list2 *init_list_arena(arena *mem, uint32_t len);
+
 /*
  * Free the memory allocated to a list2 *lst
+ * Does nothing if the list is allocated from an arena.
  */
 extern void free_list(list2 *lst);
 
@@ -20,7 +20,6 @@
 
 #include <X11/Xatom.h>
 #include <X11/Xlib.h>
-#include <X11/Xmu/Atoms.h>
 #include <X11/extensions/Xfixes.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -37,6 +36,8 @@
 static volatile int running;
 
 int clipboard_listen(ListenerCallback callback) {
+    // the send threads read the clipboard through their own connections while this one waits for events
+    xclip_init();
     Display *dpy = XOpenDisplay(NULL);
     if (!dpy) {
 #ifdef DEBUG_MODE
@@ -45,10 +46,20 @@ int clipboard_listen(ListenerCallback callback) {
         return EXIT_FAILURE;
     }
 
+    int event_base, error_base;
+    if (!XFixesQueryExtension(dpy, &event_base, &error_base)) {
+#ifdef DEBUG_MODE
+        fputs("XFixes is not available\n", stderr);
+#endif
+        XCloseDisplay(dpy);
+        return EXIT_FAILURE;
+    }
     Atom clip = XInternAtom(dpy, "CLIPBOARD", 0);
     Window win = DefaultRootWindow(dpy);
     XFixesSelectSelectionInput(dpy, win, clip, XFixesSetSelectionOwnerNotifyMask);
 
+    // owner changes are reported to the xclip snapshot, which lets the send threads share one read of the clipboard
+    xclip_snapshot_start();
     running = 1;
     while (running) {
         XEvent evt;
@@ -56,14 +67,14 @@ int clipboard_listen(ListenerCallback callback) {
         if (!running) {
             break;
         }
-        if (check_and_delete_temp_file()) {  // send text only if it's not from clip-share
-            continue;
-        }
-        int copied_type = get_copied_type();
-        if (copied_type != COPIED_TYPE_NONE) {
-            callback(copied_type);
+        if (evt.type == event_base + XFixesSelectionNotify) {
+            const XFixesSelectionNotifyEvent *notify = (const XFixesSelectionNotifyEvent *)&evt;
+            xclip_owner_changed(notify->owner, notify->selection_timestamp);
         }
+        // only the change is recorded here. the content is read and sent later, after a burst of changes settles
+        callback(check_and_delete_temp_file());
     }
+    xclip_snapshot_stop();
     XDestroyWindow(dpy, win);
     XCloseDisplay(dpy);
     return EXIT_SUCCESS;
@@ -60,15 +60,7 @@ ListenerCallback clip_callback = NULL;
         return;
     }
     self.changeCount = self.pasteboard.changeCount;
-
-    if (check_and_delete_temp_file()) {
-        return;
-    }
-
-    int8_t copied_type = get_copied_type();
-    if (copied_type != COPIED_TYPE_NONE) {
-        clip_callback(copied_type);
-    }
+    clip_callback(check_and_delete_temp_file());
 }
 
 @end
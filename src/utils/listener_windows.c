@@ -40,13 +40,7 @@ static LRESULT CALLBACK ClipWindProc(HWND window, UINT msg, WPARAM wParam, LPARA
             return 0;
         }
         case WM_CLIPBOARDUPDATE: {
-            if (check_and_delete_temp_file()) {  // send text only if it's not from clip-share
-                return 0;
-            }
-            int copied_type = get_copied_type();
-            if (copied_type != COPIED_TYPE_NONE) {
-                clip_callback(copied_type);
-            }
+            clip_callback(check_and_delete_temp_file());
             return 0;
         }
         default:
@@ -63,10 +63,9 @@ char *get_clipboard_text(uint32_t *lenptr) {
 }
 
 int put_clipboard_text(char *data, uint32_t len) {
-    char c = data[len];
     data[len] = 0;
     NSString *str_data = @(data);
-    data[len] = c;
+    free(data);
     NSPasteboard *pasteBoard = [NSPasteboard generalPasteboard];
     [pasteBoard clearContents];
     BOOL status = [pasteBoard setString:str_data forType:NSPasteboardTypeString];
@@ -76,6 +75,18 @@ int put_clipboard_text(char *data, uint32_t len) {
     return EXIT_SUCCESS;
 }
 
+int put_clipboard_image(char *data, uint32_t len) {
+    // the pasteboard data takes the buffer and frees it when it is released
+    NSData *png_data = [NSData dataWithBytesNoCopy:data length:len freeWhenDone:YES];
+    NSPasteboard *pasteBoard = [NSPasteboard generalPasteboard];
+    [pasteBoard clearContents];
+    BOOL status = [pasteBoard setData:png_data forType:NSPasteboardTypePNG];
+    if (status != YES) {
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
 char *get_copied_files_as_str(int *offset) {
     *offset = 0;
     NSPasteboard *pasteboard = [NSPasteboard generalPasteboard];
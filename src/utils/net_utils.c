@@ -523,6 +523,27 @@ int read_size(socket_t *socket, int64_t *size_ptr) {
     return EXIT_SUCCESS;
 }
 
+void interrupt_socket(socket_t *socket) {
+    if (IS_NULL_SOCK(socket->type)) return;
+    sock_t sd;
+    if (!IS_SSL(socket->type)) {
+        sd = socket->socket.plain;
+    } else {
+#ifdef NO_SSL
+        return;
+#elif defined(_WIN32)
+        sd = (sock_t)SSL_get_fd(socket->socket.ssl);
+#else
+        sd = SSL_get_fd(socket->socket.ssl);
+#endif
+    }
+#ifdef _WIN32
+    shutdown(sd, SD_BOTH);
+#else
+    shutdown(sd, SHUT_RDWR);
+#endif
+}
+
 void _close_socket(socket_t *socket, int await) {
     if (IS_NULL_SOCK(socket->type)) return;
     if (!IS_SSL(socket->type)) {
@@ -115,6 +115,12 @@ extern int send_size(socket_t *socket, int64_t num);
  */
 extern int read_size(socket_t *socket, int64_t *size_ptr);
 
+/*
+ * Shuts down the connection of a socket to make the reads and writes on it fail, including those blocked in other
+ * threads. The socket is not released and should still be closed.
+ */
+extern void interrupt_socket(socket_t *socket);
+
 /*
  * Closes a socket.
  */
@@ -0,0 +1,243 @@
+/*
+ * utils/path_store.c - compact store of file paths
+ * Copyright (C) 2026 H. Thevindu J. Wijesekera
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <utils/arena.h>
+#include <utils/path_store.h>
+#include <utils/utils.h>
+
+typedef struct _ps_entry ps_entry;
+
+struct _ps_entry {
+    ps_entry *next;
+    ps_dir *dir;  // NULL if the entry is a file
+    uint32_t name_len;
+    char name[];
+};
+
+struct _ps_dir {
+    ps_entry *first;
+    ps_entry *last;
+    const char *name;
+    uint32_t name_len;
+    int8_t is_leaf;
+};
+
+struct _ps_writer {
+    ps_writer *next;
+    arena *mem;
+    uint32_t count;
+};
+
+struct _path_store {
+    ps_writer *writers;
+    ps_dir root;
+};
+
+typedef struct _iter_frame {
+    const ps_entry *next;
+    size_t prefix_len;  // length of the path including the PATH_SEP before the names of entries
+    int8_t is_leaf;
+} iter_frame;
+
+struct _path_iter {
+    iter_frame *frames;
+    size_t depth;
+    size_t frame_cap;
+    char *path;
+    size_t path_cap;
+};
+
+path_store *new_path_store(void) {
+    path_store *store = (path_store *)calloc(1, sizeof(path_store));
+    return store;
+}
+
+void free_path_store(path_store *store) {
+    ps_writer *writer = store->writers;
+    while (writer) {
+        free_arena(writer->mem);
+        ps_writer *next = writer->next;
+        free(writer);
+        writer = next;
+    }
+    free(store);
+}
+
+ps_writer *path_store_writer(path_store *store) {
+    ps_writer *writer = (ps_writer *)calloc(1, sizeof(ps_writer));
+    if (!writer) return NULL;
+    writer->mem = new_arena(0);
+    if (!writer->mem) {
+        free(writer);
+        return NULL;
+    }
+    writer->next = store->writers;
+    store->writers = writer;
+    return writer;
+}
+
+void free_path_store_writer(path_store *store, ps_writer *writer) {
+    for (ps_writer **link = &(store->writers); *link; link = &((*link)->next)) {
+        if (*link != writer) continue;
+        *link = writer->next;
+        free_arena(writer->mem);
+        free(writer);
+        return;
+    }
+}
+
+ps_dir *path_store_root(path_store *store) { return &(store->root); }
+
+static ps_entry *_add_entry(ps_writer *writer, ps_dir *parent, const char *name, size_t name_len) {
+    if (name_len == 0 || name_len >= 0xFFFFFFFFUL) return NULL;
+    ps_entry *entry = (ps_entry *)arena_alloc(writer->mem, sizeof(ps_entry) + name_len + 1);
+    if (!entry) return NULL;
+    entry->next = NULL;
+    entry->dir = NULL;
+    entry->name_len = (uint32_t)name_len;
+    memcpy(entry->name, name, name_len);
+    entry->name[name_len] = '\0';
+    if (parent->last) {
+        parent->last->next = entry;
+    } else {
+        parent->first = entry;
+    }
+    parent->last = entry;
+    return entry;
+}
+
+ps_dir *path_store_add_dir(ps_writer *writer, ps_dir *parent, const char *name, size_t name_len) {
+    ps_dir *dir = (ps_dir *)arena_alloc(writer->mem, sizeof(ps_dir));
+    if (!dir) return NULL;
+    ps_entry *entry = _add_entry(writer, parent, name, name_len);
+    if (!entry) return NULL;
+    dir->first = NULL;
+    dir->last = NULL;
+    dir->name = entry->name;
+    dir->name_len = entry->name_len;
+    dir->is_leaf = 0;
+    entry->dir = dir;
+    return dir;
+}
+
+int path_store_add_file(ps_writer *writer, ps_dir *parent, const char *name, size_t name_len) {
+    if (!_add_entry(writer, parent, name, name_len)) return EXIT_FAILURE;
+    writer->count++;
+    return EXIT_SUCCESS;
+}
+
+void path_store_set_leaf(ps_writer *writer, ps_dir *dir) {
+    if (dir->is_leaf) return;
+    dir->is_leaf = 1;
+    writer->count++;
+}
+
+const char *path_store_dir_name(const ps_dir *dir, size_t *name_len_p) {
+    if (name_len_p) *name_len_p = dir->name_len;
+    return dir->name;
+}
+
+uint32_t path_store_count(const path_store *store) {
+    uint32_t count = 0;
+    for (const ps_writer *writer = store->writers; writer; writer = writer->next) {
+        count += writer->count;
+    }
+    return count;
+}
+
+static int _ensure_path_cap(path_iter *iter, size_t len) {
+    if (len <= iter->path_cap) return EXIT_SUCCESS;
+    size_t new_cap = iter->path_cap * 2;
+    if (new_cap < len) new_cap = len;
+    char *new_path = (char *)realloc(iter->path, new_cap);
+    if (!new_path) return EXIT_FAILURE;
+    iter->path = new_path;
+    iter->path_cap = new_cap;
+    return EXIT_SUCCESS;
+}
+
+static int _push_frame(path_iter *iter, const ps_dir *dir, size_t prefix_len) {
+    if (iter->depth >= iter->frame_cap) {
+        size_t new_cap = iter->frame_cap * 2;
+        iter_frame *new_frames = (iter_frame *)realloc(iter->frames, sizeof(iter_frame) * new_cap);
+        if (!new_frames) return EXIT_FAILURE;
+        iter->frames = new_frames;
+        iter->frame_cap = new_cap;
+    }
+    iter_frame *frame = iter->frames + iter->depth;
+    frame->next = dir->first;
+    frame->prefix_len = prefix_len;
+    frame->is_leaf = dir->is_leaf;
+    iter->depth++;
+    return EXIT_SUCCESS;
+}
+
+path_iter *path_store_iter(const path_store *store) {
+    path_iter *iter = (path_iter *)calloc(1, sizeof(path_iter));
+    if (!iter) return NULL;
+    iter->frame_cap = 32;
+    iter->frames = (iter_frame *)malloc(sizeof(iter_frame) * iter->frame_cap);
+    iter->path_cap = 512;
+    iter->path = (char *)malloc(iter->path_cap);
+    if (!iter->frames || !iter->path) {
+        free_path_iter(iter);
+        return NULL;
+    }
+    iter->path[0] = '\0';
+    (void)_push_frame(iter, &(store->root), 0);
+    iter->frames[0].is_leaf = 0;
+    return iter;
+}
+
+const char *path_iter_next(path_iter *iter, size_t *len_p) {
+    while (iter->depth > 0) {
+        iter_frame *frame = iter->frames + iter->depth - 1;
+        const ps_entry *entry = frame->next;
+        if (!entry) {
+            iter->depth--;
+            if (frame->is_leaf) {
+                iter->path[frame->prefix_len] = '\0';
+                if (len_p) *len_p = frame->prefix_len;
+                return iter->path;
+            }
+            continue;
+        }
+        frame->next = entry->next;
+        const size_t prefix_len = frame->prefix_len;
+        const size_t path_len = prefix_len + entry->name_len;
+        if (_ensure_path_cap(iter, path_len + 2) != EXIT_SUCCESS) return NULL;  // +2 for PATH_SEP and null terminator
+        memcpy(iter->path + prefix_len, entry->name, entry->name_len);
+        if (!entry->dir) {
+            iter->path[path_len] = '\0';
+            if (len_p) *len_p = path_len;
+            return iter->path;
+        }
+        size_t child_prefix_len = path_len;
+        if (entry->name[entry->name_len - 1] != PATH_SEP) iter->path[child_prefix_len++] = PATH_SEP;
+        if (_push_frame(iter, entry->dir, child_prefix_len) != EXIT_SUCCESS) return NULL;
+    }
+    return NULL;
+}
+
+void free_path_iter(path_iter *iter) {
+    if (iter->frames) free(iter->frames);
+    if (iter->path) free(iter->path);
+    free(iter);
+}
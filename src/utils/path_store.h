@@ -0,0 +1,126 @@
+/*
+ * utils/path_store.h - header for compact store of file paths
+ * Copyright (C) 2026 H. Thevindu J. Wijesekera
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef UTILS_PATH_STORE_H_
+#define UTILS_PATH_STORE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * A tree of directories and files.
+ * Each name is stored once in the directory containing it, so the common prefixes of paths are not duplicated.
+ * The names are allocated from arenas and freed all at once with the store.
+ */
+typedef struct _path_store path_store;
+
+/*
+ * A directory in the path store.
+ */
+typedef struct _ps_dir ps_dir;
+
+/*
+ * Allocates the memory for adding entries to the path store.
+ * Each thread adding entries to the same path store must use a separate writer.
+ */
+typedef struct _ps_writer ps_writer;
+
+/*
+ * Iterates over the paths in a path store.
+ */
+typedef struct _path_iter path_iter;
+
+/*
+ * Creates an empty path store.
+ * returns the path store on success or NULL on failure.
+ */
+extern path_store *new_path_store(void);
+
+/*
+ * Frees the path store and all its directories, names, and writers.
+ */
+extern void free_path_store(path_store *store);
+
+/*
+ * Creates a writer for the path store.
+ * This function is not thread-safe. Create the writers before starting the threads which use them.
+ * returns the writer on success or NULL on failure.
+ */
+extern ps_writer *path_store_writer(path_store *store);
+
+/*
+ * Removes the writer from the path store and frees it. The writer must not have added any entries.
+ * This function is not thread-safe.
+ */
+extern void free_path_store_writer(path_store *store, ps_writer *writer);
+
+/*
+ * Get the top level directory of the path store.
+ * Names of the entries in the top level directory are the paths given by the user, which are not joined to any prefix.
+ */
+extern ps_dir *path_store_root(path_store *store);
+
+/*
+ * Appends a sub-directory to the directory parent.
+ * Only one writer may add entries to the same directory at a time.
+ * returns the new directory on success or NULL on failure.
+ */
+extern ps_dir *path_store_add_dir(ps_writer *writer, ps_dir *parent, const char *name, size_t name_len);
+
+/*
+ * Appends a file to the directory parent.
+ * Only one writer may add entries to the same directory at a time.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+extern int path_store_add_file(ps_writer *writer, ps_dir *parent, const char *name, size_t name_len);
+
+/*
+ * Marks the directory as a leaf directory. A leaf directory path is listed with a trailing PATH_SEP after the paths
+ * of its entries.
+ */
+extern void path_store_set_leaf(ps_writer *writer, ps_dir *dir);
+
+/*
+ * Get the name of the directory, which is stored in its parent directory.
+ */
+extern const char *path_store_dir_name(const ps_dir *dir, size_t *name_len_p);
+
+/*
+ * Get the number of paths listed by iterating the path store, which is the number of files and leaf directories.
+ * Must not be called while adding entries.
+ */
+extern uint32_t path_store_count(const path_store *store);
+
+/*
+ * Creates an iterator for the path store.
+ * The paths are listed in the depth-first order, in the order which the entries were added to each directory.
+ * returns the iterator on success or NULL on failure.
+ */
+extern path_iter *path_store_iter(const path_store *store);
+
+/*
+ * Get the next path from the iterator.
+ * The returned path is valid only until the next call to path_iter_next() or free_path_iter(), and must not be freed.
+ * Sets the length of the path in len_p if it is not NULL.
+ * returns NULL if there are no more paths or on failure.
+ */
+extern const char *path_iter_next(path_iter *iter, size_t *len_p);
+
+extern void free_path_iter(path_iter *iter);
+
+#endif  // UTILS_PATH_STORE_H_
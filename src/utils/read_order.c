@@ -0,0 +1,152 @@
+/*
+ * utils/read_order.c - ordering files by their location on the storage
+ * Copyright (C) 2026 H. Thevindu J. Wijesekera
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#if defined(__linux__) || defined(__APPLE__)
+
+#define _FILE_OFFSET_BITS 64
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utils/read_order.h>
+#include <utils/utils.h>
+#ifdef __linux__
+#include <linux/fiemap.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#endif
+
+typedef struct _path_key {
+    uint64_t dev;
+    uint64_t ino;
+    uint64_t offset;  // physical location of the first extent
+    uint32_t index;   // position in the path store
+    char *path;
+} path_key;
+
+/*
+ * Get the physical location of the first extent of the open file fd on its device.
+ * Sets offset_p to 0 if the file has no extents.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE if the location is not available.
+ */
+static int _first_extent(int fd, const struct stat *statbuf, uint64_t *offset_p) {
+    *offset_p = 0;
+    if (statbuf->st_size == 0) return EXIT_SUCCESS;
+#ifdef __linux__
+    struct {
+        struct fiemap map;
+        struct fiemap_extent extent;
+    } req;
+    memset(&req, 0, sizeof(req));
+    req.map.fm_length = FIEMAP_MAX_OFFSET;
+    req.map.fm_extent_count = 1;
+    if (ioctl(fd, FS_IOC_FIEMAP, &req.map)) return EXIT_FAILURE;
+    if (req.map.fm_mapped_extents > 0) *offset_p = req.extent.fe_physical;
+    return EXIT_SUCCESS;
+#elif defined(__APPLE__)
+    struct log2phys l2p;
+    memset(&l2p, 0, sizeof(l2p));
+    if (fcntl(fd, F_LOG2PHYS, &l2p) == -1 || l2p.l2p_devoffset < 0) return EXIT_FAILURE;
+    *offset_p = (uint64_t)l2p.l2p_devoffset;
+    return EXIT_SUCCESS;
+#endif
+}
+
+/*
+ * Fill the location of the file at key->path in key.
+ * Sets *use_extents_p to 0 if the physical location is not supported.
+ */
+static void _get_location(path_key *key, int *use_extents_p) {
+    struct stat statbuf;
+    if (!*use_extents_p) {
+        if (stat(key->path, &statbuf)) return;
+        key->dev = (uint64_t)statbuf.st_dev;
+        key->ino = (uint64_t)statbuf.st_ino;
+        return;
+    }
+    int fd = open(key->path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return;
+    if (fstat(fd, &statbuf) == 0) {
+        key->dev = (uint64_t)statbuf.st_dev;
+        key->ino = (uint64_t)statbuf.st_ino;
+        if (_first_extent(fd, &statbuf, &(key->offset)) != EXIT_SUCCESS) *use_extents_p = 0;
+    }
+    close(fd);
+}
+
+static int _cmp_offset(const void *a, const void *b) {
+    const path_key *key1 = (const path_key *)a;
+    const path_key *key2 = (const path_key *)b;
+    if (key1->dev != key2->dev) return key1->dev < key2->dev ? -1 : 1;
+    if (key1->offset != key2->offset) return key1->offset < key2->offset ? -1 : 1;
+    if (key1->ino != key2->ino) return key1->ino < key2->ino ? -1 : 1;
+    return key1->index < key2->index ? -1 : (key1->index > key2->index);
+}
+
+static int _cmp_inode(const void *a, const void *b) {
+    const path_key *key1 = (const path_key *)a;
+    const path_key *key2 = (const path_key *)b;
+    if (key1->dev != key2->dev) return key1->dev < key2->dev ? -1 : 1;
+    if (key1->ino != key2->ino) return key1->ino < key2->ino ? -1 : 1;
+    return key1->index < key2->index ? -1 : (key1->index > key2->index);
+}
+
+list2 *sort_paths_for_reading(const path_store *store, int use_extents, arena *mem) {
+    const uint32_t cnt = path_store_count(store);
+    list2 *paths = init_list_arena(mem, cnt ? cnt : 1);
+    path_key *keys = (path_key *)malloc(sizeof(path_key) * (cnt ? cnt : 1));
+    path_iter *iter = path_store_iter(store);
+    if (!paths || !keys || !iter) {
+        if (keys) free(keys);
+        if (iter) free_path_iter(iter);
+        return NULL;
+    }
+
+    uint32_t file_cnt = 0;
+    for (uint32_t i = 0; i < cnt; i++) {
+        size_t len;
+        const char *path = path_iter_next(iter, &len);
+        char *copy = path ? arena_strndup(mem, path, len) : NULL;
+        if (!copy) {
+            free(keys);
+            free_path_iter(iter);
+            return NULL;
+        }
+        if (len > 0 && copy[len - 1] == PATH_SEP) {
+            append(paths, copy);  // leaf directories have no data to read
+            continue;
+        }
+        path_key *key = keys + file_cnt++;
+        memset(key, 0, sizeof(path_key));
+        key->index = i;
+        key->path = copy;
+    }
+    free_path_iter(iter);
+
+    for (uint32_t i = 0; i < file_cnt; i++) _get_location(keys + i, &use_extents);
+    // locations are not comparable unless all the files have them
+    qsort(keys, file_cnt, sizeof(path_key), use_extents ? _cmp_offset : _cmp_inode);
+    for (uint32_t i = 0; i < file_cnt; i++) append(paths, keys[i].path);
+    free(keys);
+    return paths;
+}
+
+#endif
@@ -0,0 +1,40 @@
+/*
+ * utils/read_order.h - header for ordering files by their location on the storage
+ * Copyright (C) 2026 H. Thevindu J. Wijesekera
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef UTILS_READ_ORDER_H_
+#define UTILS_READ_ORDER_H_
+
+#if defined(__linux__) || defined(__APPLE__)
+
+#include <utils/arena.h>
+#include <utils/list_utils.h>
+#include <utils/path_store.h>
+
+/*
+ * Get the paths of the path store sorted to read the files with less seeking.
+ * Leaf directory paths come first, in the order of the path store. Files are grouped by their device and sorted by the
+ * inode number, or by the physical location of their first extent if use_extents is not 0. Files are sorted by the
+ * inode number if the physical location is not available for any file.
+ * The list and the paths are allocated from the arena mem.
+ * returns the list of paths on success or NULL on failure.
+ */
+extern list2 *sort_paths_for_reading(const path_store *store, int use_extents, arena *mem);
+
+#endif
+
+#endif  // UTILS_READ_ORDER_H_
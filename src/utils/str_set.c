@@ -0,0 +1,117 @@
+/*
+ * utils/str_set.c - hash set of strings
+ * Copyright (C) 2026 H. Thevindu J. Wijesekera
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <utils/arena.h>
+#include <utils/str_set.h>
+
+#define INITIAL_CAPACITY 64  // must be a power of 2
+
+typedef struct _set_entry {
+    uint64_t hash;
+    const char *str;  // NULL if the slot is empty
+    size_t len;
+} set_entry;
+
+struct _str_set {
+    arena *mem;
+    set_entry *table;
+    size_t capacity;
+    size_t count;
+};
+
+static inline uint64_t _hash(const char *str, size_t len) {
+    uint64_t hash = 0xCBF29CE484222325ULL;  // FNV-1a
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (unsigned char)str[i];
+        hash *= 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+static const set_entry *_find(const str_set *set, const char *str, size_t len, uint64_t hash) {
+    const size_t mask = set->capacity - 1;
+    for (size_t i = (size_t)hash & mask;; i = (i + 1) & mask) {
+        const set_entry *entry = set->table + i;
+        if (!entry->str) return NULL;
+        if (entry->hash == hash && entry->len == len && !memcmp(entry->str, str, len)) return entry;
+    }
+}
+
+static int _grow(str_set *set) {
+    const size_t new_cap = set->capacity * 2;
+    set_entry *new_table = (set_entry *)calloc(new_cap, sizeof(set_entry));
+    if (!new_table) return EXIT_FAILURE;
+    for (size_t i = 0; i < set->capacity; i++) {
+        const set_entry *entry = set->table + i;
+        if (!entry->str) continue;
+        size_t j = (size_t)entry->hash & (new_cap - 1);
+        while (new_table[j].str) j = (j + 1) & (new_cap - 1);
+        new_table[j] = *entry;
+    }
+    free(set->table);
+    set->table = new_table;
+    set->capacity = new_cap;
+    return EXIT_SUCCESS;
+}
+
+str_set *new_str_set(void) {
+    str_set *set = (str_set *)calloc(1, sizeof(str_set));
+    if (!set) return NULL;
+    set->mem = new_arena(0);
+    set->table = (set_entry *)calloc(INITIAL_CAPACITY, sizeof(set_entry));
+    if (!set->mem || !set->table) {
+        if (set->mem) free_arena(set->mem);
+        if (set->table) free(set->table);
+        free(set);
+        return NULL;
+    }
+    set->capacity = INITIAL_CAPACITY;
+    return set;
+}
+
+void free_str_set(str_set *set) {
+    free(set->table);
+    free_arena(set->mem);
+    free(set);
+}
+
+int str_set_contains(const str_set *set, const char *str, size_t len) {
+    return _find(set, str, len, _hash(str, len)) != NULL;
+}
+
+const char *str_set_add(str_set *set, const char *str, size_t len) {
+    const uint64_t hash = _hash(str, len);
+    const set_entry *existing = _find(set, str, len, hash);
+    if (existing) return existing->str;
+    if ((set->count + 1) * 2 > set->capacity && _grow(set) != EXIT_SUCCESS) return NULL;
+    const size_t mask = set->capacity - 1;
+    size_t i = (size_t)hash & mask;
+    while (set->table[i].str) i = (i + 1) & mask;
+    char *copy = (char *)arena_alloc(set->mem, len + 1);
+    if (!copy) return NULL;
+    memcpy(copy, str, len);
+    copy[len] = '\0';
+    set->table[i].hash = hash;
+    set->table[i].str = copy;
+    set->table[i].len = len;
+    set->count++;
+    return copy;
+}
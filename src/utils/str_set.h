@@ -0,0 +1,54 @@
+/*
+ * utils/str_set.h - header for hash set of strings
+ * Copyright (C) 2026 H. Thevindu J. Wijesekera
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef UTILS_STR_SET_H_
+#define UTILS_STR_SET_H_
+
+#include <stddef.h>
+
+/*
+ * Hash set of strings.
+ * The strings are copied to an arena owned by the set and freed all at once with the set.
+ * A set is not thread-safe.
+ */
+typedef struct _str_set str_set;
+
+/*
+ * Creates an empty set.
+ * returns the set on success or NULL on failure.
+ */
+extern str_set *new_str_set(void);
+
+/*
+ * Frees the set and all the strings in it.
+ */
+extern void free_str_set(str_set *set);
+
+/*
+ * Check if the first len bytes of str are in the set.
+ * returns 1 if found. Otherwise, returns 0.
+ */
+extern int str_set_contains(const str_set *set, const char *str, size_t len);
+
+/*
+ * Adds a copy of the first len bytes of str to the set if it is not already there.
+ * returns the null terminated copy stored in the set on success or NULL on failure.
+ */
+extern const char *str_set_add(str_set *set, const char *str, size_t len);
+
+#endif  // UTILS_STR_SET_H_
@@ -0,0 +1,412 @@
+/*
+ * utils/tar_archive.c - streaming tar archive writer and reader
+ * Copyright (C) 2026 H. Thevindu J. Wijesekera
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _FILE_OFFSET_BITS 64
+
+#define __STDC_FORMAT_MACROS
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <utils/file_io.h>
+#include <utils/tar_archive.h>
+#include <utils/utils.h>
+
+#define BLOCK_SZ 512
+#define MAX_NAME_LENGTH 4096
+#define MAX_OCTAL_SIZE 077777777777LL  // largest size in the 12 byte size field
+#define MAX_EXT_HEADER_SZ 65536L        // pax extended headers and GNU long names
+#define READ_BUF_SZ 1048576L            // 1 MiB
+#define STDIO_BUF_SZ 65536L             // 64 KiB
+
+// offsets of the fields in a ustar header
+#define OFF_NAME 0
+#define OFF_MODE 100
+#define OFF_UID 108
+#define OFF_GID 116
+#define OFF_SIZE 124
+#define OFF_MTIME 136
+#define OFF_CHKSUM 148
+#define OFF_TYPE 156
+#define OFF_MAGIC 257
+#define OFF_VERSION 263
+#define OFF_PREFIX 345
+
+#define TYPE_FILE '0'
+#define TYPE_CONTIGUOUS '7'
+#define TYPE_DIR '5'
+#define TYPE_PAX 'x'
+#define TYPE_PAX_GLOBAL 'g'
+#define TYPE_GNU_LONG_NAME 'L'
+
+struct _tar_writer {
+    file_writer *writer;
+    int64_t remaining;  // data remaining in the current entry
+    size_t padding;     // zeros after the data of the current entry
+    int64_t mtime;
+};
+
+struct _tar_reader {
+    FILE *file;
+    int64_t remaining;  // data remaining in the current entry
+    int64_t padding;    // bytes after the data of the current entry
+    char *buf;
+    char *name;  // name of the current entry
+    size_t name_cap;
+    char *long_name;  // name from an extended header for the next entry, or NULL
+    int64_t long_size;  // size from an extended header for the next entry, or -1
+};
+
+static inline size_t _padding(int64_t size) { return (size_t)((BLOCK_SZ - size % BLOCK_SZ) % BLOCK_SZ); }
+
+static uint32_t _checksum(const unsigned char *header) {
+    uint32_t sum = 0;
+    for (int i = 0; i < BLOCK_SZ; i++) {
+        sum += (i >= OFF_CHKSUM && i < OFF_CHKSUM + 8) ? ' ' : header[i];
+    }
+    return sum;
+}
+
+static int _write_bytes(tar_writer *tar, const char *data, size_t len) {
+    while (len > 0) {
+        size_t buf_len;
+        char *buf = file_writer_buf(tar->writer, &buf_len);
+        if (buf_len > len) buf_len = len;
+        if (data) {
+            memcpy(buf, data, buf_len);
+            data += buf_len;
+        } else {
+            memset(buf, 0, buf_len);
+        }
+        if (file_writer_commit(tar->writer, buf_len) != EXIT_SUCCESS) return EXIT_FAILURE;
+        len -= buf_len;
+    }
+    return EXIT_SUCCESS;
+}
+
+static void _set_octal(char *field, size_t field_sz, uint64_t value) {
+    // the field is zero filled with a null terminator
+    snprintf(field, field_sz, "%0*" PRIo64, (int)field_sz - 1, value);
+}
+
+/*
+ * Find where to split the name into the prefix and name fields of a ustar header.
+ * returns 0 if the name fits in the name field, the position of the / to split at, or SIZE_MAX if the name does not fit
+ * in the header.
+ */
+static size_t _ustar_split(const char *name, size_t name_len) {
+    if (name_len <= 100) return 0;
+    if (name_len > 256) return SIZE_MAX;
+    for (size_t i = name_len - 101; i + 1 < name_len && i <= 155; i++) {
+        if (name[i] == '/' && i > 0) return i;
+    }
+    return SIZE_MAX;
+}
+
+static int _write_header(tar_writer *tar, const char *name, size_t name_len, int64_t size, char type) {
+    char header[BLOCK_SZ];
+    memset(header, 0, BLOCK_SZ);
+    size_t split = _ustar_split(name, name_len);
+    if (split == SIZE_MAX) {
+        memcpy(header + OFF_NAME, name, 100);  // the full name is in the extended header
+    } else if (split) {
+        memcpy(header + OFF_PREFIX, name, split);
+        memcpy(header + OFF_NAME, name + split + 1, name_len - split - 1);
+    } else {
+        memcpy(header + OFF_NAME, name, name_len);
+    }
+    _set_octal(header + OFF_MODE, 8, type == TYPE_DIR ? 0755 : 0644);
+    _set_octal(header + OFF_UID, 8, 0);
+    _set_octal(header + OFF_GID, 8, 0);
+    _set_octal(header + OFF_SIZE, 12, size <= MAX_OCTAL_SIZE ? (uint64_t)size : 0);
+    _set_octal(header + OFF_MTIME, 12, (uint64_t)tar->mtime);
+    header[OFF_TYPE] = type;
+    memcpy(header + OFF_MAGIC, "ustar", 6);
+    memcpy(header + OFF_VERSION, "00", 2);
+    snprintf(header + OFF_CHKSUM, 8, "%06" PRIo32, _checksum((unsigned char *)header));
+    header[OFF_CHKSUM + 7] = ' ';
+    return _write_bytes(tar, header, BLOCK_SZ);
+}
+
+/*
+ * Appends a pax record "<len> <key>=<value>\n" to buf and returns its length.
+ */
+static size_t _pax_record(char *buf, const char *key, const char *value, size_t value_len) {
+    const size_t len = strlen(key) + value_len + 3;  // for space, =, and \n
+    // the length of the record includes its own digits
+    size_t digits = 1;
+    char len_str[24];
+    while ((size_t)snprintf(len_str, sizeof(len_str), "%zu", len + digits) != digits) digits++;
+    int prefix_len = sprintf(buf, "%zu %s=", len + digits, key);
+    memcpy(buf + prefix_len, value, value_len);
+    buf[len + digits - 1] = '\n';
+    return len + digits;
+}
+
+tar_writer *open_tar_writer(const char *path, int mode) {
+    tar_writer *tar = (tar_writer *)calloc(1, sizeof(tar_writer));
+    if (!tar) return NULL;
+    // the size of the archive is not known in advance
+    tar->writer = open_file_writer(path, 0, mode);
+    if (!tar->writer) {
+        free(tar);
+        return NULL;
+    }
+    tar->mtime = (int64_t)time(NULL);
+    if (tar->mtime < 0) tar->mtime = 0;
+    return tar;
+}
+
+int tar_add_entry(tar_writer *tar, const char *name, size_t name_len, int64_t size) {
+    if (tar->remaining || name_len == 0 || name_len > MAX_NAME_LENGTH || name[0] == '/' || size < -1) {
+        return EXIT_FAILURE;
+    }
+    if (_write_bytes(tar, NULL, tar->padding) != EXIT_SUCCESS) return EXIT_FAILURE;
+    tar->padding = 0;
+
+    char type = size < 0 ? TYPE_DIR : TYPE_FILE;
+    if (type == TYPE_DIR) size = 0;
+    char full_name[name_len + 2];
+    memcpy(full_name, name, name_len);
+    if (type == TYPE_DIR) full_name[name_len++] = '/';
+    full_name[name_len] = '\0';
+
+    const int long_name = _ustar_split(full_name, name_len) == SIZE_MAX;
+    if (long_name || size > MAX_OCTAL_SIZE) {
+        char records[name_len + 64];
+        size_t records_len = 0;
+        if (long_name) {
+            records_len += _pax_record(records, "path", full_name, name_len);
+        }
+        if (size > MAX_OCTAL_SIZE) {
+            char size_str[24];
+            int size_len = snprintf(size_str, sizeof(size_str), "%" PRIi64, size);
+            records_len += _pax_record(records + records_len, "size", size_str, (size_t)size_len);
+        }
+        if (_write_header(tar, "PaxHeader", 9, (int64_t)records_len, TYPE_PAX) != EXIT_SUCCESS ||
+            _write_bytes(tar, records, records_len) != EXIT_SUCCESS ||
+            _write_bytes(tar, NULL, _padding((int64_t)records_len)) != EXIT_SUCCESS) {
+            return EXIT_FAILURE;
+        }
+    }
+    if (_write_header(tar, full_name, name_len, size, type) != EXIT_SUCCESS) return EXIT_FAILURE;
+    tar->remaining = size;
+    tar->padding = _padding(size);
+    return EXIT_SUCCESS;
+}
+
+char *tar_writer_buf(tar_writer *tar, size_t *len_p) {
+    char *buf = file_writer_buf(tar->writer, len_p);
+    if ((uint64_t)tar->remaining < *len_p) *len_p = (size_t)tar->remaining;
+    return buf;
+}
+
+int tar_writer_commit(tar_writer *tar, size_t len) {
+    if ((uint64_t)len > (uint64_t)tar->remaining) return EXIT_FAILURE;
+    if (file_writer_commit(tar->writer, len) != EXIT_SUCCESS) return EXIT_FAILURE;
+    tar->remaining -= (int64_t)len;
+    return EXIT_SUCCESS;
+}
+
+int close_tar_writer(tar_writer *tar) {
+    int status = EXIT_SUCCESS;
+    // an archive ends with two zero blocks
+    if (tar->remaining || _write_bytes(tar, NULL, tar->padding + 2 * BLOCK_SZ) != EXIT_SUCCESS) status = EXIT_FAILURE;
+    if (close_file_writer(tar->writer) != EXIT_SUCCESS) status = EXIT_FAILURE;
+    free(tar);
+    return status;
+}
+
+tar_reader *open_tar_reader(const char *path) {
+    tar_reader *tar = (tar_reader *)calloc(1, sizeof(tar_reader));
+    if (!tar) return NULL;
+    tar->file = open_file(path, "rb");
+    tar->buf = (char *)malloc(READ_BUF_SZ);
+    if (!tar->file || !tar->buf) {
+        close_tar_reader(tar);
+        return NULL;
+    }
+    // headers of small entries are read through the stdio buffer
+    setvbuf(tar->file, NULL, _IOFBF, STDIO_BUF_SZ);
+    tar->long_size = -1;
+    return tar;
+}
+
+void close_tar_reader(tar_reader *tar) {
+    if (tar->file) fclose(tar->file);
+    if (tar->buf) free(tar->buf);
+    if (tar->name) free(tar->name);
+    if (tar->long_name) free(tar->long_name);
+    free(tar);
+}
+
+static int _skip(tar_reader *tar, int64_t len) {
+    if (len > STDIO_BUF_SZ) return fseeko(tar->file, (off_t)len, SEEK_CUR) ? EXIT_FAILURE : EXIT_SUCCESS;
+    // seeking would drop the buffered data of the following entries
+    if (len > 0 && fread(tar->buf, 1, (size_t)len, tar->file) != (size_t)len) return EXIT_FAILURE;
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Parse a numeric header field, which is octal or GNU base-256.
+ * returns the value or -1 on failure.
+ */
+static int64_t _parse_number(const char *field, size_t field_sz) {
+    const unsigned char *bytes = (const unsigned char *)field;
+    int64_t value = 0;
+    if (bytes[0] & 0x80) {
+        if (bytes[0] != 0x80) return -1;  // negative or too large
+        for (size_t i = 1; i < field_sz; i++) {
+            if (value > (INT64_MAX >> 8)) return -1;
+            value = (value << 8) | bytes[i];
+        }
+        return value;
+    }
+    size_t i = 0;
+    while (i < field_sz && field[i] == ' ') i++;
+    for (; i < field_sz && field[i] >= '0' && field[i] <= '7'; i++) {
+        if (value > (INT64_MAX >> 3)) return -1;
+        value = (value << 3) | (field[i] - '0');
+    }
+    return value;
+}
+
+static int _set_name(tar_reader *tar, const char *name, size_t len) {
+    if (len + 1 > tar->name_cap) {
+        char *new_name = (char *)realloc(tar->name, len + 1);
+        if (!new_name) return EXIT_FAILURE;
+        tar->name = new_name;
+        tar->name_cap = len + 1;
+    }
+    memcpy(tar->name, name, len);
+    tar->name[len] = '\0';
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Read the data of an extended header entry into the buffer as a null terminated string.
+ */
+static char *_read_ext_data(tar_reader *tar, int64_t size) {
+    if (size < 0 || size > MAX_EXT_HEADER_SZ) return NULL;
+    // the padding is read together with the data to keep the data in the buffer
+    const size_t len = (size_t)size + _padding(size);
+    if (fread(tar->buf, 1, len, tar->file) != len) return NULL;
+    tar->buf[size] = '\0';
+    return tar->buf;
+}
+
+static int _parse_pax(tar_reader *tar, const char *data, size_t size) {
+    size_t pos = 0;
+    while (pos < size) {
+        char *end;
+        unsigned long long rec_len = strtoull(data + pos, &end, 10);
+        if (end == data + pos || *end != ' ' || rec_len > size - pos || rec_len < 5) return EXIT_FAILURE;
+        const char *key = end + 1;
+        const char *rec_end = data + pos + rec_len - 1;  // the \n
+        const char *eq = memchr(key, '=', (size_t)(rec_end - key));
+        if (!eq || *rec_end != '\n') return EXIT_FAILURE;
+        const char *value = eq + 1;
+        size_t value_len = (size_t)(rec_end - value);
+        if ((size_t)(eq - key) == 4 && !memcmp(key, "path", 4)) {
+            if (tar->long_name) free(tar->long_name);
+            tar->long_name = strndup(value, value_len);
+            if (!tar->long_name) return EXIT_FAILURE;
+        } else if ((size_t)(eq - key) == 4 && !memcmp(key, "size", 4)) {
+            tar->long_size = strtoll(value, NULL, 10);
+            if (tar->long_size < 0) return EXIT_FAILURE;
+        }
+        pos += (size_t)rec_len;
+    }
+    return EXIT_SUCCESS;
+}
+
+int tar_reader_next(tar_reader *tar, const char **name_p, int64_t *size_p) {
+    while (1) {
+        if (_skip(tar, tar->remaining + tar->padding) != EXIT_SUCCESS) return -1;
+        tar->remaining = 0;
+        tar->padding = 0;
+
+        unsigned char header[BLOCK_SZ];
+        size_t read_len = fread(header, 1, BLOCK_SZ, tar->file);
+        if (read_len == 0 && feof(tar->file)) return 0;  // archive without the end blocks
+        if (read_len != BLOCK_SZ) return -1;
+        if (header[0] == 0) return 0;  // end of the archive
+        if (_parse_number((char *)header + OFF_CHKSUM, 8) != (int64_t)_checksum(header)) return -1;
+
+        int64_t size = tar->long_size >= 0 ? tar->long_size : _parse_number((char *)header + OFF_SIZE, 12);
+        if (size < 0) return -1;
+        const char type = (char)header[OFF_TYPE];
+        if (type == TYPE_PAX || type == TYPE_PAX_GLOBAL || type == TYPE_GNU_LONG_NAME) {
+            char *data = _read_ext_data(tar, size);
+            if (!data) return -1;
+            if (type == TYPE_PAX && _parse_pax(tar, data, (size_t)size) != EXIT_SUCCESS) return -1;
+            if (type == TYPE_GNU_LONG_NAME) {
+                if (tar->long_name) free(tar->long_name);
+                tar->long_name = strndup(data, (size_t)size);
+                if (!tar->long_name) return -1;
+            }
+            continue;
+        }
+
+        int status;
+        if (tar->long_name) {
+            status = _set_name(tar, tar->long_name, strlen(tar->long_name));
+            free(tar->long_name);
+            tar->long_name = NULL;
+        } else {
+            char name[257];
+            size_t len = 0;
+            if (!memcmp(header + OFF_MAGIC, "ustar", 5) && header[OFF_PREFIX]) {
+                len = strnlen((char *)header + OFF_PREFIX, 155);
+                memcpy(name, header + OFF_PREFIX, len);
+                name[len++] = '/';
+            }
+            size_t name_len = strnlen((char *)header + OFF_NAME, 100);
+            memcpy(name + len, header + OFF_NAME, name_len);
+            status = _set_name(tar, name, len + name_len);
+        }
+        tar->long_size = -1;
+        if (status != EXIT_SUCCESS) return -1;
+
+        const int is_dir = type == TYPE_DIR;
+        const int is_file = type == TYPE_FILE || type == '\0' || type == TYPE_CONTIGUOUS;
+        tar->remaining = is_dir ? 0 : size;
+        tar->padding = (int64_t)_padding(tar->remaining);
+        if (!is_dir && !is_file) continue;  // links and special files are skipped
+
+        char *name = tar->name;
+        while (name[0] == '/' || (name[0] == '.' && name[1] == '/')) name += name[0] == '/' ? 1 : 2;
+        size_t name_len = strlen(name);
+        while (name_len > 0 && name[name_len - 1] == '/') name[--name_len] = '\0';
+        if (name_len == 0 || (name_len == 1 && name[0] == '.')) continue;  // the top level directory
+        *name_p = name;
+        *size_p = is_dir ? -1 : size;
+        return 1;
+    }
+}
+
+const char *tar_reader_read(tar_reader *tar, size_t *len_p) {
+    if (tar->remaining <= 0) return NULL;
+    size_t len = (uint64_t)tar->remaining < READ_BUF_SZ ? (size_t)tar->remaining : READ_BUF_SZ;
+    len = fread(tar->buf, 1, len, tar->file);
+    if (len == 0) return NULL;
+    tar->remaining -= (int64_t)len;
+    *len_p = len;
+    return tar->buf;
+}
@@ -0,0 +1,97 @@
+/*
+ * utils/tar_archive.h - header for streaming tar archive writer and reader
+ * Copyright (C) 2026 H. Thevindu J. Wijesekera
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef UTILS_TAR_ARCHIVE_H_
+#define UTILS_TAR_ARCHIVE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Writes regular files and directories to a POSIX (pax) tar archive, one entry after the other.
+ * The data of the entries is written through a file_writer without copying.
+ */
+typedef struct _tar_writer tar_writer;
+
+/*
+ * Reads the regular files and directories of a tar archive, one entry after the other.
+ * Entries of other types are skipped.
+ */
+typedef struct _tar_reader tar_reader;
+
+/*
+ * Creates or truncates the archive file at path.
+ * mode is passed to open_file_writer().
+ * returns the writer on success or NULL on failure.
+ */
+extern tar_writer *open_tar_writer(const char *path, int mode);
+
+/*
+ * Starts a new entry in the archive after completing the previous entry.
+ * name is the path of the entry with / as the path separator, which must not start with /.
+ * size is the size of the regular file, or -1 for a directory.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure or if the data of the previous entry is incomplete.
+ */
+extern int tar_add_entry(tar_writer *tar, const char *name, size_t name_len, int64_t size);
+
+/*
+ * Get the free space for the data of the current entry.
+ * Sets len_p to the length of the free space, which is never more than the remaining data of the entry.
+ * Must be called only while the entry has remaining data.
+ */
+extern char *tar_writer_buf(tar_writer *tar, size_t *len_p);
+
+/*
+ * Adds the first len bytes of the free space as data of the current entry.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+extern int tar_writer_commit(tar_writer *tar, size_t len);
+
+/*
+ * Writes the end of the archive, closes the file, and frees the writer.
+ * The end of the archive is not written if the data of the last entry is incomplete.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure or if the archive is incomplete.
+ */
+extern int close_tar_writer(tar_writer *tar);
+
+/*
+ * Opens the tar archive at path for reading.
+ * returns the reader on success or NULL on failure.
+ */
+extern tar_reader *open_tar_reader(const char *path);
+
+/*
+ * Moves to the next regular file or directory in the archive, skipping the rest of the current entry.
+ * Sets name_p to the path of the entry without a trailing / and leading ./ or /. The name is valid only until the
+ * next call to tar_reader_next() or close_tar_reader().
+ * Sets size_p to the size of the regular file, or -1 for a directory.
+ * returns 1 if an entry is found, 0 at the end of the archive, or -1 on failure.
+ */
+extern int tar_reader_next(tar_reader *tar, const char **name_p, int64_t *size_p);
+
+/*
+ * Reads the next part of the data of the current entry.
+ * The returned data is valid only until the next call to any function of the reader.
+ * Sets len_p to the length of the data.
+ * returns NULL at the end of the entry or on failure.
+ */
+extern const char *tar_reader_read(tar_reader *tar, size_t *len_p);
+
+extern void close_tar_reader(tar_reader *tar);
+
+#endif  // UTILS_TAR_ARCHIVE_H_
@@ -27,4 +27,9 @@
 #pragma GCC diagnostic pop
 #endif
 
+#include <utils/utf8_check.h>
+
+// validate with the vectorized implementation instead of the byte-wise one in libunistring
+#define u8_check(s, n) utf8_check(s, n)
+
 #endif  // UTILS_UNISTR_WRAP_H_
@@ -0,0 +1,278 @@
+/*
+ * utils/utf8_check.c - UTF-8 validation with SIMD instructions
+ * Copyright (C) 2026 H. Thevindu J. Wijesekera
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <utils/utf8_check.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define UTF8_CHECK_AVX2
+#ifdef __SSE2__
+#define UTF8_CHECK_SSE2
+#endif
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define UTF8_CHECK_NEON
+#endif
+
+typedef const uint8_t *(*check_fn)(const uint8_t *, const uint8_t *);
+
+/*
+ * Get the length of the valid character at s, which must be before end.
+ * returns 0 if the character is invalid or incomplete.
+ */
+static inline size_t _char_len(const uint8_t *s, const uint8_t *end) {
+    const uint8_t c = *s;
+    if (c < 0x80) return 1;
+    if (c < 0xC2) return 0;
+    const size_t avail = (size_t)(end - s);
+    if (c < 0xE0) {
+        if (avail >= 2 && (s[1] ^ 0x80) < 0x40) return 2;
+    } else if (c < 0xF0) {
+        if (avail >= 3 && (s[1] ^ 0x80) < 0x40 && (s[2] ^ 0x80) < 0x40 && (c >= 0xE1 || s[1] >= 0xA0) &&
+            (c != 0xED || s[1] < 0xA0)) {
+            return 3;
+        }
+    } else if (c < 0xF8) {
+        if (avail >= 4 && (s[1] ^ 0x80) < 0x40 && (s[2] ^ 0x80) < 0x40 && (s[3] ^ 0x80) < 0x40 &&
+            (c >= 0xF1 || s[1] >= 0x90) && (c < 0xF4 || (c == 0xF4 && s[1] < 0x90))) {
+            return 4;
+        }
+    }
+    return 0;
+}
+
+static const uint8_t *_check_scalar(const uint8_t *s, const uint8_t *end) {
+    while (s < end) {
+        const size_t len = _char_len(s, end);
+        if (!len) return s;
+        s += len;
+    }
+    return NULL;
+}
+
+#if defined(UTF8_CHECK_AVX2) || defined(UTF8_CHECK_NEON)
+
+/*
+ * Lookup tables of the errors indicated by each pair of consecutive bytes, as in the algorithm of
+ * J. Keiser and D. Lemire, "Validating UTF-8 In Less Than One Instruction Per Byte".
+ * Errors of a pair are the bits set in all three lookups by the high and low nibbles of the first byte and the high
+ * nibble of the second byte.
+ */
+#define TOO_SHORT (1 << 0)   // 11______ 0_______ or 11______ 11______
+#define TOO_LONG (1 << 1)    // 0_______ 10______
+#define OVERLONG_3 (1 << 2)  // 11100000 100_____
+#define TOO_LARGE (1 << 3)   // 11110100 1001____ or 11110100 101_____ or 11110101+ 1001____ or 11110101+ 101_____
+#define SURROGATE (1 << 4)   // 11101101 101_____
+#define OVERLONG_2 (1 << 5)  // 1100000_ 10______
+#define TOO_LARGE_1000 (1 << 6)  // 11110101+ 1000____
+#define OVERLONG_4 (1 << 6)      // 11110000 1000____
+#define TWO_CONTS (1 << 7)       // 10______ 10______
+#define CARRY (TOO_SHORT | TOO_LONG | TWO_CONTS)
+
+static const uint8_t byte_1_high[16] = {TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+                                        TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS, TOO_SHORT | OVERLONG_2, TOO_SHORT,
+                                        TOO_SHORT | OVERLONG_3 | SURROGATE,
+                                        TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4};
+
+static const uint8_t byte_1_low[16] = {CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4, CARRY | OVERLONG_2, CARRY, CARRY,
+                                       CARRY | TOO_LARGE, CARRY | TOO_LARGE | TOO_LARGE_1000,
+                                       CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,
+                                       CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,
+                                       CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,
+                                       CARRY | TOO_LARGE | TOO_LARGE_1000,
+                                       CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+                                       CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000};
+
+static const uint8_t byte_2_high[16] = {TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+                                        TOO_SHORT,
+                                        TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4,
+                                        TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+                                        TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+                                        TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE, TOO_SHORT, TOO_SHORT,
+                                        TOO_SHORT, TOO_SHORT};
+
+// a block is incomplete if any of its last 3 bytes starts a character longer than the remaining bytes
+static const uint8_t incomplete_max[32] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+                                           0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+                                           0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xEF, 0xDF, 0xBF};
+
+/*
+ * Get the start of the character which is not known to be complete when the bytes from start to s are validated
+ * without errors, except for a possibly incomplete character at the end.
+ */
+static inline const uint8_t *_last_char_start(const uint8_t *start, const uint8_t *s) {
+    const uint8_t *p = (s - start > 3) ? s - 3 : start;
+    while (p < s && (*p & 0xC0) == 0x80) p++;
+    return p;
+}
+
+#endif
+
+#ifdef UTF8_CHECK_AVX2
+
+__attribute__((target("avx2"))) static inline __m256i _load_table_avx2(const uint8_t *table) {
+    return _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)table));
+}
+
+/*
+ * Check all the characters in input which end in it. prev_input is the previous block.
+ * returns the errors as non-zero bytes.
+ */
+__attribute__((target("avx2"))) static inline __m256i _block_errors_avx2(__m256i input, __m256i prev_input) {
+    const __m256i low_nibble = _mm256_set1_epi8(0x0F);
+    const __m256i shifted = _mm256_permute2x128_si256(prev_input, input, 0x21);
+    const __m256i prev1 = _mm256_alignr_epi8(input, shifted, 15);
+    const __m256i prev2 = _mm256_alignr_epi8(input, shifted, 14);
+    const __m256i prev3 = _mm256_alignr_epi8(input, shifted, 13);
+
+    __m256i special = _mm256_shuffle_epi8(_load_table_avx2(byte_1_high),
+                                          _mm256_and_si256(_mm256_srli_epi16(prev1, 4), low_nibble));
+    special = _mm256_and_si256(special,
+                               _mm256_shuffle_epi8(_load_table_avx2(byte_1_low), _mm256_and_si256(prev1, low_nibble)));
+    special = _mm256_and_si256(special, _mm256_shuffle_epi8(_load_table_avx2(byte_2_high),
+                                                            _mm256_and_si256(_mm256_srli_epi16(input, 4), low_nibble)));
+
+    // the second and third continuation bytes are not covered by the pairs
+    const __m256i third = _mm256_subs_epu8(prev2, _mm256_set1_epi8(0xE0 - 0x80));
+    const __m256i fourth = _mm256_subs_epu8(prev3, _mm256_set1_epi8(0xF0 - 0x80));
+    const __m256i must_be_cont = _mm256_and_si256(_mm256_or_si256(third, fourth), _mm256_set1_epi8((char)0x80));
+    return _mm256_xor_si256(must_be_cont, special);
+}
+
+__attribute__((target("avx2"))) static const uint8_t *_check_avx2(const uint8_t *s, const uint8_t *end) {
+    const uint8_t *start = s;
+    const __m256i max_value = _mm256_loadu_si256((const __m256i *)incomplete_max);
+    __m256i prev_input = _mm256_setzero_si256();
+    __m256i prev_incomplete = _mm256_setzero_si256();
+    while (end - s >= 32) {
+        const __m256i input = _mm256_loadu_si256((const __m256i *)s);
+        __m256i err;
+        if (_mm256_movemask_epi8(input) == 0) {
+            err = prev_incomplete;
+            prev_incomplete = _mm256_setzero_si256();
+        } else {
+            err = _block_errors_avx2(input, prev_input);
+            prev_incomplete = _mm256_subs_epu8(input, max_value);
+        }
+        // the exact position of the error is found by the scalar check
+        if (!_mm256_testz_si256(err, err)) break;
+        prev_input = input;
+        s += 32;
+    }
+    return _check_scalar(_last_char_start(start, s), end);
+}
+
+#endif
+
+#ifdef UTF8_CHECK_SSE2
+
+/*
+ * Skips blocks of 16 ASCII bytes and checks the characters of other blocks one by one.
+ */
+static const uint8_t *_check_sse2(const uint8_t *s, const uint8_t *end) {
+    while (end - s >= 16) {
+        const unsigned mask = (unsigned)_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)s));
+        if (mask == 0) {
+            s += 16;
+            continue;
+        }
+        const uint8_t *block_end = s + 16;
+        s += __builtin_ctz(mask);
+        while (s < block_end) {
+            const size_t len = _char_len(s, end);
+            if (!len) return s;
+            s += len;
+        }
+    }
+    return _check_scalar(s, end);
+}
+
+#endif
+
+#ifdef UTF8_CHECK_NEON
+
+/*
+ * Check all the characters in input which end in it. prev_input is the previous block.
+ * returns the errors as non-zero bytes.
+ */
+static inline uint8x16_t _block_errors_neon(uint8x16_t input, uint8x16_t prev_input) {
+    const uint8x16_t prev1 = vextq_u8(prev_input, input, 15);
+    const uint8x16_t prev2 = vextq_u8(prev_input, input, 14);
+    const uint8x16_t prev3 = vextq_u8(prev_input, input, 13);
+
+    uint8x16_t special = vqtbl1q_u8(vld1q_u8(byte_1_high), vshrq_n_u8(prev1, 4));
+    special = vandq_u8(special, vqtbl1q_u8(vld1q_u8(byte_1_low), vandq_u8(prev1, vdupq_n_u8(0x0F))));
+    special = vandq_u8(special, vqtbl1q_u8(vld1q_u8(byte_2_high), vshrq_n_u8(input, 4)));
+
+    // the second and third continuation bytes are not covered by the pairs
+    const uint8x16_t third = vqsubq_u8(prev2, vdupq_n_u8(0xE0 - 0x80));
+    const uint8x16_t fourth = vqsubq_u8(prev3, vdupq_n_u8(0xF0 - 0x80));
+    const uint8x16_t must_be_cont = vandq_u8(vorrq_u8(third, fourth), vdupq_n_u8(0x80));
+    return veorq_u8(must_be_cont, special);
+}
+
+static const uint8_t *_check_neon(const uint8_t *s, const uint8_t *end) {
+    const uint8_t *start = s;
+    const uint8x16_t max_value = vld1q_u8(incomplete_max + 16);
+    uint8x16_t prev_input = vdupq_n_u8(0);
+    uint8x16_t prev_incomplete = vdupq_n_u8(0);
+    while (end - s >= 16) {
+        const uint8x16_t input = vld1q_u8(s);
+        uint8x16_t err;
+        if (vmaxvq_u8(input) < 0x80) {
+            err = prev_incomplete;
+            prev_incomplete = vdupq_n_u8(0);
+        } else {
+            err = _block_errors_neon(input, prev_input);
+            prev_incomplete = vqsubq_u8(input, max_value);
+        }
+        // the exact position of the error is found by the scalar check
+        if (vmaxvq_u8(err) != 0) break;
+        prev_input = input;
+        s += 16;
+    }
+    return _check_scalar(_last_char_start(start, s), end);
+}
+
+#endif
+
+static check_fn _select_check(void) {
+#ifdef UTF8_CHECK_AVX2
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return &_check_avx2;
+#endif
+#if defined(UTF8_CHECK_SSE2)
+    return &_check_sse2;
+#elif defined(UTF8_CHECK_NEON)
+    return &_check_neon;
+#else
+    return &_check_scalar;
+#endif
+}
+
+const uint8_t *utf8_check(const uint8_t *s, size_t n) {
+    static check_fn check = NULL;
+    check_fn fn = __atomic_load_n(&check, __ATOMIC_RELAXED);
+    if (!fn) {
+        fn = _select_check();
+        __atomic_store_n(&check, fn, __ATOMIC_RELAXED);
+    }
+    return fn(s, s + n);
+}
@@ -0,0 +1,32 @@
+/*
+ * utils/utf8_check.h - header for UTF-8 validation
+ * Copyright (C) 2026 H. Thevindu J. Wijesekera
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef UTILS_UTF8_CHECK_H_
+#define UTILS_UTF8_CHECK_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Check if the n bytes at s are valid UTF-8, with the same rules as u8_check() of libunistring.
+ * Uses SIMD instructions selected at runtime if the CPU supports them.
+ * returns NULL if the string is valid, or a pointer to the first invalid or incomplete character otherwise.
+ */
+extern const uint8_t *utf8_check(const uint8_t *s, size_t n);
+
+#endif  // UTILS_UTF8_CHECK_H_
@@ -34,13 +34,18 @@
 #include <time.h>
 #include <unistd.h>
 #include <utils/clipboard_listener.h>
+#include <utils/dir_walker.h>
 #include <utils/linux_status_icon.h>
 #include <utils/net_utils.h>
 #include <utils/utils.h>
 #ifdef __linux__
-#include <X11/Xmu/Atoms.h>
 #include <xclip/xclip.h>
 #endif
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 #ifdef _WIN32
 #include <direct.h>
 #include <shlobj.h>
@@ -54,12 +59,13 @@
 #include <microhttpd.h>
 #endif
 
-#define MAX_RECURSE_DEPTH 256
-
 #if defined(__linux__) || defined(__APPLE__)
 
 #define TEMP_FILE "/tmp/clipshare-copied"
 
+// maximum number of paths buffered by the directory walker until they are sent
+#define DIR_STREAM_QUEUE_LEN 1024
+
 static inline int8_t hex2char(char h);
 static int url_decode(char *, uint32_t *len_p);
 #elif defined(_WIN32)
@@ -70,15 +76,9 @@ static inline void _wappend(list2 *lst, const wchar_t *wstr);
 static inline BOOL OpenClipboardWrapper(HWND hwnd);
 #endif
 static inline int milli_sleep(unsigned int millis);
-
-#ifdef __linux__
-#define PENDING_TEXT 1
-#define PENDING_FILES 2
-
-static uint32_t pending_len;
-static int pending_type;
-
-char *pending_data = NULL;
+static uint64_t _hash_file_meta(const char *path, uint64_t digest, int *is_dir_p);
+#if (PROTOCOL_MIN <= 5) && (2 <= PROTOCOL_MAX)
+static int _hash_copied_tree(uint64_t *digest_p);
 #endif
 
 void print_usage(const char *prog_name) {
@@ -160,31 +160,6 @@ void error_exit(const char *msg) {
     exit(EXIT_FAILURE);
 }
 
-#ifdef __linux__
-typedef struct _DisplayRec {
-    struct _DisplayRec *next;
-    Display *dpy;
-    Atom atom;
-} DisplayRec;
-
-struct _AtomRec {
-    _Xconst char *name;
-    DisplayRec *head;
-};
-
-static void freeAtomPtr(AtomPtr atomPtr) {
-    if (atomPtr) {
-        DisplayRec *next = atomPtr->head;
-        atomPtr->head = NULL;
-        while (next) {
-            DisplayRec *tmp = next->next;
-            XtFree((char *)(next));
-            next = tmp;
-        }
-    }
-}
-#endif
-
 void cleanup(void) {
 #ifdef DEBUG_MODE
     puts("Cleaning up resources before exit");
@@ -210,8 +185,6 @@ void cleanup(void) {
 #endif
 #ifdef __linux__
     cleanup_status_icon();
-    if (_XA_CLIPBOARD) freeAtomPtr(_XA_CLIPBOARD);
-    if (_XA_UTF8_STRING) freeAtomPtr(_XA_UTF8_STRING);
 #elif defined(_WIN32)
     WSACleanup();
     if (temp_file) {
@@ -241,6 +214,25 @@ uint64_t get_time_millis(void) {
 #endif
 }
 
+uint64_t hash_bytes(const void *data, size_t len, uint64_t hash) {
+    const unsigned char *ptr = (const unsigned char *)data;
+    hash ^= (uint64_t)len * 0x9E3779B97F4A7C15ULL;
+    // one multiplication per 8 bytes instead of one per byte as in FNV-1a
+    for (; len >= 8; len -= 8, ptr += 8) {
+        uint64_t word;
+        memcpy(&word, ptr, 8);
+        hash = (hash ^ word) * 0x100000001B3ULL;
+        hash ^= hash >> 29;
+    }
+    if (len > 0) {
+        uint64_t word = 0;
+        memcpy(&word, ptr, len);
+        hash = (hash ^ word) * 0x100000001B3ULL;
+        hash ^= hash >> 29;
+    }
+    return hash;
+}
+
 int file_exists(const char *file_name) {
     if (file_name[0] == 0) return 0;  // empty path
     int f_ok;
@@ -312,91 +304,121 @@ int is_directory(const char *path, int follow_symlinks) {
     return -1;
 }
 
-#ifdef _WIN32
+#if defined(__SSE2__)
+#define EOL_BLOCK_LEN 16
+#define EOL_MASK_BITS 1
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#define EOL_BLOCK_LEN 16
+#define EOL_MASK_BITS 4
+#endif
+
+#ifdef EOL_BLOCK_LEN
 /*
- * Allocate the required capacity for the string with EOL=CRLF including the terminating '\0'.
- * Assign the realloced string to *str_p and the length after conversion to *len_p without the terminating '\0'.
- * Returns 0 if all LF are preceded by CR (i.e. no conversion needed).
- * Returns 1 if conversion is needed and it will increase the length.
- * Returns -1 if realloc failed, and free() the *str_p.
+ * Get a bit mask of the bytes equal to c in the EOL_BLOCK_LEN bytes at p.
+ * Each byte is represented by EOL_MASK_BITS bits in the mask, starting from the lowest bits. Only one bit is set for
+ * each matching byte.
  */
-static inline int _realloc_for_crlf(char **str_p, size_t *len_p) {
-    char *str = *str_p;
-    size_t increase = 0;
-    size_t ind;
-    for (ind = 0; str[ind]; ind++) {
-        if (str[ind] == '\n' && (ind == 0 || str[ind - 1] != '\r')) {
-            // needs increasing
-            increase++;
-        }
-    }
-    if (!increase) {
-        *len_p = ind;
-        return 0;
-    }
-    uint64_t req_len = (uint64_t)ind + increase;
-    if (req_len >= 0xFFFFFFFFUL) {
-        free(str);
-        error("realloc size too large");
-        return -1;
-    }
-    *str_p = realloc_or_free(str, (size_t)req_len + 1);  // +1 for terminating '\0'
-    if (!*str_p) return -1;
-    *len_p = (size_t)req_len;
-    return 1;
+static inline uint64_t _eol_byte_mask(const char *p, char c) {
+#if defined(__SSE2__)
+    const __m128i v = _mm_loadu_si128((const __m128i *)p);
+    return (uint64_t)(unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8(c)));
+#else
+    const uint8x16_t match = vceqq_u8(vld1q_u8((const uint8_t *)p), vdupq_n_u8((uint8_t)c));
+    return vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(match), 4)), 0) & 0x8888888888888888ULL;
+#endif
 }
 
-static inline void _convert_to_crlf(char *str, size_t new_len) {
-    // converting to CRLF expands string. Therefore, start from the end to avoid overwriting
-    size_t new_ind = new_len - 1;
-    str[new_len] = 0;  // terminating '\0'
-    for (size_t cur_ind = strnlen(str, new_len + 1) - 1;; cur_ind--) {
-        char c = str[cur_ind];
-        str[new_ind--] = c;
-        if (c == '\n' && (cur_ind == 0 || str[cur_ind - 1] != '\r')) {
-            // add the missing \r before \n
-            str[new_ind--] = '\r';
-        }
-        if (cur_ind == 0) break;
-    }
-}
+/*
+ * Get a bit mask of the bytes equal to c or '\0' in the EOL_BLOCK_LEN bytes at p, in the same form as _eol_byte_mask().
+ */
+static inline uint64_t _eol_block_mask(const char *p, char c) { return _eol_byte_mask(p, c) | _eol_byte_mask(p, '\0'); }
 #endif
 
-static inline int64_t _convert_to_lf(char *str) {
-    // converting to CRLF shrinks string. Therefore, start from the begining to avoid overwriting
-    const char *old_ptr = str;
-    char *new_ptr = str;
-    char c;
-    while ((c = *old_ptr)) {
-        old_ptr++;
-        if (c != '\r' || *old_ptr != '\n') {
-            *new_ptr = c;
-            new_ptr++;
+/*
+ * Removes CR followed by LF in the len bytes at src and writes the result to dst, which may be the same as src.
+ * Stops at the first '\0' and sets *ended_p to 1 if it is found.
+ * Returns the number of bytes written.
+ */
+static size_t _part_to_lf(const char *src, size_t len, char *dst, int *ended_p) {
+    size_t w = 0;
+    size_t r = 0;
+    while (r < len) {
+#ifdef EOL_BLOCK_LEN
+        if (r + EOL_BLOCK_LEN <= len) {
+            const uint64_t mask = _eol_block_mask(src + r, '\r');
+            const size_t skip = mask ? (size_t)__builtin_ctzll(mask) / EOL_MASK_BITS : EOL_BLOCK_LEN;
+            if (dst + w != src + r) memmove(dst + w, src + r, skip);
+            r += skip;
+            w += skip;
+            if (!mask) continue;
+        }
+#endif
+        const char c = src[r++];
+        if (!c) {
+            *ended_p = 1;
+            break;
         }
+        if (c != '\r' || r >= len || src[r] != '\n') dst[w++] = c;
     }
-    *new_ptr = '\0';
-    return new_ptr - str;
+    return w;
 }
 
-int64_t convert_eol(char **str_p, int force_lf) {
 #ifdef _WIN32
-    if (!force_lf) {  // convert to CRLF
-        size_t new_len;
-        // realloc if available capacity is not enough
-        int status = _realloc_for_crlf(str_p, &new_len);
-        if (status == 0) {  // no conversion needed
-            return (int64_t)new_len;
+/*
+ * Adds CR before LF not preceded by CR in the len bytes at src and writes the result to dst, which must not overlap
+ * src. prev is the byte before src.
+ * Stops at the first '\0' and sets *ended_p to 1 if it is found.
+ * Returns the number of bytes written.
+ */
+static size_t _part_to_crlf(const char *src, size_t len, char prev, char *dst, int *ended_p) {
+    size_t w = 0;
+    size_t r = 0;
+    while (r < len) {
+#ifdef EOL_BLOCK_LEN
+        if (r + EOL_BLOCK_LEN <= len) {
+            const uint64_t mask = _eol_block_mask(src + r, '\n');
+            memcpy(dst + w, src + r, EOL_BLOCK_LEN);
+            if (!mask) {
+                r += EOL_BLOCK_LEN;
+                w += EOL_BLOCK_LEN;
+                continue;
+            }
+            // copied bytes after the match are overwritten
+            const size_t skip = (size_t)__builtin_ctzll(mask) / EOL_MASK_BITS;
+            r += skip;
+            w += skip;
         }
-        if (status < 0 || !*str_p) {  // realloc failed
-            return -1;
+#endif
+        const char c = src[r];
+        if (!c) {
+            *ended_p = 1;
+            break;
         }
-        _convert_to_crlf(*str_p, new_len);
-        return (int64_t)new_len;
+        if (c == '\n' && (r ? src[r - 1] : prev) != '\r') dst[w++] = '\r';  // add the missing \r before \n
+        dst[w++] = c;
+        r++;
     }
+    return w;
+}
+#endif
+
+size_t convert_eol_part(const char *src, size_t len, char prev, int force_lf, char *dst, int *ended_p) {
+#ifdef _WIN32
+    if (!force_lf) return _part_to_crlf(src, len, prev, dst, ended_p);
 #else
     (void)force_lf;
 #endif
-    return _convert_to_lf(*str_p);
+    (void)prev;
+    return _part_to_lf(src, len, dst, ended_p);
+}
+
+size_t convert_eol_max_len(size_t len, int force_lf) {
+#ifdef _WIN32
+    if (!force_lf) return 2 * len;
+#else
+    (void)force_lf;
+#endif
+    return len;
 }
 
 #if PROTOCOL_MIN <= 1
@@ -587,7 +609,7 @@ int mkdirs(const char *dir_path) {
     return EXIT_SUCCESS;
 }
 
-list2 *list_dir(const char *dirname) {
+list2 *list_dir(const char *dirname, arena *mem) {
 #if defined(__linux__) || defined(__APPLE__)
     DIR *d = opendir(dirname);
 #elif defined(_WIN32)
@@ -604,7 +626,7 @@ list2 *list_dir(const char *dirname) {
 #endif
         return NULL;
     }
-    list2 *lst = init_list(2);
+    list2 *lst = mem ? init_list_arena(mem, 2) : init_list(2);
     if (!lst) return NULL;
     while (1) {
 #if defined(__linux__) || defined(__APPLE__)
@@ -618,7 +640,7 @@ list2 *list_dir(const char *dirname) {
         filename = dir->d_name;
 #if defined(__linux__) || defined(__APPLE__)
         if (!(strcmp(filename, ".") && strcmp(filename, ".."))) continue;
-        append(lst, strdup(filename));
+        append(lst, mem ? arena_strdup(mem, filename) : strdup(filename));
 #elif defined(_WIN32)
         if (!(wcscmp(filename, L".") && wcscmp(filename, L".."))) continue;
         _wappend(lst, filename);
@@ -632,87 +654,21 @@ list2 *list_dir(const char *dirname) {
     return lst;
 }
 
-#if (PROTOCOL_MIN <= 4) && (2 <= PROTOCOL_MAX)
+#if (PROTOCOL_MIN <= 5) && (2 <= PROTOCOL_MAX)
 
 #if defined(__linux__) || defined(__APPLE__)
 
 /*
- * Check if the path is a file or a directory.
- * If the path is a directory, calls _recurse_dir() on that.
- * Otherwise, appends the path to the list
+ * Get the paths of the copied files and directories from the clipboard.
+ * Sets roots_p to an array of root_cnt_p paths, which point into the returned buffer, and sets path_len_p to the length
+ * of the path name of the directory which the files are copied.
+ * Returns the buffer on success, which should be freed after freeing *roots_p. Otherwise, returns NULL.
  */
-static void _process_path(const char *path, list2 *lst, int depth, int include_leaf_dirs);
-
-/*
- * Recursively append all file paths in the directory and its subdirectories
- * to the list.
- * maximum recursion depth is limited to MAX_RECURSE_DEPTH
- */
-static void _recurse_dir(const char *_path, list2 *lst, int depth, int include_leaf_dirs);
-
-static void _process_path(const char *path, list2 *lst, int depth, int include_leaf_dirs) {
-    struct stat sb;
-    if (lstat(path, &sb) != 0) return;
-    if (S_ISDIR(sb.st_mode)) {
-        _recurse_dir(path, lst, depth + 1, include_leaf_dirs);
-    } else if (S_ISREG(sb.st_mode)) {
-        append(lst, strdup(path));
-    }
-}
-
-static void _recurse_dir(const char *_path, list2 *lst, int depth, int include_leaf_dirs) {
-    if (depth > MAX_RECURSE_DEPTH) return;
-    DIR *d = opendir(_path);
-    if (!d) {
-#ifdef DEBUG_MODE
-        printf("Error opening directory %s", _path);
-#endif
-        return;
-    }
-    size_t p_len = strnlen(_path, 2050);
-    if (p_len > 2048) {
-        error("Too long file name.");
-        (void)closedir(d);
-        return;
-    }
-    char path[p_len + 2];
-    strncpy(path, _path, p_len + 1);
-    path[p_len + 1] = 0;
-    if (path[p_len - 1] != PATH_SEP) {
-        path[p_len++] = PATH_SEP;
-        path[p_len] = '\0';
-    }
-    const struct dirent *dir;
-    int is_empty = 1;
-    while ((dir = readdir(d)) != NULL) {
-        const char *filename = dir->d_name;
-        if (!(strcmp(filename, ".") && strcmp(filename, ".."))) continue;
-        is_empty = 0;
-        const size_t _fname_len = strnlen(filename, sizeof(dir->d_name));
-        if ((_fname_len + p_len) > 2048) {
-            error("Too long file name.");
-            (void)closedir(d);
-            return;
-        }
-        char pathname[_fname_len + p_len + 1];
-        strncpy(pathname, path, p_len);
-        strncpy(pathname + p_len, filename, _fname_len + 1);
-        pathname[p_len + _fname_len] = 0;
-        _process_path(pathname, lst, depth, include_leaf_dirs);
-    }
-    if (include_leaf_dirs && is_empty) {
-        append(lst, strdup(path));
-    }
-    (void)closedir(d);
-}
-
-void get_copied_dirs_files(dir_files *dfiles_p, int include_leaf_dirs) {
-    dfiles_p->lst = NULL;
-    dfiles_p->path_len = 0;
+static char *_get_copied_roots(const char ***roots_p, uint32_t *root_cnt_p, size_t *path_len_p) {
     int offset = 0;
     char *fnames = get_copied_files_as_str(&offset);
     if (!fnames) {
-        return;
+        return NULL;
     }
     char *file_path = fnames + offset;
 
@@ -725,15 +681,15 @@ void get_copied_dirs_files(dir_files *dfiles_p, int include_leaf_dirs) {
     }
     if (file_cnt >= 0xFFFFFFFFUL) {
         free(fnames);
-        return;
+        return NULL;
     }
 
-    list2 *lst = init_list((uint32_t)file_cnt);
-    if (!lst) {
+    const char **roots = (const char **)malloc(sizeof(const char *) * file_cnt);
+    if (!roots) {
         free(fnames);
-        return;
+        return NULL;
     }
-    dfiles_p->lst = lst;
+    uint32_t root_cnt = 0;
     char *fname = file_path;
     for (size_t i = 0; i < file_cnt; i++) {
         const size_t off = strnlen(fname, 2047) + 1;
@@ -744,57 +700,136 @@ void get_copied_dirs_files(dir_files *dfiles_p, int include_leaf_dirs) {
             if (fname[fname_len - 1] == PATH_SEP) fname[fname_len - 1] = 0;  // if directory, remove ending /
             const char *sep_ptr = strrchr(fname, PATH_SEP);
             if (sep_ptr > fname) {
-                dfiles_p->path_len = (size_t)(sep_ptr - fname) + 1;
+                *path_len_p = (size_t)(sep_ptr - fname) + 1;
             }
         }
 
-        struct stat statbuf;
-        if (stat(fname, &statbuf)) {
-#ifdef DEBUG_MODE
-            puts("stat failed");
-#endif
-            fname += off;
-            continue;
-        }
-        if (S_ISDIR(statbuf.st_mode)) {
-            _recurse_dir(fname, lst, 1, include_leaf_dirs);
-            fname += off;
-        } else if (S_ISREG(statbuf.st_mode)) {
-            append(lst, strdup(fname));
-            fname += off;
+        roots[root_cnt++] = fname;
+        fname += off;
+    }
+    *roots_p = roots;
+    *root_cnt_p = root_cnt;
+    return fnames;
+}
+
+void get_copied_dirs_files(dir_files *dfiles_p, int include_leaf_dirs, const walk_budget *budget) {
+    dfiles_p->store = NULL;
+    dfiles_p->path_len = 0;
+    const char **roots;
+    uint32_t root_cnt;
+    char *fnames = _get_copied_roots(&roots, &root_cnt, &(dfiles_p->path_len));
+    if (!fnames) {
+        return;
+    }
+    path_store *store = new_path_store();
+    if (store) {
+        if (walk_dir_tree(roots, root_cnt, include_leaf_dirs, 0, budget, store) == EXIT_SUCCESS) {
+            dfiles_p->store = store;
+        } else {
+            free_path_store(store);
         }
     }
+    free(roots);
+    free(fnames);
+}
+
+#if (PROTOCOL_MIN <= 5) && (5 <= PROTOCOL_MAX)
+dir_stream *get_copied_dirs_stream(size_t *path_len_p, int include_leaf_dirs, const walk_budget *budget) {
+    *path_len_p = 0;
+    const char **roots;
+    uint32_t root_cnt;
+    char *fnames = _get_copied_roots(&roots, &root_cnt, path_len_p);
+    if (!fnames) {
+        return NULL;
+    }
+    dir_stream *stream = open_dir_stream(roots, root_cnt, include_leaf_dirs, budget, DIR_STREAM_QUEUE_LEN);
+    free(roots);
     free(fnames);
+    return stream;
 }
+#endif
 
 #elif defined(_WIN32)
 
+/*
+ * Adds the entry to the directory in the path store with the UTF-8 name converted from the wide char name.
+ * Adds a file if dir_p is NULL. Otherwise, adds a directory and sets it in dir_p.
+ */
+static int _wadd_entry(ps_writer *writer, ps_dir *parent, const wchar_t *wname, ps_dir **dir_p) {
+    char *name;
+    uint32_t name_len;
+    if (wchar_to_utf8_str(wname, &name, &name_len) != EXIT_SUCCESS) return EXIT_FAILURE;
+    int status = EXIT_SUCCESS;
+    if (dir_p) {
+        *dir_p = path_store_add_dir(writer, parent, name, name_len);
+        if (!*dir_p) status = EXIT_FAILURE;
+    } else {
+        status = path_store_add_file(writer, parent, name, name_len);
+    }
+    free(name);
+    return status;
+}
+
+/*
+ * State of a directory walk shared by all the directories walked into.
+ */
+typedef struct _win_walk {
+    ps_writer *writer;
+    int include_leaf_dirs;
+    const walk_budget *budget;
+    uint32_t entry_cnt;  // number of files and leaf directories counted against the budget
+    int8_t exceeded;
+} win_walk;
+
+/*
+ * Count a file of size file_size, or a leaf directory if file_size is -1, against the budget of the walk.
+ * Stops the walk and logs the reason if the budget is exceeded.
+ * returns EXIT_SUCCESS if the budget is not exceeded and EXIT_FAILURE otherwise.
+ */
+static int _wcharge_budget(win_walk *walk, int64_t file_size) {
+    const walk_budget *budget = walk->budget;
+    if (!budget) return EXIT_SUCCESS;
+    if (budget->max_file_size >= 0 && file_size > budget->max_file_size) {
+        error("Directory walk stopped. File is too large.");
+        walk->exceeded = 1;
+        return EXIT_FAILURE;
+    }
+    if (budget->max_files > 0 && ++(walk->entry_cnt) > budget->max_files) {
+        error("Directory walk stopped. Too many files.");
+        walk->exceeded = 1;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
 /*
  * Check if the path is a file or a directory.
  * If the path is a directory, calls _recurse_dir() on that.
- * Otherwise, appends the path to the list
+ * Otherwise, adds the file to the directory in the path store
  */
-static void _process_path(const wchar_t *path, list2 *lst, int depth, int include_leaf_dirs);
+static void _process_path(const wchar_t *path, size_t name_off, win_walk *walk, ps_dir *parent, int depth);
 
 /*
- * Recursively append all file paths in the directory and its subdirectories
- * to the list.
+ * Recursively add all files in the directory and its subdirectories to the path store.
  * maximum recursion depth is limited to MAX_RECURSE_DEPTH
  */
-static void _recurse_dir(const wchar_t *_path, list2 *lst, int depth, int include_leaf_dirs);
+static void _recurse_dir(const wchar_t *_path, win_walk *walk, ps_dir *dir, int depth);
 
-static void _process_path(const wchar_t *path, list2 *lst, int depth, int include_leaf_dirs) {
+static void _process_path(const wchar_t *path, size_t name_off, win_walk *walk, ps_dir *parent, int depth) {
     struct _stat64 sb;
     if (_wstat64(path, &sb) != 0) return;
     if (S_ISDIR(sb.st_mode)) {
-        _recurse_dir(path, lst, depth + 1, include_leaf_dirs);
+        ps_dir *dir;
+        if (_wadd_entry(walk->writer, parent, path + name_off, &dir) != EXIT_SUCCESS) return;
+        _recurse_dir(path, walk, dir, depth + 1);
     } else if (S_ISREG(sb.st_mode)) {
-        _wappend(lst, path);
+        if (_wcharge_budget(walk, (int64_t)sb.st_size) != EXIT_SUCCESS) return;
+        (void)_wadd_entry(walk->writer, parent, path + name_off, NULL);
     }
 }
 
-static void _recurse_dir(const wchar_t *_path, list2 *lst, int depth, int include_leaf_dirs) {
-    if (depth > MAX_RECURSE_DEPTH) return;
+static void _recurse_dir(const wchar_t *_path, win_walk *walk, ps_dir *dir, int depth) {
+    if (depth > MAX_RECURSE_DEPTH || walk->exceeded) return;
     _WDIR *d = _wopendir(_path);
     if (!d) {
 #ifdef DEBUG_MODE
@@ -815,10 +850,10 @@ static void _recurse_dir(const wchar_t *_path, list2 *lst, int depth, int includ
         path[p_len++] = PATH_SEP;
         path[p_len] = '\0';
     }
-    const struct _wdirent *dir;
+    const struct _wdirent *entry;
     int is_empty = 1;
-    while ((dir = _wreaddir(d)) != NULL) {
-        const wchar_t *filename = dir->d_name;
+    while (!walk->exceeded && (entry = _wreaddir(d)) != NULL) {
+        const wchar_t *filename = entry->d_name;
         if (!(wcscmp(filename, L".") && wcscmp(filename, L".."))) continue;
         is_empty = 0;
         const size_t _fname_len = wcslen(filename);
@@ -831,16 +866,16 @@ static void _recurse_dir(const wchar_t *_path, list2 *lst, int depth, int includ
         wcsncpy(pathname, path, p_len);
         wcsncpy(pathname + p_len, filename, _fname_len + 1);
         pathname[p_len + _fname_len] = 0;
-        _process_path(pathname, lst, depth, include_leaf_dirs);
+        _process_path(pathname, p_len, walk, dir, depth);
     }
-    if (include_leaf_dirs && is_empty) {
-        _wappend(lst, wcsdup(path));
+    if (walk->include_leaf_dirs && is_empty && _wcharge_budget(walk, -1) == EXIT_SUCCESS) {
+        path_store_set_leaf(walk->writer, dir);
     }
     (void)_wclosedir(d);
 }
 
-void get_copied_dirs_files(dir_files *dfiles_p, int include_leaf_dirs) {
-    dfiles_p->lst = NULL;
+void get_copied_dirs_files(dir_files *dfiles_p, int include_leaf_dirs, const walk_budget *budget) {
+    dfiles_p->store = NULL;
     dfiles_p->path_len = 0;
 
     if (!OpenClipboardWrapper(NULL)) {
@@ -868,15 +903,20 @@ void get_copied_dirs_files(dir_files *dfiles_p, int include_leaf_dirs) {
         CloseClipboard();
         return;
     }
-    list2 *lst = init_list((uint32_t)file_cnt);
-    if (!lst) {
+    path_store *store = new_path_store();
+    ps_writer *writer = store ? path_store_writer(store) : NULL;
+    if (!writer) {
+        if (store) free_path_store(store);
         GlobalUnlock(hGlobal);
         CloseClipboard();
         return;
     }
-    dfiles_p->lst = lst;
+    dfiles_p->store = store;
+    ps_dir *root = path_store_root(store);
+    win_walk walk = {
+        .writer = writer, .include_leaf_dirs = include_leaf_dirs, .budget = budget, .entry_cnt = 0, .exceeded = 0};
     wchar_t fileName[MAX_PATH + 1];
-    for (size_t i = 0; i < file_cnt; i++) {
+    for (size_t i = 0; i < file_cnt && !walk.exceeded; i++) {
         fileName[0] = 0;
         DragQueryFileW(hDrop, (UINT)i, fileName, MAX_PATH);
         DWORD attr = GetFileAttributesW(fileName);
@@ -894,18 +934,64 @@ void get_copied_dirs_files(dir_files *dfiles_p, int include_leaf_dirs) {
             }
         }
         if (attr & FILE_ATTRIBUTE_DIRECTORY) {
-            _recurse_dir(fileName, lst, 1, include_leaf_dirs);
+            ps_dir *dir;
+            if (_wadd_entry(writer, root, fileName, &dir) != EXIT_SUCCESS) continue;
+            _recurse_dir(fileName, &walk, dir, 1);
         } else {  // regular file
-            _wappend(lst, fileName);
+            struct _stat64 sb;
+            if (_wstat64(fileName, &sb) != 0 || _wcharge_budget(&walk, (int64_t)sb.st_size) != EXIT_SUCCESS) continue;
+            (void)_wadd_entry(writer, root, fileName, NULL);
         }
     }
     GlobalUnlock(hGlobal);
     CloseClipboard();
+    if (walk.exceeded) {
+        free_path_store(store);
+        dfiles_p->store = NULL;
+        dfiles_p->path_len = 0;
+    }
 }
 
 #endif
 
-#endif  // (PROTOCOL_MIN <= 4) && (2 <= PROTOCOL_MAX)
+/*
+ * Continue the digest with the paths and metadata of the files and leaf directories in the copied directories.
+ * The walk is limited by the auto-send limits, since the copied files are not auto-sent if they are exceeded, and by
+ * DIGEST_MAX_FILES, since it runs before every send. Sets the digest to DIGEST_NONE if there are more files than that.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure or if the auto-send limits are exceeded.
+ */
+static int _hash_copied_tree(uint64_t *digest_p) {
+    const uint32_t max_files = configuration.auto_send_max_files;
+    const int capped = max_files == 0 || max_files > DIGEST_MAX_FILES;
+    const walk_budget budget = {.max_files = capped ? DIGEST_MAX_FILES : max_files,
+                                .max_file_size = configuration.auto_send_max_file_size};
+    dir_files dfiles;
+    get_copied_dirs_files(&dfiles, 1, &budget);
+    if (!dfiles.store) {
+        if (!capped) return EXIT_FAILURE;
+        // the files may still be within the auto-send limits, which are checked by the full walk of the send
+        *digest_p = DIGEST_NONE;
+        return EXIT_SUCCESS;
+    }
+    path_iter *iter = path_store_iter(dfiles.store);
+    if (!iter) {
+        free_path_store(dfiles.store);
+        return EXIT_FAILURE;
+    }
+    uint64_t digest = *digest_p;
+    const char *path;
+    size_t len;
+    while ((path = path_iter_next(iter, &len))) {
+        digest = hash_bytes(path, len + 1, digest);  // the terminator separates the paths
+        digest = _hash_file_meta(path, digest, NULL);
+    }
+    free_path_iter(iter);
+    free_path_store(dfiles.store);
+    *digest_p = digest;
+    return EXIT_SUCCESS;
+}
+
+#endif  // (PROTOCOL_MIN <= 5) && (2 <= PROTOCOL_MAX)
 
 #if defined(__linux__) || defined(__APPLE__)
 
@@ -963,64 +1049,63 @@ static int url_decode(char *str, uint32_t *len_p) {
     if (len_p) *len_p = (uint32_t)(ptr1 - str);
     return EXIT_SUCCESS;
 }
-#endif
-
-#ifdef __linux__
 
-int8_t get_copied_type(void) {
-    char *targets;
-    uint32_t targets_len;
-    if (xclip_util(XCLIP_OUT, "TARGETS", &targets_len, &targets) || targets_len <= 0) {  // do not change the order
-#ifdef DEBUG_MODE
-        printf("xclip read TARGETS. len = %" PRIu32 "\n", targets_len);
+/*
+ * Continue the digest with the size, modification time, inode, and mode of the file at path if it exists.
+ * Sets is_dir_p to 1 if it is not NULL and the file is a directory.
+ */
+static uint64_t _hash_file_meta(const char *path, uint64_t digest, int *is_dir_p) {
+    struct stat statbuf;
+    if (stat(path, &statbuf) != 0) return digest;
+#ifdef __APPLE__
+    const struct timespec *mtime = &(statbuf.st_mtimespec);
+#else
+    const struct timespec *mtime = &(statbuf.st_mtim);
 #endif
-        if (targets) {
-            free(targets);
-        }
-        return COPIED_TYPE_NONE;
-    }
+    // nanoseconds of the modification time distinguish rewrites within the same second
+    const int64_t meta[5] = {(int64_t)statbuf.st_size, (int64_t)mtime->tv_sec, (int64_t)mtime->tv_nsec,
+                             (int64_t)statbuf.st_ino, (int64_t)statbuf.st_mode};
+    if (is_dir_p && S_ISDIR(statbuf.st_mode)) *is_dir_p = 1;
+    return hash_bytes(meta, sizeof(meta), digest);
+}
 
-    // search for copied files
-    const char *token;
-    char found = 0;
-    char *copy = targets;
-    const char *const endptr = targets + targets_len;
-    while ((token = strsep(&copy, "\n"))) {
-        if (!strncmp(token, "x-special/gnome-copied-files", 28)) {
-            found = 1;
-            break;
-        }
-        if (copy < endptr && copy > targets) {
-            *(copy - 1) = '\n';  // restore delemeter of targets
-        }
-    }
-    if (found) {
-        free(targets);
-        return COPIED_TYPE_FILE;
+int get_copied_files_digest(uint64_t *digest_p) {
+    int offset = 0;
+    char *fnames = get_copied_files_as_str(&offset);
+    if (!fnames) return EXIT_FAILURE;
+    uint64_t digest = HASH_INIT;
+    int has_dir = 0;
+    char *fname = fnames + offset;
+    while (fname) {
+        char *next = strchr(fname, '\n');
+        if (next) *(next++) = 0;
+        digest = hash_bytes(fname, strlen(fname) + 1, digest);  // the terminator separates the names
+        if (url_decode(fname, NULL) == EXIT_SUCCESS) digest = _hash_file_meta(fname, digest, &has_dir);
+        fname = next;
     }
+    free(fnames);
+#if (PROTOCOL_MIN <= 5) && (2 <= PROTOCOL_MAX)
+    // changes inside the copied directories do not change the directories themselves
+    if (has_dir && _hash_copied_tree(&digest) != EXIT_SUCCESS) return EXIT_FAILURE;
+#endif
+    *digest_p = digest;
+    return EXIT_SUCCESS;
+}
+#endif
 
-    // search for text
-    copy = targets;
-    while ((token = strsep(&copy, "\n"))) {
-        if (!(strncmp(token, "text/plain", 10) && strncmp(token, "text/html", 9) && strcmp(token, "UTF8_STRING") &&
-              strcmp(token, "TEXT"))) {
-            found = 1;
-            break;
-        }
-    }
-    free(targets);
-    if (found) {
-        return COPIED_TYPE_TEXT;
-    }
+#ifdef __linux__
+
+int8_t get_copied_type(void) {
+    int8_t copied_type = xclip_copied_type();
 #ifdef DEBUG_MODE
-    puts("No copied files");
+    if (copied_type == COPIED_TYPE_NONE) puts("No copied files");
 #endif
-    return COPIED_TYPE_NONE;
+    return copied_type;
 }
 
 char *get_clipboard_text(uint32_t *len_ptr) {
     char *buf;
-    if (xclip_util(XCLIP_OUT, NULL, len_ptr, &buf) != EXIT_SUCCESS || *len_ptr <= 0) {  // do not change the order
+    if (xclip_util(NULL, len_ptr, &buf) != EXIT_SUCCESS || *len_ptr <= 0) {  // do not change the order
 #ifdef DEBUG_MODE
         printf("xclip read text failed. len = %" PRIu32 "\n", *len_ptr);
 #endif
@@ -1033,12 +1118,13 @@ char *get_clipboard_text(uint32_t *len_ptr) {
 }
 
 int put_clipboard_text(char *data, uint32_t len) {
-    char *copy = strndup(data, len);
-    if (!copy) return EXIT_FAILURE;
-    if (pending_data) free(pending_data);
-    pending_data = copy;
-    pending_len = len;
-    pending_type = PENDING_TEXT;
+    data[len] = 0;
+    xclip_offer(NULL, data, len);
+    return EXIT_SUCCESS;
+}
+
+int put_clipboard_image(char *data, uint32_t len) {
+    xclip_offer("image/png", data, len);
     return EXIT_SUCCESS;
 }
 
@@ -1051,7 +1137,7 @@ char *get_copied_files_as_str(int *offset) {
     }
     char *fnames;
     uint32_t fname_len;
-    if (xclip_util(XCLIP_OUT, "x-special/gnome-copied-files", &fname_len, &fnames) ||
+    if (xclip_util("x-special/gnome-copied-files", &fname_len, &fnames) ||
         fname_len <= 0) {  // do not change the order
 #ifdef DEBUG_MODE
         printf("xclip read copied files. len = %" PRIu32 "\n", fname_len);
@@ -1075,7 +1161,7 @@ char *get_copied_files_as_str(int *offset) {
     return fnames;
 }
 
-static unsigned int url_encode(char *str, char **url_p) {
+static unsigned int url_encode(char *str, char **url_p, arena *mem) {
     unsigned int url_len = 1;  // 1 for null terminator
     char *p = str;
     while (*p) {
@@ -1087,7 +1173,7 @@ static unsigned int url_encode(char *str, char **url_p) {
         }
         p++;
     }
-    char *url = (char *)malloc(url_len);
+    char *url = (char *)arena_alloc(mem, url_len);
     if (!url) return 0;
     p = url;
     while (*str) {
@@ -1118,22 +1204,28 @@ static unsigned int url_encode(char *str, char **url_p) {
 }
 
 int set_clipboard_cut_files(const list2 *paths) {
-    list2 *lst_url = init_list(paths->len);
+    arena *mem = new_arena(0);
+    if (!mem) return EXIT_FAILURE;
+    list2 *lst_url = init_list_arena(mem, paths->len);
+    if (!lst_url) {
+        free_arena(mem);
+        return EXIT_FAILURE;
+    }
     size_t tot_len = 4;  // "cut" + null terminator
     for (size_t i = 0; i < paths->len; i++) {
         char *url = NULL;
-        unsigned int len = url_encode((char *)(paths->array[i]), &url);
-        if (len == 0) {
-            if (url) free(url);
-            continue;
-        }
+        unsigned int len = url_encode((char *)(paths->array[i]), &url, mem);
+        if (len == 0) continue;
         tot_len += len + 8;  // 1 for \n and 7 for "file://"
         append(lst_url, url);
     }
-    if (tot_len >= 0xFFFFFFFFUL) return EXIT_FAILURE;
+    if (tot_len >= 0xFFFFFFFFUL) {
+        free_arena(mem);
+        return EXIT_FAILURE;
+    }
     char *buf = (char *)malloc(tot_len);
     if (!buf) {
-        free_list(lst_url);
+        free_arena(mem);
         return EXIT_FAILURE;
     }
     strncpy(buf, "cut", 4);
@@ -1147,48 +1239,19 @@ int set_clipboard_cut_files(const list2 *paths) {
         p += len;
     }
     *p = 0;
-    free_list(lst_url);
-    if (pending_data) free(pending_data);
-    pending_data = buf;
-    pending_len = (uint32_t)tot_len;
-    pending_type = PENDING_FILES;
+    free_arena(mem);
+    xclip_offer("x-special/gnome-copied-files", buf, (uint32_t)tot_len);
     return EXIT_SUCCESS;
 }
 
 void set_pending_clipboard_item(void) {
-    const char *atom_name;
-    switch (pending_type) {
-        case PENDING_TEXT: {
-            atom_name = NULL;
-            break;
-        }
-        case PENDING_FILES: {
-            atom_name = "x-special/gnome-copied-files";
-            break;
-        }
-        default: {
-            free(pending_data);
-            pending_data = NULL;
-            return;
-        }
-    }
-    create_temp_file();
-    if (xclip_util(XCLIP_IN, atom_name, &pending_len, &pending_data) != EXIT_SUCCESS) {
-        if (pending_data) {
-            free(pending_data);
-            pending_data = NULL;
-        }
-        pending_type = 0;
-        error("Failed to write to clipboard");
-        return;
-    }
-    if (pending_data) {
-        free(pending_data);
-        pending_data = NULL;
-    }
-    pending_type = 0;
+    if (xclip_serve() != EXIT_SUCCESS) error("Failed to write to clipboard");
 }
 
+int has_pending_clipboard_item(void) { return xclip_has_offer(); }
+
+void start_clipboard_owner(void) { xclip_start_owner(); }
+
 #elif defined(_WIN32)
 
 static int set_temp_file(void) {
@@ -1337,6 +1400,11 @@ static inline void _wappend(list2 *lst, const wchar_t *wstr) {
 #endif
         return;
     }
+    if (lst->mem) {
+        append(lst, arena_strdup(lst->mem, utf8path));
+        free(utf8path);
+        return;
+    }
     append(lst, utf8path);
 }
 
@@ -1388,18 +1456,18 @@ char *get_clipboard_text(uint32_t *lenptr) {
 
 int put_clipboard_text(char *data, uint32_t len) {
     if (!OpenClipboardWrapper(NULL)) {
+        free(data);
         return EXIT_FAILURE;
     }
     wchar_t *wstr;
     uint32_t wlen;
-    char prev = data[len];
     data[len] = 0;
-    if (utf8_to_wchar_str(data, &wstr, &wlen) != EXIT_SUCCESS) {
-        data[len] = prev;
+    const int status = utf8_to_wchar_str(data, &wstr, &wlen);
+    free(data);
+    if (status != EXIT_SUCCESS) {
         CloseClipboard();
         return EXIT_FAILURE;
     }
-    data[len] = prev;
     HGLOBAL hMem = GlobalAlloc(GMEM_MOVEABLE, (size_t)(wlen + 1) * sizeof(wchar_t));
     wcscpy_s(GlobalLock(hMem), (rsize_t)(wlen + 1), wstr);
     GlobalUnlock(hMem);
@@ -1411,6 +1479,83 @@ int put_clipboard_text(char *data, uint32_t len) {
     return (res == NULL ? EXIT_FAILURE : EXIT_SUCCESS);
 }
 
+int put_clipboard_image(char *data, uint32_t len) {
+    // "PNG" is the registered clipboard format that applications use for PNG images
+    const UINT format = RegisterClipboardFormat(TEXT("PNG"));
+    HGLOBAL hMem = format ? GlobalAlloc(GMEM_MOVEABLE, (size_t)len) : NULL;
+    void *mem = hMem ? GlobalLock(hMem) : NULL;
+    if (!mem) {
+        if (hMem) GlobalFree(hMem);
+        free(data);
+        return EXIT_FAILURE;
+    }
+    memcpy(mem, data, len);
+    GlobalUnlock(hMem);
+    free(data);
+    if (!OpenClipboardWrapper(NULL)) {
+        GlobalFree(hMem);
+        return EXIT_FAILURE;
+    }
+    create_temp_file();
+    EmptyClipboard();
+    HANDLE res = SetClipboardData(format, hMem);
+    CloseClipboard();
+    if (res == NULL) {
+        GlobalFree(hMem);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+/*
+ * Continue the digest with the attributes, last write time, and size of the file at the wide char path if it exists.
+ * Sets is_dir_p to 1 if it is not NULL and the file is a directory.
+ */
+static uint64_t _whash_file_meta(const wchar_t *path, uint64_t digest, int *is_dir_p) {
+    WIN32_FILE_ATTRIBUTE_DATA attr;
+    if (!GetFileAttributesExW(path, GetFileExInfoStandard, &attr)) return digest;
+    // not the whole struct, because the last access time changes when the files are read
+    const DWORD meta[5] = {attr.dwFileAttributes, attr.ftLastWriteTime.dwLowDateTime,
+                           attr.ftLastWriteTime.dwHighDateTime, attr.nFileSizeLow, attr.nFileSizeHigh};
+    if (is_dir_p && (attr.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) *is_dir_p = 1;
+    return hash_bytes(meta, sizeof(meta), digest);
+}
+
+static uint64_t _hash_file_meta(const char *path, uint64_t digest, int *is_dir_p) {
+    wchar_t *wpath;
+    if (utf8_to_wchar_str(path, &wpath, NULL) != EXIT_SUCCESS) return digest;
+    digest = _whash_file_meta(wpath, digest, is_dir_p);
+    free(wpath);
+    return digest;
+}
+
+int get_copied_files_digest(uint64_t *digest_p) {
+    if (!OpenClipboardWrapper(NULL)) return EXIT_FAILURE;
+    HGLOBAL hGlobal = IsClipboardFormatAvailable(CF_HDROP) ? (HGLOBAL)GetClipboardData(CF_HDROP) : NULL;
+    HDROP hDrop = hGlobal ? (HDROP)GlobalLock(hGlobal) : NULL;
+    if (!hDrop) {
+        CloseClipboard();
+        return EXIT_FAILURE;
+    }
+    const UINT file_cnt = DragQueryFileW(hDrop, (UINT)(-1), NULL, 0);
+    uint64_t digest = HASH_INIT;
+    int has_dir = 0;
+    wchar_t fileName[MAX_PATH + 1];
+    for (UINT i = 0; i < file_cnt; i++) {
+        const UINT len = DragQueryFileW(hDrop, i, fileName, MAX_PATH + 1);
+        digest = hash_bytes(fileName, ((size_t)len + 1) * sizeof(wchar_t), digest);  // with the terminator
+        if (len) digest = _whash_file_meta(fileName, digest, &has_dir);
+    }
+    GlobalUnlock(hGlobal);
+    CloseClipboard();
+#if (PROTOCOL_MIN <= 5) && (2 <= PROTOCOL_MAX)
+    // changes inside the copied directories do not change the directories themselves
+    if (has_dir && _hash_copied_tree(&digest) != EXIT_SUCCESS) return EXIT_FAILURE;
+#endif
+    *digest_p = digest;
+    return EXIT_SUCCESS;
+}
+
 int set_clipboard_cut_files(const list2 *paths) {
     if (paths->len == 0) return EXIT_SUCCESS;
 
@@ -22,6 +22,7 @@
 #include <globals.h>
 #include <stdio.h>
 #include <unistd.h>
+#include <utils/dir_walker.h>
 #include <utils/list_utils.h>
 
 #if defined(__linux__) || defined(__APPLE__)
@@ -35,11 +36,11 @@
 #define COPIED_TYPE_FILE 2
 
 /*
- * List of files and the length of the path of their parent directory
+ * Store of files and the length of the path of their parent directory
  */
 typedef struct _dir_files {
     size_t path_len;
-    list2 *lst;
+    path_store *store;
 } dir_files;
 
 extern void print_usage(const char *prog_name);
@@ -73,6 +74,30 @@ extern void cleanup(void);
 
 extern uint64_t get_time_millis(void);
 
+// initial value of the hash for hash_bytes()
+#define HASH_INIT 0xCBF29CE484222325ULL
+
+/*
+ * Hash len bytes of data, continuing from hash, which is the hash of the preceding data or HASH_INIT.
+ * The hash is meant for detecting unchanged data quickly. It is not resistant to intentional collisions.
+ */
+extern uint64_t hash_bytes(const void *data, size_t len, uint64_t hash);
+
+// digest of content that is too costly to hash, which is not the same as any content, including itself
+#define DIGEST_NONE 0
+
+// largest number of files in the copied directories that are hashed for the digest of the copied files
+#define DIGEST_MAX_FILES 1024
+
+/*
+ * Get a digest of the copied files and directories, from their names and the sizes and modification times of the
+ * entries. The paths and metadata of the files in copied directories are included, but the contents are not read.
+ * The digest is DIGEST_NONE if the copied directories have more than DIGEST_MAX_FILES files.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE if no files are copied, the clipboard could not be read, or the
+ * copied directories exceed the auto-send limits.
+ */
+extern int get_copied_files_digest(uint64_t *digest_p);
+
 extern void create_temp_file(void);
 
 extern int check_and_delete_temp_file(void);
@@ -83,7 +108,22 @@ extern int check_and_delete_temp_file(void);
 extern void *realloc_or_free(void *ptr, size_t size) __attribute__((__malloc__));
 
 #ifdef __linux__
+/*
+ * Serve the clipboard item put by put_clipboard_text() or set_clipboard_cut_files() in the calling process, until
+ * another application takes the clipboard. Changes the working directory to "/".
+ */
 extern void set_pending_clipboard_item(void);
+
+/*
+ * Check if a clipboard item is put and not served yet.
+ */
+extern int has_pending_clipboard_item(void);
+
+/*
+ * Start the resident thread that serves the clipboard items, if it is not started yet. Items put later replace the
+ * served item in place.
+ */
+extern void start_clipboard_owner(void);
 #endif
 
 extern int8_t get_copied_type(void);
@@ -99,11 +139,21 @@ extern int8_t get_copied_type(void);
 extern char *get_clipboard_text(uint32_t *lenptr) __attribute__((__malloc__));
 
 /*
- * Reads len bytes of text from the data buffer and copies it into the clipboard.
+ * Puts len bytes of text from the data buffer into the clipboard.
+ * data must be a heap buffer with space for at least len + 1 bytes. This function takes the ownership of data and
+ * frees it, in both success and failure. The caller must not use data after calling this.
+ * On Linux, the buffer itself is served to the other applications without copying it.
  * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
  */
 extern int put_clipboard_text(char *data, uint32_t len);
 
+/*
+ * Puts the len bytes of a PNG image from the data buffer into the clipboard.
+ * This function takes the ownership of data and frees it, in both success and failure, like put_clipboard_text().
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+extern int put_clipboard_image(char *data, uint32_t len);
+
 /*
  * Cut the files given by paths to clipboard. Another application may paste them.
  * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
@@ -130,14 +180,22 @@ extern int file_exists(const char *file_name);
 extern int is_directory(const char *path, int follow_symlinks);
 
 /*
- * Converts line endings to LF or CRLF based on the platform.
- * param str_p is a valid pointer to malloced, null-terminated char * which may be realloced and returned.
- * If force_lf is non-zero, convert EOL to LF regardless of the platform
- * Else, convert EOL of str to LF
- * Returns the length of the new string without the terminating '\0'.
- * If an error occured, this will free() the *str_p and return -1.
+ * Converts line endings of the len bytes at src, which are a part of a text, to LF or CRLF based on the platform. If
+ * force_lf is non-zero, line endings are converted to LF regardless of the platform. The result is written to dst,
+ * which must have space for convert_eol_max_len(len, force_lf) bytes. dst may be the same as src only if the result
+ * has no more bytes than src, which is when convert_eol_max_len() returns len.
+ * prev is the byte before the part in the text, or '\0' for the first part.
+ * A CR at the end of the part is considered not followed by LF. Therefore, a trailing CR should be kept for the next
+ * part unless it is the end of the text.
+ * Stops at the first '\0' and sets *ended_p to 1 if it is found. The result is not null-terminated.
+ * Returns the number of bytes written to dst.
+ */
+extern size_t convert_eol_part(const char *src, size_t len, char prev, int force_lf, char *dst, int *ended_p);
+
+/*
+ * Get the maximum length of the result of converting line endings of len bytes with convert_eol_part().
  */
-extern int64_t convert_eol(char **str_p, int force_lf);
+extern size_t convert_eol_max_len(size_t len, int force_lf);
 
 #if defined(__linux__) || defined(__APPLE__)
 
@@ -205,18 +263,32 @@ extern int mkdirs(const char *path);
 
 /*
  * Get a list of files in the directory at the path given by dirname.
+ * The list is allocated from the arena mem if it is not NULL. Otherwise, the list is allocated with malloc.
  * returns the list of files on success or NULL on failure
  */
-extern list2 *list_dir(const char *dirname);
+extern list2 *list_dir(const char *dirname, arena *mem);
 
 /*
  * Accepts a valid pointer to a dir_files structure
  * Get copied files and directories from the clipboard.
- * Only regular files are included in the file list.
+ * Only regular files are included in the path store.
  * Set the path_len to the length of path name of the directory which the files are copied.
- * Sets directories and files in dfiles_p on success and sets the path_len to 0 and file list to NULL on failure.
+ * If budget is not NULL, the walk is stopped as soon as any of its limits is exceeded, which is a failure.
+ * Sets directories and files in dfiles_p on success and sets the path_len to 0 and path store to NULL on failure.
+ * The path store should be freed with free_path_store().
  */
-extern void get_copied_dirs_files(dir_files *dfiles_p, int include_leaf_dirs);
+extern void get_copied_dirs_files(dir_files *dfiles_p, int include_leaf_dirs, const walk_budget *budget);
+
+#if (defined(__linux__) || defined(__APPLE__)) && (PROTOCOL_MIN <= 5) && (5 <= PROTOCOL_MAX)
+/*
+ * Get copied files and directories from the clipboard as a stream.
+ * The directories are walked on a separate thread while the paths are taken from the stream. The paths are produced
+ * with the same rules as get_copied_dirs_files().
+ * Set the path_len to the length of path name of the directory which the files are copied.
+ * Returns the stream on success, which must be closed with close_dir_stream(). Otherwise, returns NULL.
+ */
+extern dir_stream *get_copied_dirs_stream(size_t *path_len_p, int include_leaf_dirs, const walk_budget *budget);
+#endif
 
 #if defined(__linux__) || defined(__APPLE__)
 
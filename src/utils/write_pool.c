@@ -0,0 +1,204 @@
+/*
+ * utils/write_pool.c - writing small files in background threads
+ * Copyright (C) 2026 H. Thevindu J. Wijesekera
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#if defined(__linux__) || defined(__APPLE__)
+
+#ifdef __linux__
+#define _GNU_SOURCE  // for sync_file_range
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <utils/file_io.h>
+#include <utils/write_pool.h>
+
+typedef struct _write_job {
+    struct _write_job *next;
+    char *path;  // points into the same allocation after the data
+    size_t size;
+    char data[];
+} write_job;
+
+struct _write_pool {
+    pthread_mutex_t lock;
+    pthread_cond_t has_job;    // signalled when a job is queued or the pool is stopping
+    pthread_cond_t has_space;  // signalled when a job is completed
+    write_job *head;
+    write_job *tail;
+    write_job *cur;  // job of the buffer held by the caller
+    size_t budget;
+    size_t used;       // data size of the held, queued, and running jobs
+    uint32_t pending;  // number of queued and running jobs
+    int8_t stop;
+    int8_t failed;
+    int sync_mode;
+    uint32_t thread_cnt;
+    pthread_t threads[];
+};
+
+static int _write_file(const write_job *job, int sync_mode) {
+    int fd = open(job->path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0666);
+    if (fd < 0) return EXIT_FAILURE;
+    const char *ptr = job->data;
+    size_t remaining = job->size;
+    while (remaining) {
+        ssize_t written = write(fd, ptr, remaining);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            close(fd);
+            remove(job->path);
+            return EXIT_FAILURE;
+        }
+        ptr += written;
+        remaining -= (size_t)written;
+    }
+#ifdef __linux__
+    if (sync_mode == WRITE_POOL_WRITE_BACK) (void)sync_file_range(fd, 0, 0, SYNC_FILE_RANGE_WRITE);
+#endif
+    int status = sync_mode == WRITE_POOL_SYNC ? sync_fd(fd) : EXIT_SUCCESS;
+    if (close(fd)) status = EXIT_FAILURE;
+    if (status != EXIT_SUCCESS) remove(job->path);
+    return status;
+}
+
+static void *_worker(void *arg) {
+    write_pool *pool = (write_pool *)arg;
+    pthread_mutex_lock(&(pool->lock));
+    while (1) {
+        while (!pool->head && !pool->stop) pthread_cond_wait(&(pool->has_job), &(pool->lock));
+        write_job *job = pool->head;
+        if (!job) break;  // stopping and no more jobs
+        pool->head = job->next;
+        if (!pool->head) pool->tail = NULL;
+        const int8_t skip = pool->failed;  // remaining files are not needed after a failure
+        pthread_mutex_unlock(&(pool->lock));
+
+        int status = skip ? EXIT_FAILURE : _write_file(job, pool->sync_mode);
+#ifdef DEBUG_MODE
+        if (status != EXIT_SUCCESS) printf("Writing file failed : %s\n", job->path);
+#endif
+
+        pthread_mutex_lock(&(pool->lock));
+        if (status != EXIT_SUCCESS) pool->failed = 1;
+        pool->used -= job->size;
+        pool->pending--;
+        pthread_cond_broadcast(&(pool->has_space));
+        free(job);
+    }
+    pthread_mutex_unlock(&(pool->lock));
+    return NULL;
+}
+
+write_pool *new_write_pool(uint32_t thread_cnt, size_t budget, int sync_mode) {
+    if (thread_cnt == 0) thread_cnt = 1;
+    write_pool *pool = (write_pool *)calloc(1, sizeof(write_pool) + thread_cnt * sizeof(pthread_t));
+    if (!pool) return NULL;
+    pool->budget = budget;
+    pool->sync_mode = sync_mode;
+    if (pthread_mutex_init(&(pool->lock), NULL)) {
+        free(pool);
+        return NULL;
+    }
+    pthread_cond_init(&(pool->has_job), NULL);
+    pthread_cond_init(&(pool->has_space), NULL);
+    for (; pool->thread_cnt < thread_cnt; pool->thread_cnt++) {
+        if (pthread_create(pool->threads + pool->thread_cnt, NULL, &_worker, pool)) break;
+    }
+    if (pool->thread_cnt == 0) {
+        free_write_pool(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+char *write_pool_buf(write_pool *pool, const char *path, size_t size) {
+    const size_t path_len = strlen(path);
+    write_job *job = (write_job *)malloc(sizeof(write_job) + size + path_len + 1);
+    if (!job) return NULL;
+    job->next = NULL;
+    job->size = size;
+    job->path = job->data + size;
+    memcpy(job->path, path, path_len + 1);
+
+    pthread_mutex_lock(&(pool->lock));
+    // a file larger than the budget is allowed only when no other data is held
+    while (!pool->failed && pool->used > 0 && pool->used + size > pool->budget) {
+        pthread_cond_wait(&(pool->has_space), &(pool->lock));
+    }
+    if (pool->failed) {
+        pthread_mutex_unlock(&(pool->lock));
+        free(job);
+        return NULL;
+    }
+    pool->used += size;
+    pool->cur = job;
+    pthread_mutex_unlock(&(pool->lock));
+    return job->data;
+}
+
+void write_pool_submit(write_pool *pool) {
+    pthread_mutex_lock(&(pool->lock));
+    write_job *job = pool->cur;
+    pool->cur = NULL;
+    if (pool->tail) {
+        pool->tail->next = job;
+    } else {
+        pool->head = job;
+    }
+    pool->tail = job;
+    pool->pending++;
+    pthread_cond_signal(&(pool->has_job));
+    pthread_mutex_unlock(&(pool->lock));
+}
+
+void write_pool_discard(write_pool *pool) {
+    pthread_mutex_lock(&(pool->lock));
+    write_job *job = pool->cur;
+    pool->cur = NULL;
+    if (job) pool->used -= job->size;
+    pthread_mutex_unlock(&(pool->lock));
+    free(job);
+}
+
+int write_pool_wait(write_pool *pool) {
+    pthread_mutex_lock(&(pool->lock));
+    while (pool->pending > 0) pthread_cond_wait(&(pool->has_space), &(pool->lock));
+    int status = pool->failed ? EXIT_FAILURE : EXIT_SUCCESS;
+    pthread_mutex_unlock(&(pool->lock));
+    return status;
+}
+
+void free_write_pool(write_pool *pool) {
+    write_pool_discard(pool);
+    pthread_mutex_lock(&(pool->lock));
+    pool->stop = 1;
+    pthread_cond_broadcast(&(pool->has_job));
+    pthread_mutex_unlock(&(pool->lock));
+    for (uint32_t i = 0; i < pool->thread_cnt; i++) pthread_join(pool->threads[i], NULL);
+    pthread_cond_destroy(&(pool->has_job));
+    pthread_cond_destroy(&(pool->has_space));
+    pthread_mutex_destroy(&(pool->lock));
+    free(pool);
+}
+
+#endif
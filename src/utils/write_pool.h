@@ -0,0 +1,75 @@
+/*
+ * utils/write_pool.h - header for writing small files in background threads
+ * Copyright (C) 2026 H. Thevindu J. Wijesekera
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef UTILS_WRITE_POOL_H_
+#define UTILS_WRITE_POOL_H_
+
+#if defined(__linux__) || defined(__APPLE__)
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define WRITE_POOL_WRITE_BACK 1  // start writing back each file to the storage after writing it
+#define WRITE_POOL_SYNC 2        // sync each file to the storage after writing it
+
+/*
+ * Pool of threads which create and write small files while the caller keeps receiving data.
+ * Data of the queued files is limited by a memory budget.
+ * Parent directories must exist before a file is submitted. Each file is created only if it does not exist.
+ * Only one thread may submit files to a pool.
+ */
+typedef struct _write_pool write_pool;
+
+/*
+ * Creates a pool of thread_cnt threads, which keeps at most budget bytes of file data in memory.
+ * sync_mode is WRITE_POOL_WRITE_BACK, WRITE_POOL_SYNC, or 0 to leave writing back the files to the system.
+ * returns the pool on success or NULL on failure.
+ */
+extern write_pool *new_write_pool(uint32_t thread_cnt, size_t budget, int sync_mode);
+
+/*
+ * Get a buffer for the data of the file at path of size bytes, waiting until it fits in the memory budget.
+ * The file is written only after calling write_pool_submit(). Only one buffer may be held at a time.
+ * returns the buffer on success or NULL on failure or if writing a previously submitted file has failed.
+ */
+extern char *write_pool_buf(write_pool *pool, const char *path, size_t size);
+
+/*
+ * Queues the file from the last write_pool_buf() call to be written.
+ */
+extern void write_pool_submit(write_pool *pool);
+
+/*
+ * Releases the buffer from the last write_pool_buf() call without writing it.
+ */
+extern void write_pool_discard(write_pool *pool);
+
+/*
+ * Waits until all the submitted files are written.
+ * returns EXIT_SUCCESS if all the files were written successfully and EXIT_FAILURE otherwise.
+ */
+extern int write_pool_wait(write_pool *pool);
+
+/*
+ * Waits for the submitted files, stops the threads, and frees the pool.
+ */
+extern void free_write_pool(write_pool *pool);
+
+#endif
+
+#endif  // UTILS_WRITE_POOL_H_
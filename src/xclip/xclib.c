@@ -17,7 +17,7 @@
  *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
  */
 /*
- *  2022-2024 Modified by H. Thevindu J. Wijesekera
+ *  2022-2026 Modified by H. Thevindu J. Wijesekera
  */
 
 #include <X11/Xatom.h>
@@ -71,6 +71,33 @@ static size_t mach_itemsize(int format) {
     return 0;
 }
 
+/* Largest property read at once, in 32-bit units. Large enough to read any
+ * property completely, so that it can be deleted in the same request. */
+#define PROPERTY_READ_LEN 0x1FFFFFFFL
+
+/* Make space for at least len bytes of data and a terminating null byte in
+ * ctx->buf. The buffer grows geometrically, but never beyond the size limit
+ * of xcrealloc() unless the data needs it. */
+static void xcout_reserve(xcout_ctx *ctx, unsigned long len) {
+    if (len <= ctx->cap && ctx->buf) return;
+    /* xcrealloc() accepts up to limit bytes, including the terminating null byte */
+    unsigned long limit = configuration.max_text_length;
+    if (limit < MAX_BUF_LEN) limit = MAX_BUF_LEN;
+    unsigned long cap = ctx->cap * 2;
+    if (cap >= limit) cap = limit - 1;
+    if (cap < len) cap = len;
+    ctx->buf = (unsigned char *)xcrealloc(ctx->buf, cap + 1);
+    ctx->cap = cap;
+}
+
+void xcout_init(xcout_ctx *ctx, Display *dpy) {
+    memset(ctx, 0, sizeof(xcout_ctx));
+    ctx->context = XCLIB_XCOUT_NONE;
+    /* Xlib caches interned atoms. Therefore, these do not need a round trip after the first time */
+    ctx->pty = XInternAtom(dpy, "XCLIP_OUT", False);
+    ctx->inc = XInternAtom(dpy, "INCR", False);
+}
+
 /* Retrieves the contents of a selections. Arguments are:
  *
  * A display that has been opened.
@@ -85,20 +112,14 @@ static size_t mach_itemsize(int format) {
  *
  * A pointer to an atom that receives the type of the data
  *
- * A pointer to a char array to put the selection into.
- *
- * A pointer to a long to record the length of the char array
- *
- * A pointer to an int to record the context in which to process the event
+ * The transfer context initialised with xcout_init(). The received data is
+ * put into ctx->buf, with ctx->len bytes and space for a terminating null
+ * byte. ctx->context records the context in which to process the event.
  *
  * Return value is 1 if the retrieval of the selection data is complete,
  * otherwise it's 0.
  */
-int xcout(Display *dpy, Window win, XEvent evt, Atom sel, Atom target, Atom *type, unsigned char **txt_p,
-          unsigned long *len_p, unsigned int *context) {
-    /* a property for other windows to put their selection into */
-    static Atom pty;
-    static Atom inc;
+int xcout(Display *dpy, Window win, XEvent evt, Atom sel, Atom target, Atom *type, xcout_ctx *ctx) {
     int pty_format;
 
     /* buffer for XGetWindowProperty to dump data into */
@@ -107,29 +128,18 @@ int xcout(Display *dpy, Window win, XEvent evt, Atom sel, Atom target, Atom *typ
     unsigned long pty_items;
     unsigned long pty_machsize;
 
-    /* local buffer of text to return */
-    unsigned char *ltxt = *txt_p;
-
-    if (!pty) {
-        pty = XInternAtom(dpy, "XCLIP_OUT", False);
-    }
-
-    if (!inc) {
-        inc = XInternAtom(dpy, "INCR", False);
-    }
-
-    switch (*context) {
+    switch (ctx->context) {
         /* there is no context, do an XConvertSelection() */
         case XCLIB_XCOUT_NONE: {
             /* initialise return length to 0 */
-            if (*len_p > 0) {
-                free(*txt_p);
-                *len_p = 0;
-            }
+            if (ctx->buf) free(ctx->buf);
+            ctx->buf = NULL;
+            ctx->len = 0;
+            ctx->cap = 0;
 
             /* send a selection request */
-            XConvertSelection(dpy, sel, target, pty, win, CurrentTime);
-            *context = XCLIB_XCOUT_SENTCONVSEL;
+            XConvertSelection(dpy, sel, target, ctx->pty, win, CurrentTime);
+            ctx->context = XCLIB_XCOUT_SENTCONVSEL;
             return 0;
         }
         case XCLIB_XCOUT_SENTCONVSEL: {
@@ -137,49 +147,47 @@ int xcout(Display *dpy, Window win, XEvent evt, Atom sel, Atom target, Atom *typ
 
             /* return failure when the current target failed */
             if (evt.xselection.property == None) {
-                *context = XCLIB_XCOUT_BAD_TARGET;
-                return 0;
-            }
-
-            /* find the size and format of the data in property */
-            XGetWindowProperty(dpy, win, pty, 0, 0, False, AnyPropertyType, type, &pty_format, &pty_items, &pty_size,
-                               &buffer);
-            if (buffer) XFree(buffer);
-
-            if (*type == inc) {
-                /* start INCR mechanism by deleting property */
-                XDeleteProperty(dpy, win, pty);
-                XFlush(dpy);
-                *context = XCLIB_XCOUT_INCR;
+                ctx->context = XCLIB_XCOUT_BAD_TARGET;
                 return 0;
             }
 
-            /* not using INCR mechanism, just read the property */
-            XGetWindowProperty(dpy, win, pty, 0, (long)pty_size, False, AnyPropertyType, type, &pty_format, &pty_items,
-                               &pty_size, &buffer);
-
-            /* finished with property, delete it */
-            XDeleteProperty(dpy, win, pty);
+            /* read the whole property and delete it in the same request.
+             * For INCR, deleting the property starts the transfer */
+            XGetWindowProperty(dpy, win, ctx->pty, 0, PROPERTY_READ_LEN, True, AnyPropertyType, type, &pty_format,
+                               &pty_items, &pty_size, &buffer);
 
             /* compute the size of the data buffer we received */
             pty_machsize = pty_items * mach_itemsize(pty_format);
 
-            /* copy the buffer to the pointer for returned data */
+            if (*type == ctx->inc) {
+                /* the property holds a lower bound of the size of the
+                 * selection. Allocate that much up front, unless it is
+                 * beyond the size limit */
+                if (buffer && pty_format == 32 && pty_items > 0) {
+                    const unsigned long hint = (unsigned long)(((const long *)(void *)buffer)[0] & 0xFFFFFFFFL);
+                    if (hint > 0 && (hint < MAX_BUF_LEN || hint < configuration.max_text_length)) {
+                        ctx->buf = (unsigned char *)xcmalloc(hint + 1);
+                        ctx->cap = hint;
+                    }
+                }
+                if (buffer) XFree(buffer);
+                ctx->context = XCLIB_XCOUT_INCR;
+                return 0;
+            }
+
+            /* copy the buffer to the returned data, with space for a terminating null byte */
             if (pty_machsize > 0) {
-                ltxt = (unsigned char *)xcmalloc(pty_machsize);
-                memcpy(ltxt, buffer, pty_machsize);
-            } else {
-                ltxt = NULL;
+                xcout_reserve(ctx, pty_machsize);
+                memcpy(ctx->buf, buffer, pty_machsize);
             }
 
             /* set the length of the returned data */
-            *len_p = pty_machsize;
-            *txt_p = ltxt;
+            ctx->len = pty_machsize;
 
             /* free the buffer */
             if (buffer) XFree(buffer);
 
-            *context = XCLIB_XCOUT_NONE;
+            ctx->context = XCLIB_XCOUT_NONE;
 
             /* complete contents of selection fetched, return 1 */
             return 1;
@@ -197,15 +205,18 @@ int xcout(Display *dpy, Window win, XEvent evt, Atom sel, Atom target, Atom *typ
             /* skip unless the property has a new value */
             if (evt.xproperty.state != PropertyNewValue) return 0;
 
-            /* check size and format of the property */
-            XGetWindowProperty(dpy, win, pty, 0, 0, False, AnyPropertyType, type, &pty_format, &pty_items, &pty_size,
-                               &buffer);
+            /* read the chunk and delete the property in the same request,
+             * which asks the owner for the next chunk */
+            XGetWindowProperty(dpy, win, ctx->pty, 0, PROPERTY_READ_LEN, True, AnyPropertyType, type, &pty_format,
+                               &pty_items, &pty_size, &buffer);
 
-            if (pty_size == 0) {
+            /* compute the size of the data buffer we received */
+            pty_machsize = pty_items * mach_itemsize(pty_format);
+
+            if (pty_machsize == 0) {
                 /* no more data, exit from loop */
                 if (buffer) XFree(buffer);
-                XDeleteProperty(dpy, win, pty);
-                *context = XCLIB_XCOUT_NONE;
+                ctx->context = XCLIB_XCOUT_NONE;
 
                 /* this means that an INCR transfer is now
                  * complete, return 1
@@ -213,37 +224,12 @@ int xcout(Display *dpy, Window win, XEvent evt, Atom sel, Atom target, Atom *typ
                 return 1;
             }
 
-            if (buffer) XFree(buffer);
-
-            /* if we have come this far, the propery contains
-             * text, we know the size.
-             */
-            XGetWindowProperty(dpy, win, pty, 0, (long)pty_size, False, AnyPropertyType, type, &pty_format, &pty_items,
-                               &pty_size, &buffer);
-
-            /* compute the size of the data buffer we received */
-            pty_machsize = pty_items * mach_itemsize(pty_format);
+            /* append the chunk to the data received so far */
+            xcout_reserve(ctx, ctx->len + pty_machsize);
+            memcpy(ctx->buf + ctx->len, buffer, pty_machsize);
+            ctx->len += pty_machsize;
 
-            /* allocate memory to accommodate data in *txt */
-            if (pty_machsize > 0) {
-                if (*len_p == 0) {
-                    *len_p = pty_machsize;
-                    ltxt = (unsigned char *)xcmalloc(*len_p);
-                } else {
-                    *len_p += pty_machsize;
-                    ltxt = (unsigned char *)xcrealloc(ltxt, *len_p);
-                }
-
-                /* add data to ltxt */
-                memcpy(&ltxt[*len_p - pty_machsize], buffer, pty_machsize);
-            }
-
-            *txt_p = ltxt;
             if (buffer) XFree(buffer);
-
-            /* delete property to get the next item */
-            XDeleteProperty(dpy, win, pty);
-            XFlush(dpy);
             return 0;
         }
         default:
@@ -253,6 +239,20 @@ int xcout(Display *dpy, Window win, XEvent evt, Atom sel, Atom target, Atom *typ
     return 0;
 }
 
+void xcin_init(xcin_ctx *ctx, Display *dpy) {
+    memset(ctx, 0, sizeof(xcin_ctx));
+    ctx->context = XCLIB_XCIN_NONE;
+    ctx->targets = XInternAtom(dpy, "TARGETS", False);
+    ctx->inc = XInternAtom(dpy, "INCR", False);
+
+    /* We consider selections larger than a quarter of the maximum
+       request size to be "large". See ICCCM section 2.5 */
+    ctx->chunk_size = XExtendedMaxRequestSize(dpy) / 4;
+    if (!ctx->chunk_size) {
+        ctx->chunk_size = XMaxRequestSize(dpy) / 4;
+    }
+}
+
 /* put data into a selection, in response to a SelecionRequest event from
  * another window (and any subsequent events relating to an INCR transfer).
  *
@@ -260,82 +260,59 @@ int xcout(Display *dpy, Window win, XEvent evt, Atom sel, Atom target, Atom *typ
  *
  * A display
  *
- * A window
- *
  * The event to respond to
  *
- * A pointer to an Atom. This gets set to the property nominated by the other
- * app in it's SelectionRequest. Things are likely to break if you change the
- * value of this yourself.
- *
  * The target(UTF8_STRING or XA_STRING) to respond to
  *
- * A pointer to an array of chars to read selection data from.
+ * A pointer to an array of chars to read selection data from. The chunks of
+ * an INCR transfer are sent directly from this array, which must not change
+ * until the transfer is complete.
  *
  * The length of the array of chars.
  *
- * In the case of an INCR transfer, the position within the array of chars
- * that is being processed.
- *
- * The context that event is the be processed within.
+ * The transfer context initialised with xcin_init(). It records the window
+ * and the property nominated by the other app in it's SelectionRequest, the
+ * position within the array of chars that is being processed in the case of
+ * an INCR transfer, and the context that event is the be processed within.
  */
-int xcin(Display *dpy, Window *win, XEvent evt, Atom *pty, Atom target, const unsigned char *txt, unsigned long len,
-         unsigned long *pos, unsigned int *context) {
+int xcin(Display *dpy, XEvent evt, Atom target, const unsigned char *txt, unsigned long len, xcin_ctx *ctx) {
     unsigned long chunk_len;  // length of current chunk (for incr transfers only)
     XEvent res;               // response to event
-    static Atom inc;
-    static Atom targets;
-    static long chunk_size;
 
-    if (!targets) {
-        targets = XInternAtom(dpy, "TARGETS", False);
-    }
-
-    if (!inc) {
-        inc = XInternAtom(dpy, "INCR", False);
-    }
-
-    /* We consider selections larger than a quarter of the maximum
-       request size to be "large". See ICCCM section 2.5 */
-    if (!chunk_size) {
-        chunk_size = XExtendedMaxRequestSize(dpy) / 4;
-        if (!chunk_size) {
-            chunk_size = XMaxRequestSize(dpy) / 4;
-        }
-    }
-
-    switch (*context) {
+    switch (ctx->context) {
         case XCLIB_XCIN_NONE: {
             if (evt.type != SelectionRequest) return 0;
 
             /* set the window and property that is being used */
-            *win = evt.xselectionrequest.requestor;
-            *pty = evt.xselectionrequest.property;
+            ctx->win = evt.xselectionrequest.requestor;
+            ctx->pty = evt.xselectionrequest.property;
 
             /* reset position to 0 */
-            *pos = 0;
+            ctx->pos = 0;
 
             /* put the data into an property */
-            if (evt.xselectionrequest.target == targets) {
-                Atom types[2] = {targets, target};
+            if (evt.xselectionrequest.target == ctx->targets) {
+                Atom types[2] = {ctx->targets, target};
 
                 /* send data all at once (not using INCR) */
-                XChangeProperty(dpy, *win, *pty, XA_ATOM, 32, PropModeReplace, (unsigned char *)types,
+                XChangeProperty(dpy, ctx->win, ctx->pty, XA_ATOM, 32, PropModeReplace, (unsigned char *)types,
                                 (int)(sizeof(types) / sizeof(Atom)));
-            } else if ((long)len > chunk_size) {
-                /* send INCR response */
-                XChangeProperty(dpy, *win, *pty, inc, 32, PropModeReplace, 0, 0);
+            } else if ((long)len > ctx->chunk_size) {
+                /* send INCR response with the size of the data as the lower bound */
+                long size = len > 0xFFFFFFFFUL ? 0xFFFFFFFFL : (long)len;
+                XChangeProperty(dpy, ctx->win, ctx->pty, ctx->inc, 32, PropModeReplace, (unsigned char *)&size, 1);
 
                 /* With the INCR mechanism, we need to know
                  * when the requestor window changes (deletes)
-                 * its properties
+                 * its properties, or when it is destroyed
+                 * without completing the transfer
                  */
-                XSelectInput(dpy, *win, PropertyChangeMask);
+                XSelectInput(dpy, ctx->win, PropertyChangeMask | StructureNotifyMask);
 
-                *context = XCLIB_XCIN_INCR;
+                ctx->context = XCLIB_XCIN_INCR;
             } else {
                 /* send data all at once (not using INCR) */
-                XChangeProperty(dpy, *win, *pty, target, 8, PropModeReplace, txt, (int)len);
+                XChangeProperty(dpy, ctx->win, ctx->pty, target, 8, PropModeReplace, txt, (int)len);
             }
 
             /* Perhaps FIXME: According to ICCCM section 2.5, we should
@@ -345,10 +322,10 @@ int xcin(Display *dpy, Window *win, XEvent evt, Atom *pty, Atom target, const un
        variable, plus doing XSync after each XChangeProperty. */
 
             /* set values for the response event */
-            res.xselection.property = *pty;
+            res.xselection.property = ctx->pty;
             res.xselection.type = SelectionNotify;
             res.xselection.display = evt.xselectionrequest.display;
-            res.xselection.requestor = *win;
+            res.xselection.requestor = ctx->win;
             res.xselection.selection = evt.xselectionrequest.selection;
             res.xselection.target = evt.xselectionrequest.target;
             res.xselection.time = evt.xselectionrequest.time;
@@ -358,18 +335,22 @@ int xcin(Display *dpy, Window *win, XEvent evt, Atom *pty, Atom target, const un
             XFlush(dpy);
 
             /* don't treat TARGETS request as contents request */
-            if (evt.xselectionrequest.target == targets) return 0;
+            if (evt.xselectionrequest.target == ctx->targets) return 0;
 
             /* if len < chunk_size, then the data was sent all at
              * once and the transfer is now complete, return 1
              */
-            if ((long)len > chunk_size)
+            if ((long)len > ctx->chunk_size)
                 return 0;
             else
                 return 1;
         }
         case XCLIB_XCIN_INCR: {
-            /* length of current chunk */
+            /* the requestor is gone, and will never delete the property */
+            if (evt.type == DestroyNotify && evt.xdestroywindow.window == ctx->win) {
+                ctx->context = XCLIB_XCIN_NONE;
+                return 0;
+            }
 
             /* ignore non-property events */
             if (evt.type != PropertyNotify) return 0;
@@ -379,36 +360,30 @@ int xcin(Display *dpy, Window *win, XEvent evt, Atom *pty, Atom target, const un
              */
             if (evt.xproperty.state != PropertyDelete) return 0;
 
-            /* set the chunk length to the maximum size */
-            chunk_len = (unsigned long)chunk_size;
-
-            /* if a chunk length of maximum size would extend
-             * beyond the end of txt, set the length to be the
-             * remaining length of txt
-             */
-            if ((*pos + chunk_len) > len) chunk_len = len - *pos;
-
-            /* if the start of the chunk is beyond the end of txt,
-             * then we've already sent all the data, so set the
-             * length to be zero
+            /* set the chunk length to the maximum size, or the
+             * remaining length of txt if a chunk of maximum size
+             * would extend beyond the end of txt. If the start of
+             * the chunk is beyond the end of txt, then we've
+             * already sent all the data, so the length is zero
              */
-            if (*pos > len) chunk_len = 0;
+            chunk_len = ctx->pos < len ? len - ctx->pos : 0;
+            if (chunk_len > (unsigned long)ctx->chunk_size) chunk_len = (unsigned long)ctx->chunk_size;
 
             if (chunk_len) {
-                /* put the chunk into the property */
-                XChangeProperty(dpy, *win, *pty, target, 8, PropModeReplace, &txt[*pos], (int)chunk_len);
+                /* put the chunk into the property, directly from txt */
+                XChangeProperty(dpy, ctx->win, ctx->pty, target, 8, PropModeReplace, txt + ctx->pos, (int)chunk_len);
             } else {
                 /* make an empty property to show we've
                  * finished the transfer
                  */
-                XChangeProperty(dpy, *win, *pty, target, 8, PropModeReplace, 0, 0);
+                XChangeProperty(dpy, ctx->win, ctx->pty, target, 8, PropModeReplace, 0, 0);
             }
             XFlush(dpy);
 
             /* all data has been sent, break out of the loop */
-            if (!chunk_len) *context = XCLIB_XCIN_NONE;
+            if (!chunk_len) ctx->context = XCLIB_XCIN_NONE;
 
-            *pos += (unsigned long)chunk_size;
+            ctx->pos += chunk_len;
 
             /* if chunk_len == 0, we just finished the transfer,
              * return 1
@@ -423,3 +398,14 @@ int xcin(Display *dpy, Window *win, XEvent evt, Atom *pty, Atom target, const un
     }
     return 0;
 }
+
+/* abandon the INCR transfer in progress, if any, so that the context can
+ * be used for the next SelectionRequest. The requestor window is no longer
+ * watched for events.
+ */
+void xcin_abort(Display *dpy, xcin_ctx *ctx) {
+    if (ctx->context != XCLIB_XCIN_INCR) return;
+    XSelectInput(dpy, ctx->win, NoEventMask);
+    XFlush(dpy);
+    ctx->context = XCLIB_XCIN_NONE;
+}
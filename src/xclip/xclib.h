@@ -17,7 +17,7 @@
  *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
  */
 /*
- *  2022-2023 Modified by H. Thevindu J. Wijesekera
+ *  2022-2026 Modified by H. Thevindu J. Wijesekera
  */
 
 #ifndef XCLIP_XCLIB_H_
@@ -37,10 +37,33 @@
 #define XCLIB_XCIN_SELREQ 1
 #define XCLIB_XCIN_INCR 2
 
+/* state of a transfer by xcout() */
+typedef struct _xcout_ctx {
+    unsigned int context; /* one of the xcout() contexts */
+    Atom pty;             /* property for other windows to put their selection into */
+    Atom inc;
+    unsigned char *buf; /* received data */
+    unsigned long len;  /* length of the received data */
+    unsigned long cap;  /* allocated length of buf, excluding the space for a terminating null byte */
+} xcout_ctx;
+
+/* state of a transfer by xcin() */
+typedef struct _xcin_ctx {
+    unsigned int context; /* one of the xcin() contexts */
+    Window win;           /* requestor window */
+    Atom pty;             /* property nominated by the requestor */
+    unsigned long pos;    /* position of the next chunk of an INCR transfer */
+    Atom inc;
+    Atom targets;
+    long chunk_size;
+} xcin_ctx;
+
 /* functions in xclib.c */
-extern int xcout(Display *, Window, XEvent, Atom, Atom, Atom *, unsigned char **, unsigned long *, unsigned int *);
-extern int xcin(Display *, Window *, XEvent, Atom *, Atom, const unsigned char *, unsigned long, unsigned long *,
-                unsigned int *);
+extern void xcout_init(xcout_ctx *, Display *);
+extern int xcout(Display *, Window, XEvent, Atom, Atom, Atom *, xcout_ctx *);
+extern void xcin_init(xcin_ctx *, Display *);
+extern int xcin(Display *, XEvent, Atom, const unsigned char *, unsigned long, xcin_ctx *);
+extern void xcin_abort(Display *, xcin_ctx *);
 extern void *xcmalloc(size_t);
 extern void *xcrealloc(void *, size_t);
 
@@ -17,12 +17,24 @@
  *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
  */
 /*
- *  2022-2024 Modified by H. Thevindu J. Wijesekera
+ *  2022-2026 Modified by H. Thevindu J. Wijesekera
+ */
+
+/*
+ * Threading:
+ * - Each thread reads the clipboard through a connection of its own (xclip_conn). The clipboard owner, resident or
+ *   not, also has its own connection. Therefore, no Display is used by more than one thread, and the state of each
+ *   transfer is kept in the xcout_ctx or xcin_ctx of the caller.
+ * - The process-wide state is the snapshot, guarded by snapshot_lock, and the offered item and the wake pipe, guarded
+ *   by owner_lock. A thread never holds both locks, and never calls Xlib while holding either of them.
+ * - xclip_init() makes Xlib thread-safe and installs the error handler before the first connection is opened.
  */
 
 #include <X11/Xatom.h>
 #include <X11/Xlib.h>
-#include <X11/Xmu/Atoms.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -34,205 +46,606 @@
 typedef struct _xclip_options {
     Atom sseln; /* X selection to work with */
     Atom target;
+    Atom utf8;    /* UTF8_STRING atom of the connection, which falls back to XA_STRING */
     Display *dpy; /* connection to X11 display */
-    char is_targets;
 } xclip_options;
 
-static int doIn(Window win, unsigned long len, const char *buf, xclip_options *options) {
-    unsigned char *sel_buf = NULL; /* buffer for selection data */
-    unsigned long sel_len = len;   /* length of sel_buf */
-    XEvent evt;                    /* X Event Structures */
+/* number of target atoms whose copied type is remembered for a connection */
+#define TARGET_CACHE_LEN 128
 
-    /* in mode */
-    sel_buf = xcmalloc(sel_len * sizeof(char));
-    memcpy(sel_buf, buf, sel_len);
+typedef struct _target_class {
+    Atom atom;
+    int8_t copied_type;
+} target_class;
 
-    /* Handle cut buffer if needed */
-    if (options->sseln == XA_STRING) {
-        XStoreBuffer(options->dpy, (char *)sel_buf, (int)sel_len, 0);
-        free(sel_buf);
-        return EXIT_SUCCESS;
-    }
-
-    /* take control of the selection so that we receive
-     * SelectionRequest events from other windows
-     */
-    /* FIXME: Should not use CurrentTime, according to ICCCM section 2.1 */
-    XSetSelectionOwner(options->dpy, options->sseln, win, CurrentTime);
+/* indices of the atoms interned once for each connection, in the order of _atom_names */
+#define ATOM_CLIPBOARD 0
+#define ATOM_UTF8_STRING 1
+#define ATOM_TARGETS 2
+#define ATOM_COPIED_FILES 3
+#define ATOM_TEXT 4
+#define ATOM_PLAIN 5
+#define ATOM_PLAIN_UTF8 6
+#define ATOM_CNT 7
 
-    /* Avoid making the current directory in use, in case it will need to be umounted */
-    if (chdir("/") == -1) {
-        free(sel_buf);
-        return EXIT_FAILURE;
-    }
-
-    /* loop and wait for the expected number of
-     * SelectionRequest events
-     */
-    while (1) {
-        /* wait for a SelectionRequest event */
-        while (1) {
-            static unsigned int clear = 0;
-            static unsigned int context = XCLIB_XCIN_NONE;
-            static unsigned long sel_pos = 0;
-            static Window cwin;
-            static Atom pty;
-            int finished;
+static char _atom_names[ATOM_CNT][32] = {"CLIPBOARD", "UTF8_STRING", "TARGETS", "x-special/gnome-copied-files", "TEXT",
+                                         "text/plain", "text/plain;charset=utf-8"};
 
-            XNextEvent(options->dpy, &evt);
-
-            finished = xcin(options->dpy, &cwin, evt, &pty, options->target, sel_buf, sel_len, &sel_pos, &context);
+/*
+ * A connection to the X server, with a window to receive the selection, kept open for reading the clipboard.
+ * Each thread has its own connection, which is closed when the thread exits.
+ */
+typedef struct _xclip_conn {
+    Display *dpy;
+    Window win;
+    pid_t pid; /* a child process does not use the connection inherited from its parent */
+    Atom atoms[ATOM_CNT];
+    target_class targets[TARGET_CACHE_LEN];
+} xclip_conn;
+
+static pthread_key_t conn_key;
+static pthread_once_t conn_key_once = PTHREAD_ONCE_INIT;
+
+typedef struct _snapshot_item {
+    char *data;
+    uint32_t len;
+    char valid;
+} snapshot_item;
 
-            if (evt.type == SelectionClear) clear = 1;
+/*
+ * Snapshot of the clipboard content, shared by all threads. It is used only while the clipboard listener reports the
+ * selection owner changes, which invalidate it. Items are filled lazily when they are first read after a change.
+ */
+typedef struct _clip_snapshot {
+    char enabled;
+    char type_valid;
+    int8_t copied_type;
+    unsigned long generation; /* incremented on each owner change */
+    unsigned long owner;
+    unsigned long timestamp;
+    snapshot_item text;
+    snapshot_item files;
+} clip_snapshot;
+
+static pthread_mutex_t snapshot_lock = PTHREAD_MUTEX_INITIALIZER;
+static clip_snapshot snapshot;
+
+typedef struct _owner_item {
+    char *data;
+    unsigned long len;
+    const char *atom_name; /* target of the data, or NULL for UTF8_STRING */
+} owner_item;
+
+/* the latest item offered to the clipboard owner and not taken yet */
+static pthread_mutex_t owner_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t owner_cond = PTHREAD_COND_INITIALIZER;
+static owner_item offered;
+static int wake_pipe[2] = {-1, -1}; /* written to wake the resident owner while it waits for X events */
+static pthread_once_t owner_once = PTHREAD_ONCE_INIT;
+static pthread_once_t init_once = PTHREAD_ONCE_INIT;
+
+/* an INCR transfer is abandoned if the requestor does not ask for the next chunk within this time */
+#define INCR_TIMEOUT_MS 10000
+
+/* resource of the last failed request made by this thread. Each Display is used by one thread, which also runs the
+ * error handler for its requests */
+static _Thread_local XID failed_resource = None;
 
-            if ((context == XCLIB_XCIN_NONE) && clear) {
-                free(sel_buf);
-                return EXIT_SUCCESS;
-            }
+/*
+ * Errors on a request, such as BadWindow when a requestor window is destroyed during an INCR transfer, fail only that
+ * transfer. The default handler would exit the whole process.
+ */
+static int _error_handler(Display *dpy, XErrorEvent *err) {
+    (void)dpy;
+    failed_resource = err->resourceid;
+#ifdef DEBUG_MODE
+    fprintf(stderr, "X error %u on request %u\n", (unsigned)err->error_code, (unsigned)err->request_code);
+#else
+    (void)err;
+#endif
+    return 0;
+}
 
-            if (finished) break;
-        }
-    }
+static void _init(void) {
+    (void)XInitThreads();
+    (void)XSetErrorHandler(_error_handler);
 }
 
+void xclip_init(void) { (void)pthread_once(&init_once, _init); }
+
 static int doOut(Window win, unsigned long *len_ptr, char **buf_ptr, xclip_options *options) {
     *len_ptr = 0;
     *buf_ptr = NULL;
     Atom sel_type = None;
-    unsigned char *sel_buf = NULL; /* buffer for selection data */
-    unsigned long sel_len = 0;     /* length of sel_buf */
-    XEvent evt;                    /* X Event Structures */
-    unsigned int context = XCLIB_XCOUT_NONE;
+    xcout_ctx ctx; /* state of the transfer, with the buffer for selection data */
+    XEvent evt;    /* X Event Structures */
+    xcout_init(&ctx, options->dpy);
 
     while (1) {
         /* only get an event if xcout() is doing something */
-        if (context != XCLIB_XCOUT_NONE) XNextEvent(options->dpy, &evt);
+        if (ctx.context != XCLIB_XCOUT_NONE) XNextEvent(options->dpy, &evt);
 
         /* fetch the selection, or part of it */
-        xcout(options->dpy, win, evt, options->sseln, options->target, &sel_type, &sel_buf, &sel_len, &context);
+        xcout(options->dpy, win, evt, options->sseln, options->target, &sel_type, &ctx);
 
-        if (context == XCLIB_XCOUT_SELECTION_REFUSED) {
-            if (sel_buf) free(sel_buf);
+        if (ctx.context == XCLIB_XCOUT_SELECTION_REFUSED) {
+            if (ctx.buf) free(ctx.buf);
             return EXIT_FAILURE;
         }
 
-        if (options->is_targets && sel_type == XA_ATOM) {
-            const Atom *atom_buf = (Atom *)sel_buf;
-            size_t atom_len = sel_len / sizeof(Atom);
-            size_t out_len = 0;
-            size_t out_capacity = 128;
-            char *out_buf = xcmalloc(out_capacity);
-            out_buf[0] = 0;
-            while (atom_len--) {
-                char *atom_name = XGetAtomName(options->dpy, *atom_buf++);
-                const size_t atom_name_len = strnlen(atom_name, 511);
-                if (atom_name_len + out_len + 1 >= out_capacity) {
-                    out_capacity = atom_name_len + out_len + 1;
-                    out_buf = xcrealloc(out_buf, out_capacity);
-                }
-                if ((ssize_t)(out_capacity - out_len) >= 0 &&
-                    !snprintf_check(out_buf + out_len, out_capacity - out_len, "%s\n", atom_name))
-                    out_len += atom_name_len + 1;
-                XFree(atom_name);
-            }
-            *len_ptr = out_len;
-            *buf_ptr = out_buf;
-            if (sel_buf) free(sel_buf);
-            return EXIT_SUCCESS;
-        }
-
-        if (context == XCLIB_XCOUT_BAD_TARGET) {
-            if (options->target == XA_UTF8_STRING(options->dpy)) {
+        if (ctx.context == XCLIB_XCOUT_BAD_TARGET) {
+            if (options->target == options->utf8) {
                 /* fallback is needed. set XA_STRING to target and restart the loop. */
-                context = XCLIB_XCOUT_NONE;
+                ctx.context = XCLIB_XCOUT_NONE;
                 options->target = XA_STRING;
                 continue;
             } else {
                 /* no fallback available, exit with failure */
+                if (ctx.buf) free(ctx.buf);
                 return EXIT_FAILURE;
             }
         }
 
         /* only continue if xcout() is doing something */
-        if (context == XCLIB_XCOUT_NONE) break;
+        if (ctx.context == XCLIB_XCOUT_NONE) break;
+    }
+    /* xcout() leaves space for the terminating null byte. Therefore, the buffer is handed over without copying */
+    *len_ptr = ctx.len;
+    if (ctx.len > 0) {
+        ctx.buf[ctx.len] = 0;
+        *buf_ptr = (char *)ctx.buf;
+    } else if (ctx.buf) {
+        free(ctx.buf);
     }
 
-    *len_ptr = sel_len;
-    if (sel_len > 0) {
-        *buf_ptr = xcmalloc(sel_len + 1);
-        memcpy(*buf_ptr, sel_buf, sel_len);
-        (*buf_ptr)[sel_len] = 0;
+    return EXIT_SUCCESS;
+}
+
+static void _close_conn(void *arg) {
+    xclip_conn *conn = (xclip_conn *)arg;
+    if (conn->dpy && conn->pid == getpid()) {
+        XDestroyWindow(conn->dpy, conn->win);
+        XCloseDisplay(conn->dpy);
     }
+    free(conn);
+}
 
-    if (options->sseln == XA_STRING) {
-        XFree(sel_buf);
-    } else {
-        free(sel_buf);
+static void _make_conn_key(void) { (void)pthread_key_create(&conn_key, _close_conn); }
+
+/*
+ * Get the connection of the calling thread, opening it if needed.
+ * returns the connection on success or NULL on failure.
+ */
+static xclip_conn *_get_conn(void) {
+    if (pthread_once(&conn_key_once, _make_conn_key)) return NULL;
+    xclip_conn *conn = (xclip_conn *)pthread_getspecific(conn_key);
+    if (conn && conn->pid == getpid()) return conn;
+    if (conn) {
+        /* inherited from the parent process. The display is shared with the parent. Therefore, it is not closed */
+        free(conn);
+        (void)pthread_setspecific(conn_key, NULL);
     }
 
-    return EXIT_SUCCESS;
+    xclip_init();
+    conn = (xclip_conn *)calloc(1, sizeof(xclip_conn));
+    if (!conn) return NULL;
+    conn->pid = getpid();
+    if (!(conn->dpy = XOpenDisplay(NULL))) {
+#ifdef DEBUG_MODE
+        fputs("Connect X server failed\n", stderr);
+#endif
+        free(conn);
+        return NULL;
+    }
+    char *names[ATOM_CNT];
+    for (int i = 0; i < ATOM_CNT; i++) names[i] = _atom_names[i];
+    if (!XInternAtoms(conn->dpy, names, ATOM_CNT, False, conn->atoms) ||
+        pthread_setspecific(conn_key, conn)) {
+        XCloseDisplay(conn->dpy);
+        free(conn);
+        return NULL;
+    }
+
+    /* Create a window to trap events */
+    conn->win = XCreateSimpleWindow(conn->dpy, DefaultRootWindow(conn->dpy), 0, 0, 1, 1, 0, 0, 0);
+
+    /* get events about property changes */
+    XSelectInput(conn->dpy, conn->win, PropertyChangeMask);
+#ifdef DEBUG_MODE
+    fputs("Connected to X server\n", stderr);
+#endif
+    return conn;
 }
 
-int xclip_util(int io, const char *atom_name, uint32_t *len_ptr, char **buf_ptr) {
-    if (io == XCLIP_OUT) {
-        *len_ptr = 0;
-        *buf_ptr = NULL;
+/*
+ * Find the copied type for the target atom by its name, as the atom was not interned by _get_conn().
+ */
+static int8_t _copied_type_by_name(Display *dpy, Atom atom) {
+    char *name = XGetAtomName(dpy, atom);
+    if (!name) return COPIED_TYPE_NONE;
+    int8_t type = COPIED_TYPE_NONE;
+    if (!strncmp(name, "x-special/gnome-copied-files", 28)) {
+        type = COPIED_TYPE_FILE;
+    } else if (!(strncmp(name, "text/plain", 10) && strncmp(name, "text/html", 9))) {
+        type = COPIED_TYPE_TEXT;
     }
+    XFree(name);
+    return type;
+}
 
-    /* Declare variables */
-    Window win; /* Window */
-    int exit_code;
-    xclip_options options;
+/*
+ * Get the copied type for a target atom. Looks up the atom name only the first time the atom is seen.
+ */
+static int8_t _target_copied_type(xclip_conn *conn, Atom atom) {
+    if (atom == conn->atoms[ATOM_COPIED_FILES]) return COPIED_TYPE_FILE;
+    if (atom == conn->atoms[ATOM_UTF8_STRING] || atom == conn->atoms[ATOM_TEXT] || atom == conn->atoms[ATOM_PLAIN] ||
+        atom == conn->atoms[ATOM_PLAIN_UTF8])
+        return COPIED_TYPE_TEXT;
+    if (atom == None) return COPIED_TYPE_NONE;
+
+    /* atoms are never deleted while the server is running. Therefore, the cached types are always valid */
+    size_t ind = (size_t)(atom % TARGET_CACHE_LEN);
+    for (size_t i = 0; i < TARGET_CACHE_LEN; i++) {
+        target_class *entry = conn->targets + ind;
+        if (entry->atom == atom) return entry->copied_type;
+        if (entry->atom == None) {
+            entry->copied_type = _copied_type_by_name(conn->dpy, atom);
+            entry->atom = atom;
+            return entry->copied_type;
+        }
+        ind = (ind + 1) % TARGET_CACHE_LEN;
+    }
+    return _copied_type_by_name(conn->dpy, atom);
+}
+
+static void _clear_snapshot(void) {
+    if (snapshot.text.data) free(snapshot.text.data);
+    if (snapshot.files.data) free(snapshot.files.data);
+    memset(&snapshot.text, 0, sizeof(snapshot_item));
+    memset(&snapshot.files, 0, sizeof(snapshot_item));
+    snapshot.type_valid = 0;
+}
+
+void xclip_snapshot_start(void) {
+    pthread_mutex_lock(&snapshot_lock);
+    _clear_snapshot();
+    snapshot.generation++;
+    snapshot.enabled = 1;
+    pthread_mutex_unlock(&snapshot_lock);
+}
+
+void xclip_snapshot_stop(void) {
+    pthread_mutex_lock(&snapshot_lock);
+    _clear_snapshot();
+    snapshot.generation++;
+    snapshot.enabled = 0;
+    pthread_mutex_unlock(&snapshot_lock);
+}
+
+void xclip_owner_changed(unsigned long owner, unsigned long timestamp) {
+    pthread_mutex_lock(&snapshot_lock);
+    if (!snapshot.enabled || owner != snapshot.owner || timestamp != snapshot.timestamp) {
+        _clear_snapshot();
+        snapshot.generation++;
+        snapshot.owner = owner;
+        snapshot.timestamp = timestamp;
+    }
+    pthread_mutex_unlock(&snapshot_lock);
+}
+
+/*
+ * Get the snapshot item for the target given by atom_name, or NULL if the target is not kept in the snapshot.
+ */
+static inline snapshot_item *_snapshot_item(const char *atom_name) {
+    if (!atom_name) return &snapshot.text;
+    if (!strcmp(atom_name, _atom_names[ATOM_COPIED_FILES])) return &snapshot.files;
+    return NULL;
+}
+
+/*
+ * Copy the data of the snapshot item to a new buffer if the item is valid.
+ * Sets *gen_p to the current generation of the snapshot, which should be passed to _snapshot_put() after reading the
+ * data from the X server.
+ * returns 1 if the data is copied from the snapshot, or 0 otherwise.
+ */
+static int _snapshot_get(snapshot_item *item, unsigned long *gen_p, uint32_t *len_ptr, char **buf_ptr) {
+    int found = 0;
+    pthread_mutex_lock(&snapshot_lock);
+    *gen_p = snapshot.generation;
+    if (snapshot.enabled && item->valid) {
+        char *buf = malloc((size_t)item->len + 1);
+        if (buf) {
+            memcpy(buf, item->data, item->len);
+            buf[item->len] = 0;
+            *buf_ptr = buf;
+            *len_ptr = item->len;
+            found = 1;
+        }
+    }
+    pthread_mutex_unlock(&snapshot_lock);
+    return found;
+}
+
+/*
+ * Keep a copy of the data read from the X server in the snapshot item, unless the owner changed after the generation
+ * gen was taken by _snapshot_get().
+ */
+static void _snapshot_put(snapshot_item *item, unsigned long gen, const char *buf, uint32_t len) {
+    pthread_mutex_lock(&snapshot_lock);
+    if (snapshot.enabled && gen == snapshot.generation && !item->valid) {
+        item->data = malloc((size_t)len);
+        if (item->data) {
+            memcpy(item->data, buf, len);
+            item->len = len;
+            item->valid = 1;
+        }
+    }
+    pthread_mutex_unlock(&snapshot_lock);
+}
+
+int8_t xclip_copied_type(void) {
+    pthread_mutex_lock(&snapshot_lock);
+    const unsigned long gen = snapshot.generation;
+    const int cached = snapshot.enabled && snapshot.type_valid;
+    const int8_t cached_type = snapshot.copied_type;
+    pthread_mutex_unlock(&snapshot_lock);
+    if (cached) return cached_type;
 
-    options.target = XA_STRING;
+    xclip_conn *conn = _get_conn();
+    if (!conn) return COPIED_TYPE_NONE;
+    xclip_options options;
+    options.dpy = conn->dpy;
+    options.sseln = conn->atoms[ATOM_CLIPBOARD];
+    options.target = conn->atoms[ATOM_TARGETS];
+    options.utf8 = conn->atoms[ATOM_UTF8_STRING];
 
-    /* Connect to the X server. */
-    if ((options.dpy = XOpenDisplay(NULL))) {
-/* successful */
+    unsigned long len = 0;
+    char *buf = NULL;
+    if (doOut(conn->win, &len, &buf, &options) != EXIT_SUCCESS || !buf) {
 #ifdef DEBUG_MODE
-        fputs("Connected to X server\n", stderr);
+        puts("xclip read TARGETS failed");
 #endif
+        return COPIED_TYPE_NONE;
+    }
+    const Atom *atoms = (const Atom *)buf;
+    const size_t atom_cnt = len / sizeof(Atom);
+    int8_t copied_type = COPIED_TYPE_NONE;
+    for (size_t i = 0; i < atom_cnt; i++) {
+        const int8_t type = _target_copied_type(conn, atoms[i]);
+        if (type == COPIED_TYPE_FILE) {
+            copied_type = type;
+            break;
+        }
+        if (type == COPIED_TYPE_TEXT) copied_type = type;
+    }
+    free(buf);
+
+    pthread_mutex_lock(&snapshot_lock);
+    if (snapshot.enabled && gen == snapshot.generation) {
+        snapshot.copied_type = copied_type;
+        snapshot.type_valid = 1;
+    }
+    pthread_mutex_unlock(&snapshot_lock);
+    return copied_type;
+}
+
+/*
+ * Take the item offered with xclip_offer(), if any. Waits until an item is offered if wait is not 0.
+ * returns 1 if an item is taken, or 0 otherwise.
+ */
+static int _take_offer(owner_item *item, int wait) {
+    pthread_mutex_lock(&owner_lock);
+    while (wait && !offered.data) pthread_cond_wait(&owner_cond, &owner_lock);
+    const int taken = offered.data != NULL;
+    if (taken) {
+        *item = offered;
+        offered.data = NULL;
+    }
+    pthread_mutex_unlock(&owner_lock);
+    return taken;
+}
+
+/*
+ * Take control of the selection to serve the item, so that SelectionRequest events from other windows are received.
+ * atoms holds the ATOM_CLIPBOARD and ATOM_UTF8_STRING atoms of dpy. Sets *target_p to the target of the item.
+ */
+static void _own_selection(Display *dpy, Window win, const Atom *atoms, const owner_item *item, Atom *target_p) {
+    *target_p = item->atom_name ? XInternAtom(dpy, item->atom_name, False) : atoms[ATOM_UTF8_STRING];
+    create_temp_file();
+    /* FIXME: Should not use CurrentTime, according to ICCCM section 2.1 */
+    XSetSelectionOwner(dpy, atoms[ATOM_CLIPBOARD], win, CurrentTime);
+    XFlush(dpy);
+}
+
+/*
+ * Wait until an X event is received, or the owner is woken up by xclip_offer() through wake_fd, or timeout_ms elapses.
+ * Waits without a time limit if timeout_ms is negative.
+ * returns 1 if an X event is available, or 0 otherwise.
+ */
+static int _wait_event(Display *dpy, int wake_fd, int timeout_ms) {
+    if (XPending(dpy)) return 1;
+    struct pollfd fds[2] = {{.fd = ConnectionNumber(dpy), .events = POLLIN}, {.fd = wake_fd, .events = POLLIN}};
+    if (poll(fds, 2, timeout_ms) <= 0) return 0;
+    if (fds[1].revents & POLLIN) {
+        char buf[64];
+        if (read(wake_fd, buf, sizeof(buf)) < 0) return 0;
+    }
+    return XPending(dpy) > 0;
+}
+
+/*
+ * Stop serving the item to new requests. If an INCR transfer is reading the item, it is kept in *busy_p until the
+ * transfer ends, unless *busy_p already holds the item of the transfer. Otherwise, the item is freed.
+ */
+static void _retire_item(owner_item *item, Atom target, const xcin_ctx *ctx, owner_item *busy_p, Atom *busy_target_p) {
+    if (!item->data) return;
+    if (ctx->context == XCLIB_XCIN_INCR && !busy_p->data) {
+        *busy_p = *item;
+        *busy_target_p = target;
     } else {
-/* couldn't connect to X server. Print error and exit */
+        free(item->data);
+    }
+    item->data = NULL;
+}
+
+/*
+ * Serve the offered items as the owner of the clipboard selection. A new item replaces the served one immediately,
+ * while an INCR transfer in progress completes with the replaced item.
+ * If resident is 0, returns when another application takes the selection and no item is waiting. Otherwise, waits for
+ * new items forever.
+ */
+static int _serve(int resident) {
+    xclip_init();
+    Display *dpy = XOpenDisplay(NULL);
+    if (!dpy) {
 #ifdef DEBUG_MODE
         fputs("Connect X server failed\n", stderr);
 #endif
         return EXIT_FAILURE;
     }
+    /* only the first two atoms, CLIPBOARD and UTF8_STRING, are needed to own the selection */
+    char *names[ATOM_UTF8_STRING + 1] = {_atom_names[ATOM_CLIPBOARD], _atom_names[ATOM_UTF8_STRING]};
+    Atom atoms[ATOM_UTF8_STRING + 1];
+    if (!XInternAtoms(dpy, names, ATOM_UTF8_STRING + 1, False, atoms)) {
+        XCloseDisplay(dpy);
+        return EXIT_FAILURE;
+    }
 
-    /* parse selection command line option */
-    options.sseln = XA_CLIPBOARD(options.dpy);
+    /* Create a window to trap events */
+    Window win = XCreateSimpleWindow(dpy, DefaultRootWindow(dpy), 0, 0, 1, 1, 0, 0, 0);
 
-    /* parse target options */
-    if (atom_name == NULL) {
-        options.target = XA_UTF8_STRING(options.dpy);
-    } else {
-        options.target = XInternAtom(options.dpy, atom_name, False);
+    /* get events about property changes */
+    XSelectInput(dpy, win, PropertyChangeMask);
+
+    const int wake_fd = resident ? wake_pipe[0] : -1;
+    owner_item item = {0}; /* served to new requests */
+    owner_item busy = {0}; /* replaced item still read by the INCR transfer in progress */
+    Atom target = None;
+    Atom busy_target = None;
+    xcin_ctx ctx;
+    xcin_init(&ctx, dpy);
+    uint64_t last_event = 0;
+    while (1) {
+        owner_item next;
+        /* waits for an item only when there is nothing to serve */
+        if (_take_offer(&next, resident && !item.data && !busy.data)) {
+            _retire_item(&item, target, &ctx, &busy, &busy_target);
+            item = next;
+            _own_selection(dpy, win, atoms, &item, &target);
+        } else if (!item.data && !busy.data) {
+            break;
+        }
+
+        const int incr = ctx.context == XCLIB_XCIN_INCR;
+        if (!_wait_event(dpy, wake_fd, incr ? INCR_TIMEOUT_MS : -1)) {
+            if (incr && get_time_millis() - last_event >= INCR_TIMEOUT_MS) {
+#ifdef DEBUG_MODE
+                fputs("INCR transfer timed out\n", stderr);
+#endif
+                xcin_abort(dpy, &ctx);
+            }
+        } else {
+            XEvent evt;
+            XNextEvent(dpy, &evt);
+            last_event = get_time_millis();
+            if (busy.data) {
+                xcin(dpy, evt, busy_target, (const unsigned char *)busy.data, busy.len, &ctx);
+            } else {
+                xcin(dpy, evt, target, (const unsigned char *)item.data, item.len, &ctx);
+            }
+            if (evt.type == SelectionClear) _retire_item(&item, target, &ctx, &busy, &busy_target);
+        }
+        /* a request to the requestor window failed, such as when the window is destroyed */
+        if (ctx.context == XCLIB_XCIN_INCR && failed_resource == ctx.win) xcin_abort(dpy, &ctx);
+        failed_resource = None;
+        if (ctx.context != XCLIB_XCIN_INCR && busy.data) {
+            free(busy.data);
+            busy.data = NULL;
+        }
     }
 
-    if (atom_name && !strcmp("TARGETS", atom_name)) {
-        options.is_targets = 1;
-    } else {
-        options.is_targets = 0;
+    XDestroyWindow(dpy, win);
+    XCloseDisplay(dpy);
+    return EXIT_SUCCESS;
+}
+
+void xclip_offer(const char *atom_name, char *buf, uint32_t len) {
+    pthread_mutex_lock(&owner_lock);
+    if (offered.data) free(offered.data);
+    offered.data = buf;
+    offered.len = len;
+    offered.atom_name = atom_name;
+    pthread_cond_signal(&owner_cond);
+    if (wake_pipe[1] >= 0 && write(wake_pipe[1], "", 1) < 0) {
+#ifdef DEBUG_MODE
+        fputs("Waking clipboard owner failed\n", stderr);
+#endif
     }
+    pthread_mutex_unlock(&owner_lock);
+}
 
-    /* Create a window to trap events */
-    win = XCreateSimpleWindow(options.dpy, DefaultRootWindow(options.dpy), 0, 0, 1, 1, 0, 0, 0);
+int xclip_has_offer(void) {
+    pthread_mutex_lock(&owner_lock);
+    const int has_offer = offered.data != NULL;
+    pthread_mutex_unlock(&owner_lock);
+    return has_offer;
+}
 
-    /* get events about property changes */
-    XSelectInput(options.dpy, win, PropertyChangeMask);
+int xclip_serve(void) {
+    /* Avoid making the current directory in use, in case it will need to be umounted */
+    if (chdir("/") == -1) return EXIT_FAILURE;
+    return _serve(0);
+}
 
-    unsigned long len = 0;
-    if (io == XCLIP_IN) {
-        exit_code = doIn(win, *len_ptr, *buf_ptr, &options);
-    } else {
-        exit_code = doOut(win, &len, buf_ptr, &options);
+static void *_owner_thread_fn(void *arg) {
+    (void)arg;
+    _serve(1);
+    return NULL;
+}
+
+static void _start_owner(void) {
+    int fds[2];
+    if (pipe(fds) == 0) {
+        fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+        fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+        fcntl(fds[0], F_SETFL, O_NONBLOCK);
+        fcntl(fds[1], F_SETFL, O_NONBLOCK);
+        pthread_mutex_lock(&owner_lock);
+        wake_pipe[0] = fds[0];
+        wake_pipe[1] = fds[1];
+        pthread_mutex_unlock(&owner_lock);
     }
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, &_owner_thread_fn, NULL) == 0) pthread_detach(thread);
+}
+
+void xclip_start_owner(void) { (void)pthread_once(&owner_once, _start_owner); }
 
-    /* Disconnect from the X server */
-    XCloseDisplay(options.dpy);
+int xclip_util(const char *atom_name, uint32_t *len_ptr, char **buf_ptr) {
+    *len_ptr = 0;
+    *buf_ptr = NULL;
+    snapshot_item *item = _snapshot_item(atom_name);
+    unsigned long gen = 0;
+    if (item && _snapshot_get(item, &gen, len_ptr, buf_ptr)) return EXIT_SUCCESS;
+    xclip_conn *conn = _get_conn();
+    if (!conn) return EXIT_FAILURE;
+
+    xclip_options options;
+    options.dpy = conn->dpy;
+    options.sseln = conn->atoms[ATOM_CLIPBOARD];
+    options.utf8 = conn->atoms[ATOM_UTF8_STRING];
+
+    /* parse target options */
+    if (atom_name == NULL) {
+        options.target = conn->atoms[ATOM_UTF8_STRING];
+    } else if (!strcmp(atom_name, _atom_names[ATOM_COPIED_FILES])) {
+        options.target = conn->atoms[ATOM_COPIED_FILES];
+    } else {
+        options.target = XInternAtom(conn->dpy, atom_name, False);
+    }
 
-    if (io == XCLIP_IN) return exit_code;
+    unsigned long len = 0;
+    int exit_code = doOut(conn->win, &len, buf_ptr, &options);
 
     if (exit_code != EXIT_SUCCESS || len >= 0xFFFFFFFFUL || !*buf_ptr) {
         exit_code = EXIT_FAILURE;
@@ -243,6 +656,7 @@ int xclip_util(int io, const char *atom_name, uint32_t *len_ptr, char **buf_ptr)
     }
     if (exit_code == EXIT_SUCCESS) {
         *len_ptr = (uint32_t)len;
+        if (item) _snapshot_put(item, gen, *buf_ptr, *len_ptr);
     } else {
         if (*buf_ptr) free(*buf_ptr);
         *buf_ptr = NULL;
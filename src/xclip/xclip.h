@@ -1,19 +1,74 @@
 #ifndef XCLIP_XCLIP_H_
 #define XCLIP_XCLIP_H_
 
-#define XCLIP_IN 0
-#define XCLIP_OUT 1
-
 #include <stdint.h>
 
 /*
- * Get or set clipboard data
- * Allocates a memory buffer and set the pointer to buf_ptr in get mode.
- * Reads data from the provided memory buffer pointed by buf_ptr in set mode.
- * Gets or sets the size of the buffer in bytes from/to len_ptr.
+ * Make Xlib safe to use from several threads, and handle X protocol errors without exiting the process.
+ * Must be called before any other Xlib call of the process. The other functions of this file call it themselves, and
+ * are safe to call from several threads concurrently.
+ */
+extern void xclip_init(void);
+
+/*
+ * Get clipboard data for the target atom_name, or UTF8_STRING if atom_name is NULL.
+ * Allocates a memory buffer and set the pointer to buf_ptr. The buffer is null-terminated.
+ * Sets the size of the data in bytes to len_ptr.
  * Returns 0 on success.
  * Returns -1 if an error occured.
  */
-extern int xclip_util(int io, const char *atom_name, uint32_t *len_ptr, char **buf_ptr);
+extern int xclip_util(const char *atom_name, uint32_t *len_ptr, char **buf_ptr);
+
+/*
+ * Offer the len bytes at buf as the clipboard content for the target atom_name, or UTF8_STRING if atom_name is NULL.
+ * atom_name must be a string literal or otherwise outlive the item. buf must be allocated with malloc. This function
+ * takes the ownership of buf, which is served without copying it and freed when it is replaced.
+ * The item replaces any item offered earlier and not taken by the owner yet. The owner serves the new item to new
+ * requests immediately, and frees the old item when the transfer of it in progress, if any, ends.
+ */
+extern void xclip_offer(const char *atom_name, char *buf, uint32_t len);
+
+/*
+ * Check if an item is offered and not taken by the owner yet.
+ */
+extern int xclip_has_offer(void);
+
+/*
+ * Serve the offered items as the clipboard owner in the calling thread. Changes the working directory to "/".
+ * Returns when another application takes the selection and no item is waiting.
+ * returns EXIT_SUCCESS on success and EXIT_FAILURE on failure.
+ */
+extern int xclip_serve(void);
+
+/*
+ * Start the resident clipboard owner thread if it is not started yet. The thread serves the offered items for the
+ * rest of the life of the process.
+ */
+extern void xclip_start_owner(void);
+
+/*
+ * Get the type of the clipboard content from the TARGETS offered by the selection owner.
+ * Targets are matched by their atoms. The name of an atom is looked up only the first time it is seen.
+ * returns COPIED_TYPE_FILE, COPIED_TYPE_TEXT or COPIED_TYPE_NONE.
+ */
+extern int8_t xclip_copied_type(void);
+
+/*
+ * Start keeping a snapshot of the clipboard content, so that repeated reads of the same content do not need round
+ * trips to the X server or the selection owner. The caller must report every selection owner change with
+ * xclip_owner_changed() until xclip_snapshot_stop() is called.
+ */
+extern void xclip_snapshot_start(void);
+
+/*
+ * Stop keeping the snapshot of the clipboard content and free it.
+ */
+extern void xclip_snapshot_stop(void);
+
+/*
+ * Invalidate the snapshot if the selection is now owned by a different window or at a different time.
+ * owner and timestamp are the owner window and the selection timestamp from the XFixesSelectionNotify event.
+ */
+extern void xclip_owner_changed(unsigned long owner, unsigned long timestamp);
 
 #endif  // XCLIP_XCLIP_H_
@@ -52,7 +52,7 @@ fi
 
 # Export variables
 export MIN_PROTO=1
-export MAX_PROTO=3
+export MAX_PROTO=5
 export DETECTED_OS
 export TESTS_DIR="$(pwd)"
 export LOG_DIR="${TESTS_DIR}/server_output"
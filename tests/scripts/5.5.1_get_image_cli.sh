@@ -0,0 +1,3 @@
+#!/bin/bash
+
+. select_interface.sh
@@ -0,0 +1,4 @@
+#!/bin/bash
+
+proto=5
+. scripts/common/x.1.1_get_text.sh
@@ -0,0 +1,4 @@
+#!/bin/bash
+
+proto=5
+. scripts/common/x.2.1_send_text.sh
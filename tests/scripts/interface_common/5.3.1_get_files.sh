@@ -0,0 +1,4 @@
+#!/bin/bash
+
+proto=5
+. scripts/common/x.3.1_get_files.sh
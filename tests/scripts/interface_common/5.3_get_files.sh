@@ -0,0 +1,5 @@
+#!/bin/bash
+
+proto=5
+files_dir=files_v3
+. scripts/common/x.3_get_files.sh
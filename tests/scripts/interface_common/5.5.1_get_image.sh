@@ -0,0 +1,6 @@
+#!/bin/bash
+
+proto=5
+image=copied
+file=image.png
+. scripts/common/x.5_get_image.sh
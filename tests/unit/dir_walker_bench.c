@@ -0,0 +1,118 @@
+/*
+ * tests/unit/dir_walker_bench.c - scaling benchmark of the parallel directory walker
+ * Copyright (C) 2026 H. Thevindu J. Wijesekera
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Usage: dir_walker_bench [dir_count [files_per_dir [rounds]]]
+ * Creates a temporary tree of dir_count directories with files_per_dir empty files and an empty sub-directory each,
+ * and walks it with 1 to WALKER_MAX_THREADS threads. Every walk must succeed and list the same number of paths.
+ */
+
+#define _XOPEN_SOURCE 700
+
+#include <ftw.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <utils/dir_walker.h>
+
+#define BRANCHING 32
+
+void error(const char *msg) { fprintf(stderr, "%s\n", msg); }
+
+static double _now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1000.0 + (double)ts.tv_nsec / 1e6;
+}
+
+static int _remove_entry(const char *path, const struct stat *sb, int flag, struct FTW *ftw) {
+    (void)sb;
+    (void)flag;
+    (void)ftw;
+    return remove(path);
+}
+
+/*
+ * Create the tree under root. Directories are nested in groups of BRANCHING to have both wide and deep parts.
+ */
+static int _create_tree(const char *root, unsigned dir_cnt, unsigned file_cnt) {
+    char path[512];
+    for (unsigned d = 0; d < dir_cnt; d++) {
+        snprintf(path, sizeof(path), "%s/g%u", root, d / BRANCHING);
+        if (d % BRANCHING == 0 && mkdir(path, 0700)) return EXIT_FAILURE;
+        snprintf(path, sizeof(path), "%s/g%u/d%u", root, d / BRANCHING, d);
+        if (mkdir(path, 0700)) return EXIT_FAILURE;
+        snprintf(path, sizeof(path), "%s/g%u/d%u/empty", root, d / BRANCHING, d);
+        if (mkdir(path, 0700)) return EXIT_FAILURE;
+        for (unsigned f = 0; f < file_cnt; f++) {
+            snprintf(path, sizeof(path), "%s/g%u/d%u/f%u", root, d / BRANCHING, d, f);
+            FILE *fp = fopen(path, "w");
+            if (!fp) return EXIT_FAILURE;
+            fclose(fp);
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char **argv) {
+    const unsigned dir_cnt = argc > 1 ? (unsigned)strtoul(argv[1], NULL, 10) : 2000;
+    const unsigned file_cnt = argc > 2 ? (unsigned)strtoul(argv[2], NULL, 10) : 50;
+    const unsigned rounds = argc > 3 ? (unsigned)strtoul(argv[3], NULL, 10) : 5;
+    const uint32_t expected = dir_cnt * (file_cnt + 1);  // files and the empty leaf directories
+
+    char root[] = "/tmp/walker_bench_XXXXXX";
+    if (!mkdtemp(root)) {
+        perror("mkdtemp");
+        return EXIT_FAILURE;
+    }
+    int status = _create_tree(root, dir_cnt, file_cnt);
+    if (status != EXIT_SUCCESS) fputs("Couldn't create the tree\n", stderr);
+
+    const char *roots[] = {root};
+    printf("%u directories, %u paths, %ld processors\n", dir_cnt, expected, sysconf(_SC_NPROCESSORS_ONLN));
+    double base_ms = 0;
+    for (unsigned threads = 1; status == EXIT_SUCCESS && threads <= WALKER_MAX_THREADS; threads *= 2) {
+        double best_ms = -1;
+        for (unsigned r = 0; r < rounds; r++) {
+            path_store *store = new_path_store();
+            if (!store) {
+                status = EXIT_FAILURE;
+                break;
+            }
+            const double start = _now_ms();
+            const int walk_status = walk_dir_tree(roots, 1, 1, threads, NULL, store);
+            const double elapsed = _now_ms() - start;
+            const uint32_t cnt = path_store_count(store);
+            free_path_store(store);
+            if (walk_status != EXIT_SUCCESS || cnt != expected) {
+                printf("FAIL: %u threads listed %u of %u paths\n", threads, cnt, expected);
+                status = EXIT_FAILURE;
+                break;
+            }
+            if (best_ms < 0 || elapsed < best_ms) best_ms = elapsed;
+        }
+        if (status != EXIT_SUCCESS) break;
+        if (threads == 1) base_ms = best_ms;
+        printf("%2u threads: %8.2f ms  speedup %.2fx\n", threads, best_ms, base_ms / best_ms);
+    }
+
+    nftw(root, &_remove_entry, 64, FTW_DEPTH | FTW_PHYS);
+    return status;
+}
@@ -0,0 +1,107 @@
+/*
+ * tests/unit/utf8_check_bench.c - benchmark of utf8_check against u8_check of libunistring
+ * Copyright (C) 2026 H. Thevindu J. Wijesekera
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Usage: utf8_check_bench [size_kib [rounds]]
+ * Validates valid texts of ASCII, mixed Latin and multibyte characters, and CJK characters with u8_check() and with
+ * each implementation in utils/utf8_check.c, and reports the best time of the rounds.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistr.h>
+
+// the implementations are static
+#include <utils/utf8_check.c>
+
+typedef struct _impl {
+    const char *name;
+    check_fn fn;
+} impl;
+
+static const uint8_t *_via_u8_check(const uint8_t *s, const uint8_t *end) { return u8_check(s, (size_t)(end - s)); }
+
+static double _now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1000.0 + (double)ts.tv_nsec / 1e6;
+}
+
+/*
+ * Fill size bytes at buf by repeating the text, without splitting a character at the end.
+ * returns the filled length.
+ */
+static size_t _fill(uint8_t *buf, size_t size, const char *text) {
+    const size_t len = strlen(text);
+    size_t n = 0;
+    while (n + len <= size) {
+        memcpy(buf + n, text, len);
+        n += len;
+    }
+    return n;
+}
+
+int main(int argc, char **argv) {
+    const size_t size = (argc > 1 ? strtoul(argv[1], NULL, 10) : 4096) * 1024;
+    const unsigned rounds = argc > 2 ? (unsigned)strtoul(argv[2], NULL, 10) : 10;
+    static const char *const names[] = {"ascii", "mixed", "cjk"};
+    static const char *const texts[] = {
+        "The quick brown fox jumps over the lazy dog. 0123456789\n",
+        "Fa\xC3\xA7" "ade na\xC3\xAFve \xCE\xB1\xCE\xB2\xCE\xB3 \xE2\x82\xAC" "5 caf\xC3\xA9 \xF0\x9F\x98\x80 end\n",
+        "\xE6\x97\xA5\xE6\x9C\xAC\xE8\xAA\x9E\xE3\x81\xAE\xE6\x96\x87\xE7\xAB\xA0\xE3\x80\x82\xED\x95\x9C\xEA\xB5\xAD"};
+
+    impl impls[5];
+    int impl_cnt = 0;
+    impls[impl_cnt++] = (impl){"u8_check", &_via_u8_check};
+    impls[impl_cnt++] = (impl){"scalar", &_check_scalar};
+#ifdef UTF8_CHECK_SSE2
+    impls[impl_cnt++] = (impl){"sse2", &_check_sse2};
+#endif
+#ifdef UTF8_CHECK_AVX2
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) impls[impl_cnt++] = (impl){"avx2", &_check_avx2};
+#endif
+#ifdef UTF8_CHECK_NEON
+    impls[impl_cnt++] = (impl){"neon", &_check_neon};
+#endif
+
+    uint8_t *buf = malloc(size);
+    if (!buf) return EXIT_FAILURE;
+    int status = EXIT_SUCCESS;
+    for (size_t t = 0; t < sizeof(texts) / sizeof(texts[0]); t++) {
+        const size_t n = _fill(buf, size, texts[t]);
+        for (int i = 0; i < impl_cnt; i++) {
+            double best_ms = -1;
+            for (unsigned r = 0; r < rounds; r++) {
+                const double start = _now_ms();
+                const uint8_t *res = impls[i].fn(buf, buf + n);
+                const double elapsed = _now_ms() - start;
+                if (res) {
+                    printf("FAIL: %s rejected the %s text\n", impls[i].name, names[t]);
+                    status = EXIT_FAILURE;
+                }
+                if (best_ms < 0 || elapsed < best_ms) best_ms = elapsed;
+            }
+            printf("%-6s %-9s %8.3f ms  %6.2f GB/s\n", names[t], impls[i].name, best_ms, (double)n / best_ms / 1e6);
+        }
+    }
+    free(buf);
+    return status;
+}
@@ -0,0 +1,213 @@
+/*
+ * tests/unit/utf8_check_test.c - differential fuzz test of utf8_check against u8_check of libunistring
+ * Copyright (C) 2026 H. Thevindu J. Wijesekera
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Usage: utf8_check_test [iterations [seed]]
+ * Every implementation compiled in utils/utf8_check.c is run directly, besides the one selected by utf8_check(), so
+ * that the SSE2 and scalar paths are tested even on a CPU with AVX2. Each must return the same pointer as u8_check().
+ * Inputs are copied to buffers of their exact size, so that reads past the end are caught by sanitizers.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistr.h>
+
+// the implementations are static
+#include <utils/utf8_check.c>
+
+#define MAX_LEN 300
+
+typedef struct _impl {
+    const char *name;
+    check_fn fn;
+} impl;
+
+static impl impls[5];
+static int impl_cnt = 0;
+static unsigned long failures = 0;
+
+static uint64_t rng_state;
+
+static uint32_t _rand(void) {
+    // xorshift64*
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return (uint32_t)((rng_state * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+static const uint8_t *_via_utf8_check(const uint8_t *s, const uint8_t *end) { return utf8_check(s, (size_t)(end - s)); }
+
+static void _add_impl(const char *name, check_fn fn) {
+    impls[impl_cnt].name = name;
+    impls[impl_cnt].fn = fn;
+    impl_cnt++;
+}
+
+static void _init_impls(void) {
+    _add_impl("utf8_check", &_via_utf8_check);
+    _add_impl("scalar", &_check_scalar);
+#ifdef UTF8_CHECK_SSE2
+    _add_impl("sse2", &_check_sse2);
+#endif
+#ifdef UTF8_CHECK_AVX2
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        _add_impl("avx2", &_check_avx2);
+    } else {
+        puts("AVX2 is not supported by the CPU. Skipping the AVX2 path");
+    }
+#endif
+#ifdef UTF8_CHECK_NEON
+    _add_impl("neon", &_check_neon);
+#endif
+}
+
+/*
+ * Compare every implementation with u8_check on a copy of the n bytes at data.
+ */
+static void _check(const uint8_t *data, size_t n) {
+    uint8_t *buf = malloc(n ? n : 1);
+    if (!buf) {
+        fputs("malloc failed\n", stderr);
+        exit(EXIT_FAILURE);
+    }
+    memcpy(buf, data, n);
+    const uint8_t *expected = u8_check(buf, n);
+    for (int i = 0; i < impl_cnt; i++) {
+        const uint8_t *got = impls[i].fn(buf, buf + n);
+        if (got == expected) continue;
+        if (failures++ < 10) {
+            printf("FAIL: %s returned %ld, u8_check returned %ld for %zu bytes:", impls[i].name,
+                   got ? (long)(got - buf) : -1L, expected ? (long)(expected - buf) : -1L, n);
+            for (size_t j = 0; j < n; j++) printf(" %02X", buf[j]);
+            putchar('\n');
+        }
+    }
+    free(buf);
+}
+
+/*
+ * Append the encoding of a random code point, which may be a surrogate, beyond U+10FFFF, or overlong. Most of them are
+ * valid characters near the boundaries of the encoding lengths.
+ */
+static size_t _put_char(uint8_t *s) {
+    static const uint32_t bounds[] = {0x7F, 0x80, 0x7FF, 0x800, 0xFFFF, 0x10000, 0xD7FF, 0xD800, 0xDFFF, 0xE000,
+                                      0x10FFFF, 0x110000};
+    uint32_t cp;
+    switch (_rand() % 4) {
+        case 0:
+            cp = _rand() % 0x80;
+            break;
+        case 1:
+            cp = bounds[_rand() % (sizeof(bounds) / sizeof(bounds[0]))];
+            break;
+        default:
+            cp = _rand() % 0x120000;
+            break;
+    }
+    size_t len = cp < 0x80 ? 1 : (cp < 0x800 ? 2 : (cp < 0x10000 ? 3 : 4));
+    if (len < 4 && _rand() % 16 == 0) len++;  // overlong encoding
+    if (len == 1) {
+        s[0] = (uint8_t)cp;
+        return 1;
+    }
+    static const uint8_t lead[5] = {0, 0, 0xC0, 0xE0, 0xF0};
+    for (size_t i = len - 1; i > 0; i--) {
+        s[i] = (uint8_t)(0x80 | (cp & 0x3F));
+        cp >>= 6;
+    }
+    s[0] = (uint8_t)(lead[len] | cp);
+    return len;
+}
+
+/*
+ * Fill s with up to MAX_LEN bytes of random characters, and maybe corrupt some of them.
+ * returns the length.
+ */
+static size_t _random_input(uint8_t *s) {
+    const size_t target = _rand() % MAX_LEN;
+    size_t n = 0;
+    if (_rand() % 4 == 0) {
+        // long ASCII runs to take the fast paths of the SIMD checks
+        const size_t ascii = _rand() % (target + 1);
+        memset(s, 'a', ascii);
+        n = ascii;
+    }
+    while (n + 4 <= target) n += _put_char(s + n);
+    if (_rand() % 8 == 0) {
+        for (size_t i = 0; i < n; i++) s[i] = (uint8_t)_rand();
+        return n;
+    }
+    const uint32_t mutations = _rand() % 4;
+    for (uint32_t m = 0; m < mutations && n; m++) {
+        const size_t pos = _rand() % n;
+        switch (_rand() % 3) {
+            case 0:
+                s[pos] = (uint8_t)_rand();
+                break;
+            case 1:
+                s[pos] ^= (uint8_t)(1 << (_rand() % 8));
+                break;
+            default:
+                n = pos;  // truncate, possibly in the middle of a character
+                break;
+        }
+    }
+    return n;
+}
+
+int main(int argc, char **argv) {
+    const unsigned long iterations = argc > 1 ? strtoul(argv[1], NULL, 10) : 200000;
+    rng_state = argc > 2 ? strtoull(argv[2], NULL, 10) : 0x5EED;
+    if (!rng_state) rng_state = 1;
+    _init_impls();
+    printf("Testing %d implementations, seed %llu\n", impl_cnt, (unsigned long long)rng_state);
+
+    // every pair of bytes at every position of two SIMD blocks in ASCII text
+    uint8_t buf[MAX_LEN];
+    memset(buf, 'a', 64);
+    for (size_t pos = 0; pos < 63; pos++) {
+        for (unsigned pair = 0; pair < 0x10000; pair++) {
+            buf[pos] = (uint8_t)(pair >> 8);
+            buf[pos + 1] = (uint8_t)pair;
+            _check(buf, 64);
+        }
+        buf[pos] = 'a';
+        buf[pos + 1] = 'a';
+    }
+    // every non-ASCII first byte followed by bytes in and around the range of continuation bytes, cut at every length
+    for (unsigned c = 0x80; c < 0x100; c++) {
+        for (unsigned c1 = 0x70; c1 < 0xD0; c1++) {
+            for (unsigned c2 = 0x70; c2 < 0xD0; c2 += 0x10) {
+                const uint8_t seq[4] = {(uint8_t)c, (uint8_t)c1, (uint8_t)c2, 0x80};
+                for (size_t n = 0; n <= sizeof(seq); n++) _check(seq, n);
+            }
+        }
+    }
+
+    for (unsigned long i = 0; i < iterations; i++) _check(buf, _random_input(buf));
+
+    if (failures) {
+        printf("FAIL: %lu mismatches\n", failures);
+        return EXIT_FAILURE;
+    }
+    puts("PASS");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,410 @@
+/*
+ * tests/unit/xclip_alloc_test.c - allocation counts of the clipboard text transfers
+ * Copyright (C) 2026 H. Thevindu J. Wijesekera
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Checks that a text is copied once when it is read from the selection owner, and never when it is served to other
+ * applications, with and without INCR transfers. These are the paths of get_clipboard_text() and
+ * put_clipboard_text(), which hand the buffers to and from xclip_util() and xclip_offer().
+ * The program is linked with the Xlib functions below instead of libX11. They act as both the X server and the other
+ * application. malloc and friends are wrapped with the --wrap option of the linker to count the allocations made by
+ * the xclip code.
+ */
+
+#include <X11/Xatom.h>
+#include <X11/Xlib.h>
+#include <globals.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <utils/utils.h>
+#include <xclip/xclip.h>
+
+#define TEXT_LEN (1024 * 1024 + 7)
+#define CHUNK_LEN 65536
+#define QUEUE_LEN 64
+#define ATOM_BASE 100  // above the predefined atoms
+
+config configuration;
+
+void error_exit(const char *msg) {
+    fprintf(stderr, "%s\n", msg);
+    exit(EXIT_FAILURE);
+}
+
+uint64_t get_time_millis(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+void create_temp_file(void) {}
+
+/* allocation counters */
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+
+static unsigned large_allocs; /* allocations of at least TEXT_LEN bytes */
+static void *last_large;      /* the last of them */
+static const void *watched;   /* buffer whose release is counted */
+static unsigned watched_frees;
+
+static void _count(void *ptr, size_t size) {
+    if (ptr && size >= TEXT_LEN) {
+        large_allocs++;
+        last_large = ptr;
+    }
+}
+
+void *__wrap_malloc(size_t size);
+void *__wrap_malloc(size_t size) {
+    void *ptr = __real_malloc(size);
+    _count(ptr, size);
+    return ptr;
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size);
+void *__wrap_calloc(size_t nmemb, size_t size) {
+    void *ptr = __real_calloc(nmemb, size);
+    _count(ptr, nmemb * size);
+    return ptr;
+}
+
+void *__wrap_realloc(void *ptr, size_t size);
+void *__wrap_realloc(void *ptr, size_t size) {
+    void *new_ptr = __real_realloc(ptr, size);
+    _count(new_ptr, size);
+    return new_ptr;
+}
+
+void __wrap_free(void *ptr);
+void __wrap_free(void *ptr) {
+    if (ptr && ptr == watched) watched_frees++;
+    __real_free(ptr);
+}
+
+/* the X server and the other application */
+
+static const char *atom_names[32];
+static int atom_cnt = 0;
+
+static XEvent queue[QUEUE_LEN];
+static int queue_head = 0;
+static int queue_tail = 0;
+
+static Screen screen;
+static Display *display = NULL;
+
+static unsigned char *text;  /* the text held by the other application */
+static int incr_mode;        /* the text is transferred with INCR */
+static int incr_started;
+static size_t read_pos;
+
+/* properties written by the xclip owner */
+static const unsigned char *served_start;
+static size_t served_len;
+static int served_outside;
+
+static void _push_event(const XEvent *evt) {
+    if (queue_tail - queue_head >= QUEUE_LEN) error_exit("event queue full");
+    queue[queue_tail++ % QUEUE_LEN] = *evt;
+}
+
+static Atom _atom(const char *name) {
+    for (int i = 0; i < atom_cnt; i++) {
+        if (!strcmp(atom_names[i], name)) return (Atom)(ATOM_BASE + i);
+    }
+    if (atom_cnt >= (int)(sizeof(atom_names) / sizeof(atom_names[0]))) error_exit("too many atoms");
+    atom_names[atom_cnt] = name;
+    return (Atom)(ATOM_BASE + atom_cnt++);
+}
+
+Status XInitThreads(void) { return 1; }
+
+XErrorHandler XSetErrorHandler(XErrorHandler handler) {
+    (void)handler;
+    return NULL;
+}
+
+Display *XOpenDisplay(_Xconst char *name) {
+    (void)name;
+    if (!display) {
+        _XPrivDisplay dpy = __real_calloc(1, sizeof(*dpy));
+        if (!dpy) error_exit("calloc failed");
+        screen.root = 1;
+        dpy->screens = &screen;
+        dpy->nscreens = 1;
+        dpy->fd = -1;
+        display = (Display *)dpy;
+    }
+    return display;
+}
+
+int XCloseDisplay(Display *dpy) {
+    (void)dpy;
+    return 0;
+}
+
+Atom XInternAtom(Display *dpy, _Xconst char *name, Bool only_if_exists) {
+    (void)dpy;
+    (void)only_if_exists;
+    return _atom(name);
+}
+
+Status XInternAtoms(Display *dpy, char **names, int count, Bool only_if_exists, Atom *atoms) {
+    (void)dpy;
+    (void)only_if_exists;
+    for (int i = 0; i < count; i++) atoms[i] = _atom(names[i]);
+    return 1;
+}
+
+char *XGetAtomName(Display *dpy, Atom atom) {
+    (void)dpy;
+    (void)atom;
+    return NULL;
+}
+
+int XFree(void *data) {
+    __real_free(data);
+    return 1;
+}
+
+Window XCreateSimpleWindow(Display *dpy, Window parent, int x, int y, unsigned int width, unsigned int height,
+                           unsigned int border_width, unsigned long border, unsigned long background) {
+    (void)dpy;
+    (void)parent;
+    (void)x;
+    (void)y;
+    (void)width;
+    (void)height;
+    (void)border_width;
+    (void)border;
+    (void)background;
+    return 2;
+}
+
+int XDestroyWindow(Display *dpy, Window win) {
+    (void)dpy;
+    (void)win;
+    return 1;
+}
+
+int XSelectInput(Display *dpy, Window win, long mask) {
+    (void)dpy;
+    (void)win;
+    (void)mask;
+    return 1;
+}
+
+int XFlush(Display *dpy) {
+    (void)dpy;
+    return 1;
+}
+
+int XPending(Display *dpy) {
+    (void)dpy;
+    return queue_tail - queue_head;
+}
+
+int XNextEvent(Display *dpy, XEvent *evt) {
+    (void)dpy;
+    // the test would hang in a real client
+    if (queue_head == queue_tail) error_exit("waiting for an event that never comes");
+    *evt = queue[queue_head++ % QUEUE_LEN];
+    return 0;
+}
+
+long XExtendedMaxRequestSize(Display *dpy) {
+    (void)dpy;
+    return incr_mode ? CHUNK_LEN * 4 : TEXT_LEN * 4;
+}
+
+long XMaxRequestSize(Display *dpy) { return XExtendedMaxRequestSize(dpy); }
+
+/* the other application owns the selection and answers the request of xclip_util() */
+int XConvertSelection(Display *dpy, Atom selection, Atom target, Atom property, Window requestor, Time time) {
+    (void)dpy;
+    (void)time;
+    XEvent evt = {.xselection = {.type = SelectionNotify,
+                                 .requestor = requestor,
+                                 .selection = selection,
+                                 .target = target,
+                                 .property = property}};
+    _push_event(&evt);
+    return 1;
+}
+
+int XGetWindowProperty(Display *dpy, Window win, Atom property, long offset, long length, Bool delete,
+                       Atom req_type, Atom *type, int *format, unsigned long *nitems, unsigned long *bytes_after,
+                       unsigned char **prop) {
+    (void)dpy;
+    (void)offset;
+    (void)length;
+    (void)delete;
+    (void)req_type;
+    *bytes_after = 0;
+    if (incr_mode && !incr_started) {
+        incr_started = 1;
+        long *size = __real_malloc(sizeof(long));
+        if (!size) error_exit("malloc failed");
+        *size = TEXT_LEN;
+        *type = _atom("INCR");
+        *format = 32;
+        *nitems = 1;
+        *prop = (unsigned char *)size;
+    } else {
+        size_t len = TEXT_LEN - read_pos;
+        if (incr_mode && len > CHUNK_LEN) len = CHUNK_LEN;
+        unsigned char *data = __real_malloc(len + 1);
+        if (!data) error_exit("malloc failed");
+        memcpy(data, text + read_pos, len);
+        read_pos += len;
+        *type = _atom("UTF8_STRING");
+        *format = 8;
+        *nitems = len;
+        *prop = data;
+        if (!len) return Success;
+    }
+    // deleting the property asks for the next chunk, which is written at once
+    if (incr_mode) {
+        XEvent evt = {
+            .xproperty = {.type = PropertyNotify, .window = win, .atom = property, .state = PropertyNewValue}};
+        _push_event(&evt);
+    }
+    return Success;
+}
+
+/* the other application reads the selection served by xclip_serve() */
+int XChangeProperty(Display *dpy, Window win, Atom property, Atom type, int format, int mode,
+                    _Xconst unsigned char *data, int nelements) {
+    (void)dpy;
+    (void)format;
+    (void)mode;
+    if (type != _atom("INCR") && nelements > 0) {
+        if (data < served_start || data + nelements > served_start + TEXT_LEN) served_outside++;
+        served_len += (size_t)nelements;
+    }
+    XEvent evt = {.xproperty = {.type = PropertyNotify, .window = win, .atom = property, .state = PropertyDelete}};
+    // another application takes the selection once the transfer is complete
+    if (!incr_mode || (type != _atom("INCR") && nelements == 0)) evt.type = SelectionClear;
+    _push_event(&evt);
+    return 1;
+}
+
+Status XSendEvent(Display *dpy, Window win, Bool propagate, long mask, XEvent *evt) {
+    (void)dpy;
+    (void)win;
+    (void)propagate;
+    (void)mask;
+    (void)evt;
+    return 1;
+}
+
+int XSetSelectionOwner(Display *dpy, Atom selection, Window owner, Time time) {
+    (void)dpy;
+    (void)selection;
+    (void)owner;
+    (void)time;
+    return 1;
+}
+
+/* tests */
+
+static int failures = 0;
+
+static void _expect(int cond, const char *what, int incr) {
+    if (cond) return;
+    printf("FAIL: %s%s\n", what, incr ? " (INCR)" : "");
+    failures++;
+}
+
+static void _reset(int incr) {
+    queue_head = queue_tail = 0;
+    incr_mode = incr;
+    incr_started = 0;
+    read_pos = 0;
+    served_len = 0;
+    served_outside = 0;
+    large_allocs = 0;
+    last_large = NULL;
+    watched = NULL;
+    watched_frees = 0;
+}
+
+/*
+ * Read the text as get_clipboard_text() does. The buffer filled from the X properties is returned without copying.
+ */
+static void _test_read(int incr) {
+    _reset(incr);
+    uint32_t len;
+    char *buf;
+    const int status = xclip_util(NULL, &len, &buf);
+    _expect(status == EXIT_SUCCESS && buf && len == TEXT_LEN, "xclip_util read the text", incr);
+    if (status != EXIT_SUCCESS || !buf) return;
+    _expect(!memcmp(buf, text, TEXT_LEN) && buf[TEXT_LEN] == 0, "read text matches", incr);
+    _expect(large_allocs == 1, "one buffer allocated for the text read", incr);
+    _expect((void *)buf == last_large, "the text read is returned in that buffer", incr);
+    free(buf);
+}
+
+/*
+ * Serve the text as put_clipboard_text() does. The properties are written directly from the offered buffer, which is
+ * freed when the selection is lost.
+ */
+static void _test_serve(int incr) {
+    _reset(incr);
+    char *buf = __real_malloc(TEXT_LEN + 1);
+    if (!buf) error_exit("malloc failed");
+    memcpy(buf, text, TEXT_LEN);
+    buf[TEXT_LEN] = 0;
+    served_start = (const unsigned char *)buf;
+    watched = buf;
+    xclip_offer(NULL, buf, TEXT_LEN);
+
+    const XEvent request = {.xselectionrequest = {.type = SelectionRequest,
+                                                  .requestor = 3,
+                                                  .selection = _atom("CLIPBOARD"),
+                                                  .target = _atom("UTF8_STRING"),
+                                                  .property = _atom("XCLIP_IN")}};
+    _push_event(&request);
+    _expect(xclip_serve() == EXIT_SUCCESS, "xclip_serve succeeded", incr);
+    _expect(served_len == TEXT_LEN, "whole text served", incr);
+    _expect(!served_outside, "text served from the offered buffer", incr);
+    _expect(large_allocs == 0, "no buffer allocated for the text served", incr);
+    _expect(watched_frees == 1, "offered buffer freed once", incr);
+}
+
+int main(void) {
+    configuration.max_text_length = 4 * TEXT_LEN;
+    text = __real_malloc(TEXT_LEN);
+    if (!text) return EXIT_FAILURE;
+    for (size_t i = 0; i < TEXT_LEN; i++) text[i] = (unsigned char)('a' + i % 26);
+
+    for (int incr = 0; incr <= 1; incr++) {
+        _test_read(incr);
+        _test_serve(incr);
+    }
+    __real_free(text);
+
+    if (failures) return EXIT_FAILURE;
+    puts("PASS");
+    return EXIT_SUCCESS;
+}
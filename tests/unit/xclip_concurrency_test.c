@@ -0,0 +1,147 @@
+/*
+ * tests/unit/xclip_concurrency_test.c - concurrent reads and offers of the X clipboard
+ * Copyright (C) 2026 H. Thevindu J. Wijesekera
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Runs xclip_util() and xclip_copied_type() in reader threads while writer threads keep replacing the clipboard
+ * content with xclip_offer(), served by the resident owner thread. Every text read must be one of the offered items.
+ * Needs an X server, and is skipped when DISPLAY is not set.
+ */
+
+#include <X11/Xlib.h>
+#include <globals.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <utils/utils.h>
+#include <xclip/xclip.h>
+
+#define READERS 4
+#define WRITERS 2
+#define ROUNDS 200
+#define PREFIX "xclip-test "
+
+config configuration;
+
+void error_exit(const char *msg) {
+    fprintf(stderr, "%s\n", msg);
+    exit(EXIT_FAILURE);
+}
+
+uint64_t get_time_millis(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+void create_temp_file(void) {}
+
+static pthread_mutex_t fail_lock = PTHREAD_MUTEX_INITIALIZER;
+static int failures = 0;
+
+static void _fail(const char *msg, const char *data, uint32_t len) {
+    pthread_mutex_lock(&fail_lock);
+    failures++;
+    fprintf(stderr, "FAIL: %s [%.*s]\n", msg, (int)len, data ? data : "");
+    pthread_mutex_unlock(&fail_lock);
+}
+
+/*
+ * Check that the text is empty or a complete item offered by a writer, as "<PREFIX><writer> <round>".
+ */
+static void _check_text(const char *buf, uint32_t len) {
+    if (len == 0) return;
+    unsigned w, r;
+    char tail;
+    char text[64];
+    if (len >= sizeof(text)) {
+        _fail("text too long", buf, 32);
+        return;
+    }
+    memcpy(text, buf, len);
+    text[len] = 0;
+    if (strncmp(text, PREFIX, sizeof(PREFIX) - 1) ||
+        sscanf(text + sizeof(PREFIX) - 1, "%u %u%c", &w, &r, &tail) != 2 || w >= WRITERS || r >= ROUNDS) {
+        _fail("unexpected text", buf, len);
+    }
+}
+
+static void *_reader_fn(void *arg) {
+    (void)arg;
+    for (int i = 0; i < ROUNDS; i++) {
+        uint32_t len;
+        char *buf;
+        if (xclip_util(NULL, &len, &buf) == EXIT_SUCCESS && buf) _check_text(buf, len);
+        free(buf);
+        (void)xclip_copied_type();
+    }
+    return NULL;
+}
+
+static void *_writer_fn(void *arg) {
+    const unsigned w = (unsigned)(size_t)arg;
+    for (unsigned r = 0; r < ROUNDS; r++) {
+        char *buf = malloc(64);
+        if (!buf) return NULL;
+        const int len = snprintf(buf, 64, PREFIX "%u %u", w, r);
+        xclip_offer(NULL, buf, (uint32_t)len);
+        usleep(500);
+    }
+    return NULL;
+}
+
+int main(void) {
+    configuration.max_text_length = 1 << 20;
+    const char *display = getenv("DISPLAY");
+    Display *dpy = display && display[0] ? XOpenDisplay(NULL) : NULL;
+    if (!dpy) {
+        puts("SKIP: no X display");
+        return EXIT_SUCCESS;
+    }
+    XCloseDisplay(dpy);
+
+    xclip_start_owner();
+    pthread_t readers[READERS];
+    pthread_t writers[WRITERS];
+    for (size_t i = 0; i < WRITERS; i++) pthread_create(&writers[i], NULL, &_writer_fn, (void *)i);
+    for (size_t i = 0; i < READERS; i++) pthread_create(&readers[i], NULL, &_reader_fn, NULL);
+    for (size_t i = 0; i < WRITERS; i++) pthread_join(writers[i], NULL);
+    for (size_t i = 0; i < READERS; i++) pthread_join(readers[i], NULL);
+
+    /* the last offer must be served once the writers stop */
+    char *last = strdup(PREFIX "0 0");
+    if (!last) return EXIT_FAILURE;
+    xclip_offer(NULL, last, (uint32_t)strlen(last));
+    int served = 0;
+    for (int i = 0; i < 200 && !served; i++) {
+        uint32_t len;
+        char *buf;
+        if (xclip_util(NULL, &len, &buf) == EXIT_SUCCESS && buf) {
+            served = len == sizeof(PREFIX "0 0") - 1 && !memcmp(buf, PREFIX "0 0", len);
+        }
+        free(buf);
+        if (!served) usleep(10000);
+    }
+    if (!served) _fail("last offer was not served", NULL, 0);
+
+    if (failures) return EXIT_FAILURE;
+    puts("PASS");
+    return EXIT_SUCCESS;
+}
@@ -164,17 +164,18 @@ def handle_get_file(sock: socket.socket, version: int) -> None:
         path = 'files_v1'
     elif version == 2:
         path = 'files_v2'
-    elif version == 3 or version == 4:
+    elif version >= 3:
         path = 'files_v3'
     os.chdir(os.path.join(FILES_DIR, path))
-    file_cnt = 0
-    for _, dirs, files in os.walk('.'):
-        files = list(filter(lambda f: f[0] != '.', files))
-        file_cnt += len(files)
-        if version >= 3 and len(files) == 0 and len(dirs) == 0:
-            file_cnt += 1
-    print(f'Sending {file_cnt} files')
-    send_int(sock, file_cnt)
+    if version < 5:
+        file_cnt = 0
+        for _, dirs, files in os.walk('.'):
+            files = list(filter(lambda f: f[0] != '.', files))
+            file_cnt += len(files)
+            if version >= 3 and len(files) == 0 and len(dirs) == 0:
+                file_cnt += 1
+        print(f'Sending {file_cnt} files')
+        send_int(sock, file_cnt)
     for root, dirs, files in os.walk('.'):
         files = list(filter(lambda f: f[0] != '.', files))
         files.sort()
@@ -183,6 +184,9 @@ def handle_get_file(sock: socket.socket, version: int) -> None:
             send_file(sock, os.path.join(root, f))
         if version >= 3 and len(files) == 0 and len(dirs) == 0:
             send_file(sock, root)
+    if version >= 5:
+        send_int(sock, 0) # end of the file list
+        print('Sent end of files')
     if version < 4:
         return
     if read_ack(sock):
@@ -192,15 +196,22 @@ def handle_send_file(sock: socket.socket, version: int) -> None:
     sock.sendall(STATUS_OK)
     if version == 1:
         file_cnt = 1
-    else:
+    elif version < 5:
         file_cnt = read_int(sock)
-    if file_cnt <= 0:
+    else:
+        file_cnt = None # the file list ends with a zero name length
+    if file_cnt is not None and file_cnt <= 0:
         print(f'Invalid file count {file_cnt}')
         return
     received_list = []
-    for _ in range(file_cnt):
+    end_received = False
+    while file_cnt is None or len(received_list) < file_cnt:
+        name_len = read_int(sock)
+        if file_cnt is None and name_len == 0:
+            end_received = True
+            break
         received_list.append([])
-        fname = read_data(sock).decode('utf-8')
+        fname = read_data(sock, name_len).decode('utf-8')
         received_list[-1].append(f'Received file name {fname}')
         file_sz = read_int(sock)
         received_list[-1].append(f'Received file size {file_sz}')
@@ -219,6 +230,8 @@ def handle_send_file(sock: socket.socket, version: int) -> None:
     for messages in received_list:
         for message in messages:
             print(message)
+    if end_received:
+        print('Received end of files')
     if version < 4:
         return
     if send_ack(sock):
@@ -271,7 +284,7 @@ def handle_protocol(sock: socket.socket, version: int) -> None:
 
     if version == 1 or version == 2:
         ALLOWED_METHODS = [1,2,3,4,5,125]
-    elif version == 3 or version == 4:
+    elif version >= 3:
         ALLOWED_METHODS = [1,2,3,4,5,6,7,125]
     if method not in ALLOWED_METHODS:
         sock.sendall(STATUS_UNKNOWN_METHOD)